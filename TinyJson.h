@@ -680,6 +680,43 @@ private:
         AssertMoreData("Abrupt end to json whilst reading number");
     }
 };//end of struct JsonProcessor
+
+/**
+ * @brief Heap used by a parsed json document, split by what it is used for.
+ * The node sizes for std::map are an estimate, three pointers and the colour, which is what the common libraries use.
+ */
+struct JsonMemoryUsage
+{
+    size_t mNodes = 0;      //!< The JsonValues themselves, the map nodes and the array storage.
+    size_t mKeys = 0;       //!< Key strings too long for the small string buffer.
+    size_t mStrings = 0;    //!< Number and string values too long for the small string buffer.
+};
+
+/**
+ * @brief Walks the document adding up the heap it uses, the value passed in is not counted as it's not on the heap.
+ */
+inline void GetMemoryUsage(const JsonValue& pValue,JsonMemoryUsage& rUsage)
+{
+    const size_t SMALL_STRING = std::string().capacity();
+    const size_t MAP_NODE = (sizeof(void*) * 4) + sizeof(std::pair<const std::string,JsonValue>);
+
+    if( pValue.mValue.capacity() > SMALL_STRING )
+        rUsage.mStrings += pValue.mValue.capacity() + 1;
+
+    rUsage.mNodes += pValue.mArray.capacity() * sizeof(JsonValue);
+    for( const auto& value : pValue.mArray )
+    {
+        GetMemoryUsage(value,rUsage);
+    }
+
+    rUsage.mNodes += pValue.mObject.size() * MAP_NODE;
+    for( const auto& keyValue : pValue.mObject )
+    {
+        if( keyValue.first.capacity() > SMALL_STRING )
+            rUsage.mKeys += keyValue.first.capacity() + 1;
+        GetMemoryUsage(keyValue.second,rUsage);
+    }
+}
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 };// namespace tinyjson
 #endif //TINY_JSON_H
\ No newline at end of file
@@ -19,13 +19,24 @@
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 #include <assert.h>
 
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <curl/curl.h>
 
 #include "TinyWeather.h"
 #include "TinyJson.h"
+#ifndef TINYWEATHER_FIXED_CAPACITY
+	#include "TinyWeatherCache.h"
+#endif
 
 namespace tinyweather{
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -33,137 +44,1334 @@ const std::time_t ONE_MINUTE = (60);
 const std::time_t ONE_HOUR = (ONE_MINUTE * 60);
 const std::time_t ONE_DAY = (ONE_HOUR*24);
 
+static const char* ONE_CALL_URL = "http://api.openweathermap.org/data/2.5/onecall";
+
 static const std::time_t RoundToHour(const std::time_t pTime)
 {
-    return pTime - (pTime%ONE_HOUR);
+    return pTime - (pTime%ONE_HOUR);
+}
+
+/**
+ * @brief Heap used by a string, nothing if it fits in the small string buffer.
+ */
+static size_t GetStringHeap(const std::string& pString)
+{
+	return pString.capacity() > std::string().capacity() ? pString.capacity() + 1 : 0;
+}
+
+/**
+ * @brief Memory used by a forecast container. A std::vector is all heap, a FixedVector is all inside the object,
+ * GetInlineBytes is how much of the object it is so that is not counted twice.
+ */
+template<typename T> static size_t GetContainerBytes(const std::vector<T>& pVector){return pVector.capacity() * sizeof(T);}
+template<typename T,size_t CAPACITY> static size_t GetContainerBytes(const FixedVector<T,CAPACITY>& pVector){return sizeof(pVector);}
+template<typename T> static size_t GetInlineBytes(const std::vector<T>&){return 0;}
+template<typename T,size_t CAPACITY> static size_t GetInlineBytes(const FixedVector<T,CAPACITY>& pVector){return sizeof(pVector);}
+
+static int CURLWriter(char *data, size_t size, size_t nmemb,std::string *writerData)
+{
+	if(writerData == NULL)
+		return 0;
+
+	writerData->append(data, size*nmemb);
+
+	return size * nmemb;
+}
+
+#ifdef TINYWEATHER_FIXED_CAPACITY
+/**
+ * @brief The buffer the response is downloaded into in the fixed capacity build.
+ */
+struct ResponseBuffer
+{
+	char* mData;
+	size_t mSize;
+	size_t mUsed;
+};
+
+static size_t CURLBufferWriter(char *data, size_t size, size_t nmemb,ResponseBuffer *writerData)
+{
+	const size_t bytes = size * nmemb;
+	if( writerData == NULL || writerData->mUsed + bytes > writerData->mSize )
+		return 0;// Returning less than we were given stops the transfer with an error.
+
+	memcpy(writerData->mData + writerData->mUsed,data,bytes);
+	writerData->mUsed += bytes;
+	return bytes;
+}
+
+/**
+ * @brief Reads json in place for the fixed capacity build, there is no DOM so nothing is allocated.
+ * A value is just where its text starts and ends, looking up a key or an array index scans for it. The scan starts
+ * where the last one was found, as the forecast is read in about the order it is written, so it's mostly one step.
+ * Has the same getters as tinyjson::JsonValue so the same code reads the forecast from either. Strings are
+ * returned as they are in the json, the same as tinyjson, and bad json reads as missing values, not exceptions.
+ */
+class FixedJson
+{
+public:
+	FixedJson():mBegin(nullptr),mEnd(nullptr),mHint(nullptr),mHintIndex(0){}
+	FixedJson(const char* pBegin,const char* pEnd):mBegin(pBegin),mEnd(pEnd),mHint(nullptr),mHintIndex(0)
+	{
+		mBegin = SkipWhiteSpace(mBegin,mEnd);
+		mEnd = SkipValue(mBegin,mEnd);
+		if( mEnd == nullptr )
+			mBegin = nullptr;
+	}
+
+	tinyjson::JsonValueType GetType()const
+	{
+		if( mBegin == nullptr )
+			return tinyjson::JsonValueType::INVALID;
+
+		switch( *mBegin )
+		{
+		case '{':	return tinyjson::JsonValueType::OBJECT;
+		case '[':	return tinyjson::JsonValueType::ARRAY;
+		case '\"':	return tinyjson::JsonValueType::STRING;
+		case 't':
+		case 'f':	return tinyjson::JsonValueType::BOOLEAN;
+		case 'n':	return tinyjson::JsonValueType::NULL_VALUE;
+		}
+		return *mBegin == '-' || (*mBegin >= '0' && *mBegin <= '9') ? tinyjson::JsonValueType::NUMBER : tinyjson::JsonValueType::INVALID;
+	}
+
+	FixedJson operator [](std::string_view pKey)const
+	{
+		if( GetType() != tinyjson::JsonValueType::OBJECT )
+			return FixedJson();
+
+		// From the last one found to the end, then from the start.
+		const char* start = mHint ? mHint : mBegin + 1;
+		FixedJson found;
+		if( FindKey(start,mEnd,pKey,found) || (start != mBegin + 1 && FindKey(mBegin + 1,start,pKey,found)) )
+			return found;
+		return FixedJson();
+	}
+
+	FixedJson operator [](size_t pIndex)const
+	{
+		if( GetType() != tinyjson::JsonValueType::ARRAY )
+			return FixedJson();
+
+		size_t index = 0;
+		const char* pos = mBegin + 1;
+		if( mHint && pIndex >= mHintIndex )
+		{
+			index = mHintIndex;
+			pos = mHint;
+		}
+
+		for( ; pos != nullptr ; index++ )
+		{
+			pos = SkipWhiteSpace(pos,mEnd);
+			if( pos == mEnd || *pos == ']' )
+				break;
+
+			const char* end = SkipValue(pos,mEnd);
+			if( index == pIndex )
+			{
+				mHint = pos;
+				mHintIndex = index;
+				return FixedJson(pos,end);
+			}
+			pos = SkipSeparator(end,mEnd);
+		}
+		return FixedJson();
+	}
+
+	size_t GetArraySize()const
+	{
+		if( GetType() != tinyjson::JsonValueType::ARRAY )
+			return 0;
+
+		size_t count = 0;
+		for( const char* pos = mBegin + 1 ; pos != nullptr ; count++ )
+		{
+			pos = SkipWhiteSpace(pos,mEnd);
+			if( pos == mEnd || *pos == ']' )
+				break;
+			pos = SkipSeparator(SkipValue(pos,mEnd),mEnd);
+		}
+		return count;
+	}
+
+	bool HasValue(std::string_view pKey)const{return (*this)[pKey].mBegin != nullptr;}
+	tinyjson::JsonValueType GetType(std::string_view pKey)const{return (*this)[pKey].GetType();}
+	size_t GetArraySize(std::string_view pKey)const{return (*this)[pKey].GetArraySize();}
+
+	std::string_view GetString(std::string_view pKey)const
+	{
+		const FixedJson value = (*this)[pKey];
+		if( value.GetType() != tinyjson::JsonValueType::STRING )
+			return std::string_view();
+		return std::string_view(value.mBegin + 1,value.mEnd - value.mBegin - 2);
+	}
+
+	double GetDouble(std::string_view pKey,double pDefault = 0.0)const
+	{
+		char number[NUMBER_SIZE];
+		return GetNumber(pKey,number) ? strtod(number,nullptr) : pDefault;
+	}
+
+	float GetFloat(std::string_view pKey,float pDefault = 0.0f)const
+	{
+		char number[NUMBER_SIZE];
+		return GetNumber(pKey,number) ? strtof(number,nullptr) : pDefault;
+	}
+
+	uint64_t GetUInt64(std::string_view pKey,uint64_t pDefault = 0)const
+	{
+		char number[NUMBER_SIZE];
+		return GetNumber(pKey,number) ? strtoull(number,nullptr,10) : pDefault;
+	}
+
+	uint32_t GetUInt32(std::string_view pKey,uint32_t pDefault = 0)const
+	{
+		char number[NUMBER_SIZE];
+		return GetNumber(pKey,number) ? (uint32_t)strtoul(number,nullptr,10) : pDefault;
+	}
+
+	int32_t GetInt32(std::string_view pKey,int32_t pDefault = 0)const
+	{
+		char number[NUMBER_SIZE];
+		return GetNumber(pKey,number) ? (int32_t)strtol(number,nullptr,10) : pDefault;
+	}
+
+private:
+	static const size_t NUMBER_SIZE = 64;
+
+	const char* mBegin;				//!< First character of the value, nullptr if there is not one.
+	const char* mEnd;				//!< One past the last.
+	mutable const char* mHint;		//!< Where the last key or index was found.
+	mutable size_t mHintIndex;
+
+	/**
+	 * @brief Copies the number out so it has a terminating zero for the C library to read it.
+	 */
+	bool GetNumber(std::string_view pKey,char (&rNumber)[NUMBER_SIZE])const
+	{
+		const FixedJson value = (*this)[pKey];
+		const size_t length = value.mEnd - value.mBegin;
+		if( value.GetType() != tinyjson::JsonValueType::NUMBER || length >= NUMBER_SIZE )
+			return false;
+
+		memcpy(rNumber,value.mBegin,length);
+		rNumber[length] = 0;
+		return true;
+	}
+
+	bool FindKey(const char* pPos,const char* pEnd,std::string_view pKey,FixedJson& rFound)const
+	{
+		while( pPos != nullptr )
+		{
+			pPos = SkipWhiteSpace(pPos,pEnd);
+			if( pPos == pEnd || *pPos != '\"' )
+				return false;
+
+			const char* keyEnd = SkipString(pPos,pEnd);
+			const char* value = keyEnd ? SkipWhiteSpace(keyEnd,pEnd) : nullptr;
+			if( value == nullptr || value == pEnd || *value != ':' )
+				return false;
+
+			value = SkipWhiteSpace(value + 1,mEnd);
+			const char* valueEnd = SkipValue(value,mEnd);
+			if( valueEnd == nullptr )
+				return false;
+
+			const char* next = SkipSeparator(valueEnd,mEnd);
+			if( std::string_view(pPos + 1,keyEnd - pPos - 2) == pKey )
+			{
+				mHint = next;
+				rFound = FixedJson(value,valueEnd);
+				return true;
+			}
+			pPos = next;
+		}
+		return false;
+	}
+
+	static const char* SkipWhiteSpace(const char* pPos,const char* pEnd)
+	{
+		while( pPos != pEnd && (*pPos == ' ' || *pPos == '\t' || *pPos == '\n' || *pPos == '\r') )
+		{
+			pPos++;
+		}
+		return pPos;
+	}
+
+	/**
+	 * @brief Moves past the comma after a value, nullptr if it was the last one.
+	 */
+	static const char* SkipSeparator(const char* pPos,const char* pEnd)
+	{
+		if( pPos == nullptr )
+			return nullptr;
+		pPos = SkipWhiteSpace(pPos,pEnd);
+		return pPos != pEnd && *pPos == ',' ? pPos + 1 : nullptr;
+	}
+
+	/**
+	 * @brief Returns one past the closing quote, nullptr if the string is not closed.
+	 */
+	static const char* SkipString(const char* pPos,const char* pEnd)
+	{
+		for( pPos++ ; pPos < pEnd ; pPos++ )
+		{
+			if( *pPos == '\\' )
+				pPos++;
+			else if( *pPos == '\"' )
+				return pPos + 1;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * @brief Returns one past the end of the value, nullptr if it is not a whole value.
+	 */
+	static const char* SkipValue(const char* pPos,const char* pEnd)
+	{
+		if( pPos == nullptr || pPos == pEnd )
+			return nullptr;
+
+		if( *pPos == '\"' )
+			return SkipString(pPos,pEnd);
+
+		if( *pPos == '{' || *pPos == '[' )
+		{
+			int depth = 0;
+			while( pPos < pEnd )
+			{
+				if( *pPos == '\"' )
+				{
+					pPos = SkipString(pPos,pEnd);
+					if( pPos == nullptr )
+						return nullptr;
+					continue;
+				}
+
+				if( *pPos == '{' || *pPos == '[' )
+					depth++;
+				else if( (*pPos == '}' || *pPos == ']') && --depth == 0 )
+					return pPos + 1;
+				pPos++;
+			}
+			return nullptr;
+		}
+
+		// Number, true, false or null.
+		const char* start = pPos;
+		while( pPos != pEnd && *pPos != ',' && *pPos != '}' && *pPos != ']' && *pPos != ' ' && *pPos != '\t' && *pPos != '\n' && *pPos != '\r' )
+		{
+			pPos++;
+		}
+		return pPos != start ? pPos : nullptr;
+	}
+};
+#endif //#ifdef TINYWEATHER_FIXED_CAPACITY
+
+#ifndef TINYWEATHER_FIXED_CAPACITY
+/**
+ * @brief Used to check a response fetched in the background before it goes in the cache, so an error reply does not replace a good one.
+ */
+static bool IsWeatherReport(const std::string& pJson)
+{
+	try
+	{
+		tinyjson::JsonProcessor json(pJson);
+		const tinyjson::JsonValue& weather = json.GetRoot();
+		return weather.HasValue("current") || weather.GetArraySize("hourly") > 0 || weather.GetArraySize("daily") > 0;
+	}
+	catch(std::runtime_error &e)
+	{
+		std::cerr << "Failed to read weather: " << e.what() << "\n";
+	}
+	return false;
+}
+#endif
+
+/**
+ * @brief Sets the value and returns pChanged if it moved by more than the threshold since it was last reported, else zero.
+ * Measured from the last reported value, not the last one read, so a value creeping in steps under the threshold is
+ * still reported once it has moved far enough. rReported can be rValue when there are no thresholds.
+ */
+template<typename T> static uint32_t UpdateValue(T& rValue,T& rReported,T pNew,float pThreshold,uint32_t pChanged)
+{
+	const bool changed = std::fabs((double)pNew - (double)rReported) > pThreshold;
+	rValue = pNew;
+	if( changed )
+		rReported = pNew;
+	return changed ? pChanged : 0;
+}
+
+static uint32_t UpdateValue(Temperature& rValue,Temperature& rReported,float pKelvin,float pThreshold,uint32_t pChanged)
+{
+	const bool changed = std::fabs(pKelvin - rReported.k) > pThreshold;
+	rValue.Set(pKelvin);
+	if( changed )
+		rReported.Set(pKelvin);
+	return changed ? pChanged : 0;
+}
+
+static uint32_t UpdateValue(WeatherTime& rValue,std::time_t pNew,int32_t pTimezoneOffset,uint32_t pChanged)
+{
+	// Only set when it changes, saves working out the date again.
+	if( rValue.mUTC == pNew && rValue.mTimezoneOffset == pTimezoneOffset )
+		return 0;
+	rValue.Set(pNew,pTimezoneOffset);
+	return pChanged;
+}
+
+/**
+ * @brief For the current and hourly data rain and snow are an object with the volume for the last hour, for daily it's just the volume.
+ */
+template<typename JSON> static float GetPrecipitation(const JSON& pJson,const char* pKey)
+{
+	if( pJson.GetType(pKey) == tinyjson::JsonValueType::OBJECT )
+		return pJson[pKey].GetFloat("1h");
+	return pJson.GetFloat(pKey);
+}
+
+template<typename JSON> static uint32_t ReadDisplayData(const JSON& pJson,DisplayData& rDisplay)
+{
+	uint32_t changed = 0;
+	if( pJson.GetArraySize("weather") > 0 )
+	{
+		const auto& weather = pJson["weather"][0];
+		DisplayData display;
+		display.mID = weather.GetUInt32("id");
+		display.mCondition = ConditionTable::FindCondition(display.mID,weather.GetString("main"),weather.GetString("description"));
+		display.mIcon = ConditionTable::FindIcon(weather.GetString("icon"));
+		if( display != rDisplay )
+		{
+			rDisplay = display;
+			changed = CHANGED_CONDITION;
+		}
+	}
+	return changed;
+}
+
+/**
+ * @brief Moves the entries so the one at pFirst is at the start, ready to be refreshed in place.
+ * When a forecast is fetched an hour later the hours we already have just move down, this keeps them matched up.
+ * Entries are swapped, not copied, so no allocations.
+ * @return size_t How many entries at the start are for the same times as the new data.
+ */
+template<typename ENTRIES> static size_t AlignByTime(ENTRIES& rEntries,std::time_t pFirst)
+{
+	for( size_t n = 0 ; n < rEntries.size() ; n++ )
+	{
+		if( rEntries[n].mTime.mUTC == pFirst )
+		{
+			std::rotate(rEntries.begin(),rEntries.begin() + n,rEntries.end());
+			return rEntries.size() - n;
+		}
+	}
+	return 0;
+}
+
+template<typename JSON> static uint32_t ReadWeatherData(const JSON& pJson,const ChangeThresholds& pThresholds,int32_t pTimezoneOffset,WeatherData& rWeather,WeatherData& rReported)
+{
+	uint32_t changed = 0;
+	changed |= UpdateValue(rWeather.mTime,pJson.GetUInt64("dt"),pTimezoneOffset,CHANGED_TIME);					//!< Current time, Unix, UTC
+	changed |= UpdateValue(rWeather.mSunrise,pJson.GetUInt64("sunrise"),pTimezoneOffset,CHANGED_TIME);			//!< Sunrise time, Unix, UTC
+	changed |= UpdateValue(rWeather.mSunset,pJson.GetUInt64("sunset"),pTimezoneOffset,CHANGED_TIME);				//!< Sunset time, Unix, UTC
+	changed |= UpdateValue(rWeather.mTemperature,rReported.mTemperature,pJson.GetFloat("temp"),pThresholds.mTemperature,CHANGED_TEMPERATURE);			//!< Temperature. Units - default: kelvin, metric: Celsius, imperial: Fahrenheit. How to change units used
+	changed |= UpdateValue(rWeather.mFeelsLike,rReported.mFeelsLike,pJson.GetFloat("feels_like"),pThresholds.mTemperature,CHANGED_TEMPERATURE);		//!< This temperature parameter accounts for the human perception of weather. Units – default: kelvin, metric: Celsius, imperial: Fahrenheit.
+	changed |= UpdateValue(rWeather.mPressure,rReported.mPressure,pJson.GetUInt32("pressure"),pThresholds.mPressure,CHANGED_PRESSURE);			//!< Atmospheric pressure on the sea level, hPa
+	changed |= UpdateValue(rWeather.mHumidity,rReported.mHumidity,pJson.GetUInt32("humidity"),pThresholds.mPercent,CHANGED_HUMIDITY);			//!< Humidity, %
+	changed |= UpdateValue(rWeather.mDewPoint,rReported.mDewPoint,pJson.GetFloat("dew_point"),pThresholds.mTemperature,CHANGED_TEMPERATURE);			//!< Atmospheric temperature (varying according to pressure and humidity) below which water droplets begin to condense and dew can form. Units – default: kelvin, metric: Celsius, imperial: Fahrenheit.
+	changed |= UpdateValue(rWeather.mClouds,rReported.mClouds,pJson.GetUInt32("clouds"),pThresholds.mPercent,CHANGED_CLOUDS);				//!< Cloudiness, %
+	changed |= UpdateValue(rWeather.mUVIndex,rReported.mUVIndex,pJson.GetUInt32("uvi"),pThresholds.mUVIndex,CHANGED_UV_INDEX);				//!< Current UV index
+	changed |= UpdateValue(rWeather.mVisibility,rReported.mVisibility,pJson.GetUInt32("visibility"),pThresholds.mVisibility,CHANGED_VISIBILITY);		//!< Average visibility, metres
+	changed |= UpdateValue(rWeather.mWindSpeed,rReported.mWindSpeed,pJson.GetFloat("wind_speed"),pThresholds.mWindSpeed,CHANGED_WIND);		//!< Wind speed. Wind speed. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
+	changed |= UpdateValue(rWeather.mWindGusts,rReported.mWindGusts,pJson.GetFloat("wind_gust"),pThresholds.mWindSpeed,CHANGED_WIND);			//!< defaults to 0 if not found. (where available) Wind gust. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
+	changed |= UpdateValue(rWeather.mWindDirection,rReported.mWindDirection,pJson.GetUInt32("wind_deg"),pThresholds.mWindDirection,CHANGED_WIND);	//!< Wind direction, degrees (meteorological)
+	changed |= UpdateValue(rWeather.mPrecipitationProbability,rReported.mPrecipitationProbability,pJson.GetFloat("pop"),pThresholds.mProbability,CHANGED_PRECIPITATION);	//!< Probability of precipitation
+	changed |= UpdateValue(rWeather.mRain,rReported.mRain,GetPrecipitation(pJson,"rain"),pThresholds.mPrecipitation,CHANGED_PRECIPITATION);				//!< (where available) Rain volume for the last hour, mm
+	changed |= UpdateValue(rWeather.mSnow,rReported.mSnow,GetPrecipitation(pJson,"snow"),pThresholds.mPrecipitation,CHANGED_PRECIPITATION);				//!< (where available) Snow volume for the last hour, mm
+	changed |= ReadDisplayData(pJson,rWeather.mDisplay);
+	return changed;
+}
+
+template<typename JSON> static uint32_t ReadDailyWeatherData(const JSON& pJson,const ChangeThresholds& pThresholds,int32_t pTimezoneOffset,DailyWeatherData& rDaily,DailyWeatherData& rReported)
+{
+	uint32_t changed = 0;
+	changed |= UpdateValue(rDaily.mTime,pJson.GetUInt64("dt"),pTimezoneOffset,CHANGED_TIME);					//!< Current time, Unix, UTC
+	changed |= UpdateValue(rDaily.mSunrise,pJson.GetUInt64("sunrise"),pTimezoneOffset,CHANGED_TIME);			//!< Sunrise time, Unix, UTC
+	changed |= UpdateValue(rDaily.mSunset,pJson.GetUInt64("sunset"),pTimezoneOffset,CHANGED_TIME);				//!< Sunset time, Unix, UTC
+	changed |= UpdateValue(rDaily.mPressure,rReported.mPressure,pJson.GetUInt32("pressure"),pThresholds.mPressure,CHANGED_PRESSURE);			//!< Atmospheric pressure on the sea level, hPa
+	changed |= UpdateValue(rDaily.mHumidity,rReported.mHumidity,pJson.GetUInt32("humidity"),pThresholds.mPercent,CHANGED_HUMIDITY);			//!< Humidity, %
+	changed |= UpdateValue(rDaily.mDewPoint,rReported.mDewPoint,pJson.GetFloat("dew_point"),pThresholds.mTemperature,CHANGED_TEMPERATURE);			//!< Atmospheric temperature (varying according to pressure and humidity) below which water droplets begin to condense and dew can form. Units – default: kelvin, metric: Celsius, imperial: Fahrenheit.
+	changed |= UpdateValue(rDaily.mClouds,rReported.mClouds,pJson.GetUInt32("clouds"),pThresholds.mPercent,CHANGED_CLOUDS);				//!< Cloudiness, %
+	changed |= UpdateValue(rDaily.mUVIndex,rReported.mUVIndex,pJson.GetUInt32("uvi"),pThresholds.mUVIndex,CHANGED_UV_INDEX);				//!< Current UV index
+
+	changed |= UpdateValue(rDaily.mWindSpeed,rReported.mWindSpeed,pJson.GetFloat("wind_speed"),pThresholds.mWindSpeed,CHANGED_WIND);		//!< Wind speed. Wind speed. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
+	changed |= UpdateValue(rDaily.mWindGusts,rReported.mWindGusts,pJson.GetFloat("wind_gust"),pThresholds.mWindSpeed,CHANGED_WIND);			//!< defaults to 0 if not found. (where available) Wind gust. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
+	changed |= UpdateValue(rDaily.mWindDirection,rReported.mWindDirection,pJson.GetUInt32("wind_deg"),pThresholds.mWindDirection,CHANGED_WIND);	//!< Wind direction, degrees (meteorological)
+
+	changed |= UpdateValue(rDaily.mPrecipitationProbability,rReported.mPrecipitationProbability,pJson.GetFloat("pop"),pThresholds.mProbability,CHANGED_PRECIPITATION);	//!< Probability of precipitation
+	changed |= UpdateValue(rDaily.mRain,rReported.mRain,pJson.GetFloat("rain"),pThresholds.mPrecipitation,CHANGED_PRECIPITATION);						//!< (where available) Precipitation volume, mm
+	changed |= UpdateValue(rDaily.mSnow,rReported.mSnow,pJson.GetFloat("snow"),pThresholds.mPrecipitation,CHANGED_PRECIPITATION);						//!< (where available) Snow volume, mm
+
+	if( pJson.GetType("temp") == tinyjson::JsonValueType::OBJECT  )
+	{
+		const auto& temp = pJson["temp"];
+		changed |= UpdateValue(rDaily.mTemperature.Morning,rReported.mTemperature.Morning,temp.GetFloat("morn"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Day,rReported.mTemperature.Day,temp.GetFloat("day"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Evening,rReported.mTemperature.Evening,temp.GetFloat("eve"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Night,rReported.mTemperature.Night,temp.GetFloat("night"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Min,rReported.mTemperature.Min,temp.GetFloat("min"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Max,rReported.mTemperature.Max,temp.GetFloat("max"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+	}
+	else if( pJson.GetType("temp") == tinyjson::JsonValueType::NUMBER  )
+	{
+		const float k = pJson.GetFloat("temp");
+		changed |= UpdateValue(rDaily.mTemperature.Morning,rReported.mTemperature.Morning,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Day,rReported.mTemperature.Day,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Evening,rReported.mTemperature.Evening,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Night,rReported.mTemperature.Night,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Min,rReported.mTemperature.Min,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mTemperature.Max,rReported.mTemperature.Max,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+	}
+
+	if( pJson.GetType("feels_like") == tinyjson::JsonValueType::OBJECT  )
+	{
+		const auto& feels_like = pJson["feels_like"];
+		changed |= UpdateValue(rDaily.mFeelsLike.Morning,rReported.mFeelsLike.Morning,feels_like.GetFloat("morn"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mFeelsLike.Day,rReported.mFeelsLike.Day,feels_like.GetFloat("day"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mFeelsLike.Evening,rReported.mFeelsLike.Evening,feels_like.GetFloat("eve"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mFeelsLike.Night,rReported.mFeelsLike.Night,feels_like.GetFloat("night"),pThresholds.mTemperature,CHANGED_TEMPERATURE);
+	}
+	else if( pJson.GetType("feels_like") == tinyjson::JsonValueType::NUMBER  )
+	{
+		const float k = pJson.GetFloat("temp");
+		changed |= UpdateValue(rDaily.mFeelsLike.Morning,rReported.mFeelsLike.Morning,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mFeelsLike.Day,rReported.mFeelsLike.Day,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mFeelsLike.Evening,rReported.mFeelsLike.Evening,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+		changed |= UpdateValue(rDaily.mFeelsLike.Night,rReported.mFeelsLike.Night,k,pThresholds.mTemperature,CHANGED_TEMPERATURE);
+	}
+
+	changed |= ReadDisplayData(pJson,rDaily.mDisplay);
+	return changed;
+}
+
+/**
+ * @brief Refreshes the entries in place from the json array, reusing what is there.
+ * In the fixed capacity build entries past the capacity are dropped.
+ */
+template<typename JSON,typename ENTRIES,typename CHANGES,typename READER> static void ReadEntries(const JSON& pArray,const ChangeThresholds& pThresholds,int32_t pTimezoneOffset,READER pReader,ENTRIES& rEntries,ENTRIES& rReported,CHANGES& rChanges)
+{
+	const size_t count = std::min(pArray.GetArraySize(),rEntries.max_size());
+	const std::time_t first = pArray[0].GetUInt64("dt");
+	const size_t kept = std::min(count,AlignByTime(rEntries,first));
+
+	rEntries.resize(count);
+	rChanges.resize(count);
+	if( pThresholds.IsSet() == false )
+	{// Every change is reported, so the entries are what was last reported and the copy is not needed.
+		rReported.clear();
+		for( size_t n = 0 ; n < count ; n++ )
+		{
+			const uint32_t changed = pReader(pArray[n],pThresholds,pTimezoneOffset,rEntries[n],rEntries[n]);
+			rChanges[n] = n < kept ? changed : CHANGED_ALL;
+		}
+		return;
+	}
+
+	// The values last reported, moved along with the entries.
+	const size_t reported = std::min(kept,AlignByTime(rReported,first));
+	rReported.resize(count);
+	for( size_t n = 0 ; n < count ; n++ )
+	{
+		if( n >= reported )
+		{// Thresholds were just set, start from what we have.
+			rReported[n] = rEntries[n];
+		}
+
+		const uint32_t changed = pReader(pArray[n],pThresholds,pTimezoneOffset,rEntries[n],rReported[n]);
+		if( n < kept )
+		{
+			rChanges[n] = changed;
+		}
+		else
+		{// New entry, all of it is reported.
+			rChanges[n] = CHANGED_ALL;
+			rReported[n] = rEntries[n];
+		}
+	}
+}
+
+void HourlyColumns::Build(const HourlyForecasts& pHourly)
+{
+	const size_t count = pHourly.size();
+	mTime.resize(count);
+	mConditionID.resize(count);
+	for( auto& column : mValues )
+	{
+		column.resize(count);
+	}
+
+	for( size_t n = 0 ; n < count ; n++ )
+	{
+		const WeatherData& hour = pHourly[n];
+		mTime[n] = hour.mTime.mUTC;
+		mConditionID[n] = hour.mDisplay.mID;
+		mValues[(size_t)HourlyColumn::TEMPERATURE][n] = hour.mTemperature.k;
+		mValues[(size_t)HourlyColumn::FEELS_LIKE][n] = hour.mFeelsLike.k;
+		mValues[(size_t)HourlyColumn::HUMIDITY][n] = hour.mHumidity;
+		mValues[(size_t)HourlyColumn::PRESSURE][n] = hour.mPressure;
+		mValues[(size_t)HourlyColumn::CLOUDS][n] = hour.mClouds;
+		mValues[(size_t)HourlyColumn::WIND_SPEED][n] = hour.mWindSpeed;
+		mValues[(size_t)HourlyColumn::WIND_GUSTS][n] = hour.mWindGusts;
+		mValues[(size_t)HourlyColumn::PRECIPITATION_PROBABILITY][n] = hour.mPrecipitationProbability;
+		mValues[(size_t)HourlyColumn::RAIN][n] = hour.mRain;
+		mValues[(size_t)HourlyColumn::SNOW][n] = hour.mSnow;
+		mValues[(size_t)HourlyColumn::UV_INDEX][n] = hour.mUVIndex;
+	}
+}
+
+void HourlyColumns::GetWindow(std::time_t pFromUTC,std::time_t pToUTC,size_t& rFirst,size_t& rLast)const
+{
+	rFirst = std::lower_bound(mTime.begin(),mTime.end(),pFromUTC) - mTime.begin();
+	rLast = std::max(rFirst,(size_t)(std::lower_bound(mTime.begin(),mTime.end(),pToUTC) - mTime.begin()));
+}
+
+ColumnSummary HourlyColumns::Summarise(HourlyColumn pColumn,std::time_t pFromUTC,std::time_t pToUTC)const
+{
+	ColumnSummary summary;
+	size_t first,last;
+	GetWindow(pFromUTC,pToUTC,first,last);
+	if( first == last )
+		return summary;
+
+	// Kept as simple loops with no branches so the compiler can vectorise them.
+	const float* values = GetColumn(pColumn).data();
+	float low = values[first];
+	float high = values[first];
+	for( size_t n = first ; n < last ; n++ )
+	{
+		low = values[n] < low ? values[n] : low;
+		high = values[n] > high ? values[n] : high;
+	}
+
+	// Four sums, else the compiler has to add them up in order and can't vectorise.
+	float sums[4] = {0.0f,0.0f,0.0f,0.0f};
+	size_t n = first;
+	for( ; n + 4 <= last ; n += 4 )
+	{
+		sums[0] += values[n+0];
+		sums[1] += values[n+1];
+		sums[2] += values[n+2];
+		sums[3] += values[n+3];
+	}
+	for( ; n < last ; n++ )
+	{
+		sums[0] += values[n];
+	}
+
+	summary.mCount = last - first;
+	summary.mMin = low;
+	summary.mMax = high;
+	summary.mMean = (sums[0] + sums[1] + sums[2] + sums[3]) / summary.mCount;
+	summary.mMinIndex = std::find(values + first,values + last,low) - values;
+	summary.mMaxIndex = std::find(values + first,values + last,high) - values;
+	return summary;
+}
+
+/**
+ * @brief Slope of the curve at a point for monotone cubic interpolation.
+ * Uses the harmonic mean of the slopes either side, zero at a peak or a dip, this keeps the curve from overshooting the points.
+ */
+static float GetMonotoneTangent(const float* pValues,const std::time_t* pTimes,size_t pIndex,size_t pCount)
+{
+	const float before = pIndex > 0 ? (pValues[pIndex] - pValues[pIndex-1]) / (float)(pTimes[pIndex] - pTimes[pIndex-1]) : 0.0f;
+	const float after = pIndex + 1 < pCount ? (pValues[pIndex+1] - pValues[pIndex]) / (float)(pTimes[pIndex+1] - pTimes[pIndex]) : 0.0f;
+	if( pIndex == 0 )
+		return after;
+	if( pIndex + 1 == pCount )
+		return before;
+	if( before * after <= 0.0f )
+		return 0.0f;
+	return 2.0f / (1.0f / before + 1.0f / after);
+}
+
+size_t HourlyColumns::Interpolate(HourlyColumn pColumn,const std::time_t* pTimesUTC,size_t pCount,float* rValues,Interpolation pInterpolation,OutOfRange pOutOfRange)const
+{
+	assert( pTimesUTC != nullptr && rValues != nullptr );
+	const size_t count = GetCount();
+	const float* values = GetColumn(pColumn).data();
+	const std::time_t* times = mTime.data();
+
+	if( count == 0 )
+	{
+		std::fill(rValues,rValues + pCount,NAN);
+		return 0;
+	}
+
+	// Done in batches, first find the hour each time is in, then work out all the values in a loop that the compiler can vectorise.
+	const size_t BATCH_SIZE = 64;
+	uint32_t hour[BATCH_SIZE];
+	float fraction[BATCH_SIZE];
+	size_t inRange = 0;
+	size_t cursor = 0;
+	for( size_t start = 0 ; start < pCount ; start += BATCH_SIZE )
+	{
+		const size_t batch = std::min(BATCH_SIZE,pCount - start);
+		for( size_t n = 0 ; n < batch ; n++ )
+		{
+			const std::time_t time = pTimesUTC[start + n];
+			if( time < times[0] || time > times[count-1] )
+			{// Out of range, clamped here and put right below if they want NAN.
+				hour[n] = time < times[0] ? 0 : (uint32_t)(count - 1);
+				fraction[n] = 0.0f;
+				continue;
+			}
+
+			inRange++;
+			if( time < times[cursor] )
+			{// Went backwards, not in order so search for it.
+				cursor = std::upper_bound(times,times + count,time) - times - 1;
+			}
+			while( cursor + 1 < count && times[cursor+1] <= time )
+			{
+				cursor++;
+			}
+
+			hour[n] = (uint32_t)cursor;
+			fraction[n] = cursor + 1 < count ? (float)(time - times[cursor]) / (float)(times[cursor+1] - times[cursor]) : 0.0f;
+		}
+
+		float* out = rValues + start;
+		if( pInterpolation == Interpolation::LINEAR )
+		{
+			for( size_t n = 0 ; n < batch ; n++ )
+			{
+				const uint32_t next = std::min(hour[n] + 1,(uint32_t)(count - 1));
+				out[n] = values[hour[n]] + (values[next] - values[hour[n]]) * fraction[n];
+			}
+		}
+		else
+		{// Cubic hermite with monotone tangents.
+			for( size_t n = 0 ; n < batch ; n++ )
+			{
+				const uint32_t next = std::min(hour[n] + 1,(uint32_t)(count - 1));
+				const float step = (float)(times[next] - times[hour[n]]);
+				const float t = fraction[n];
+				const float t2 = t * t;
+				const float t3 = t2 * t;
+				const float m0 = GetMonotoneTangent(values,times,hour[n],count) * step;
+				const float m1 = GetMonotoneTangent(values,times,next,count) * step;
+				out[n] = (2.0f*t3 - 3.0f*t2 + 1.0f) * values[hour[n]] +
+						(t3 - 2.0f*t2 + t) * m0 +
+						(-2.0f*t3 + 3.0f*t2) * values[next] +
+						(t3 - t2) * m1;
+			}
+		}
+
+		if( pOutOfRange == OutOfRange::NOT_A_NUMBER )
+		{
+			for( size_t n = 0 ; n < batch ; n++ )
+			{
+				const std::time_t time = pTimesUTC[start + n];
+				if( time < times[0] || time > times[count-1] )
+				{
+					out[n] = NAN;
+				}
+			}
+		}
+	}
+
+	return inRange;
+}
+
+/**
+ * @brief The conditions and icons from https://openweathermap.org/weather-conditions, the table starts with these.
+ */
+static const struct{uint32_t mID;const char* mTitle;const char* mDescription;}KNOWN_CONDITIONS[] =
+{
+	{200,"Thunderstorm","thunderstorm with light rain"},
+	{201,"Thunderstorm","thunderstorm with rain"},
+	{202,"Thunderstorm","thunderstorm with heavy rain"},
+	{210,"Thunderstorm","light thunderstorm"},
+	{211,"Thunderstorm","thunderstorm"},
+	{212,"Thunderstorm","heavy thunderstorm"},
+	{221,"Thunderstorm","ragged thunderstorm"},
+	{230,"Thunderstorm","thunderstorm with light drizzle"},
+	{231,"Thunderstorm","thunderstorm with drizzle"},
+	{232,"Thunderstorm","thunderstorm with heavy drizzle"},
+	{300,"Drizzle","light intensity drizzle"},
+	{301,"Drizzle","drizzle"},
+	{302,"Drizzle","heavy intensity drizzle"},
+	{310,"Drizzle","light intensity drizzle rain"},
+	{311,"Drizzle","drizzle rain"},
+	{312,"Drizzle","heavy intensity drizzle rain"},
+	{313,"Drizzle","shower rain and drizzle"},
+	{314,"Drizzle","heavy shower rain and drizzle"},
+	{321,"Drizzle","shower drizzle"},
+	{500,"Rain","light rain"},
+	{501,"Rain","moderate rain"},
+	{502,"Rain","heavy intensity rain"},
+	{503,"Rain","very heavy rain"},
+	{504,"Rain","extreme rain"},
+	{511,"Rain","freezing rain"},
+	{520,"Rain","light intensity shower rain"},
+	{521,"Rain","shower rain"},
+	{522,"Rain","heavy intensity shower rain"},
+	{531,"Rain","ragged shower rain"},
+	{600,"Snow","light snow"},
+	{601,"Snow","snow"},
+	{602,"Snow","heavy snow"},
+	{611,"Snow","sleet"},
+	{612,"Snow","light shower sleet"},
+	{613,"Snow","shower sleet"},
+	{615,"Snow","light rain and snow"},
+	{616,"Snow","rain and snow"},
+	{620,"Snow","light shower snow"},
+	{621,"Snow","shower snow"},
+	{622,"Snow","heavy shower snow"},
+	{701,"Mist","mist"},
+	{711,"Smoke","smoke"},
+	{721,"Haze","haze"},
+	{731,"Dust","sand/ dust whirls"},
+	{741,"Fog","fog"},
+	{751,"Sand","sand"},
+	{761,"Dust","dust"},
+	{762,"Ash","volcanic ash"},
+	{771,"Squall","squalls"},
+	{781,"Tornado","tornado"},
+	{800,"Clear","clear sky"},
+	{801,"Clouds","few clouds"},
+	{802,"Clouds","scattered clouds"},
+	{803,"Clouds","broken clouds"},
+	{804,"Clouds","overcast clouds"}
+};
+
+static const char* KNOWN_ICONS[] =
+{
+	"01d","02d","03d","04d","09d","10d","11d","13d","50d",
+	"01n","02n","03n","04n","09n","10n","11n","13n","50n"
+};
+
+/**
+ * @brief Entries are only ever added, and the count is only moved on once the entry is written, so readers up to the count need no lock.
+ */
+struct ConditionTableData
+{
+	struct Condition
+	{
+		uint32_t mID;
+		std::string mTitle;
+		std::string mDescription;
+	};
+
+	Condition mConditions[ConditionTable::MAX_CONDITIONS];
+	std::string mIcons[ConditionTable::MAX_ICONS];
+	std::atomic<size_t> mConditionCount;
+	std::atomic<size_t> mIconCount;
+	std::mutex mLock;
+
+	ConditionTableData()
+	{
+		// Handle zero is the empty one.
+		mConditions[0].mID = 0;
+		size_t count = 1;
+		for( const auto& known : KNOWN_CONDITIONS )
+		{
+			mConditions[count].mID = known.mID;
+			mConditions[count].mTitle = known.mTitle;
+			mConditions[count].mDescription = known.mDescription;
+			count++;
+		}
+		mConditionCount = count;
+
+		count = 1;
+		for( const char* known : KNOWN_ICONS )
+		{
+			mIcons[count++] = known;
+		}
+		mIconCount = count;
+	}
+
+	static ConditionTableData& Get()
+	{
+		static ConditionTableData table;
+		return table;
+	}
+};
+
+uint16_t ConditionTable::FindCondition(uint32_t pID,std::string_view pTitle,std::string_view pDescription)
+{
+	ConditionTableData& table = ConditionTableData::Get();
+	auto find = [&](size_t pFrom,size_t pTo)
+	{
+		for( size_t n = pFrom ; n < pTo ; n++ )
+		{
+			const ConditionTableData::Condition& condition = table.mConditions[n];
+			if( condition.mID == pID && condition.mDescription == pDescription && condition.mTitle == pTitle )
+				return n;
+		}
+		return (size_t)0;
+	};
+
+	const size_t count = table.mConditionCount.load(std::memory_order_acquire);
+	size_t found = find(1,count);
+	if( found != 0 )
+		return (uint16_t)found;
+
+	// New one, check again with the lock held as it could have been added since.
+	std::unique_lock<std::mutex> lock(table.mLock);
+	const size_t lockedCount = table.mConditionCount.load(std::memory_order_relaxed);
+	found = find(count,lockedCount);
+	if( found != 0 )
+		return (uint16_t)found;
+
+	if( lockedCount == MAX_CONDITIONS )
+	{
+		std::cerr << "Weather condition table is full, " << pID << " " << pDescription << " not added\n";
+		return 0;
+	}
+
+	ConditionTableData::Condition& condition = table.mConditions[lockedCount];
+	condition.mID = pID;
+	condition.mTitle = pTitle;
+	condition.mDescription = pDescription;
+	table.mConditionCount.store(lockedCount + 1,std::memory_order_release);
+	return (uint16_t)lockedCount;
+}
+
+uint16_t ConditionTable::FindIcon(std::string_view pIcon)
+{
+	ConditionTableData& table = ConditionTableData::Get();
+	auto find = [&](size_t pFrom,size_t pTo)
+	{
+		for( size_t n = pFrom ; n < pTo ; n++ )
+		{
+			if( table.mIcons[n] == pIcon )
+				return n;
+		}
+		return (size_t)0;
+	};
+
+	if( pIcon.size() == 0 )
+		return 0;
+
+	const size_t count = table.mIconCount.load(std::memory_order_acquire);
+	size_t found = find(1,count);
+	if( found != 0 )
+		return (uint16_t)found;
+
+	std::unique_lock<std::mutex> lock(table.mLock);
+	const size_t lockedCount = table.mIconCount.load(std::memory_order_relaxed);
+	found = find(count,lockedCount);
+	if( found != 0 )
+		return (uint16_t)found;
+
+	if( lockedCount == MAX_ICONS )
+	{
+		std::cerr << "Weather icon table is full, " << pIcon << " not added\n";
+		return 0;
+	}
+
+	table.mIcons[lockedCount] = pIcon;
+	table.mIconCount.store(lockedCount + 1,std::memory_order_release);
+	return (uint16_t)lockedCount;
+}
+
+uint32_t ConditionTable::GetID(uint16_t pCondition)
+{
+	assert( pCondition < GetConditionCount() );
+	return ConditionTableData::Get().mConditions[pCondition].mID;
 }
 
-static int CURLWriter(char *data, size_t size, size_t nmemb,std::string *writerData)
+const std::string& ConditionTable::GetTitle(uint16_t pCondition)
 {
-	if(writerData == NULL)
-		return 0;
+	assert( pCondition < GetConditionCount() );
+	return ConditionTableData::Get().mConditions[pCondition].mTitle;
+}
 
-	writerData->append(data, size*nmemb);
+const std::string& ConditionTable::GetDescription(uint16_t pCondition)
+{
+	assert( pCondition < GetConditionCount() );
+	return ConditionTableData::Get().mConditions[pCondition].mDescription;
+}
 
-	return size * nmemb;
+const std::string& ConditionTable::GetIcon(uint16_t pIcon)
+{
+	assert( pIcon < GetIconCount() );
+	return ConditionTableData::Get().mIcons[pIcon];
 }
 
-static void ReadWeatherData(const tinyjson::JsonValue pJson,WeatherData& rWeather)
+size_t ConditionTable::GetConditionCount()
 {
+	return ConditionTableData::Get().mConditionCount.load(std::memory_order_acquire);
+}
 
-	rWeather.mTime.Set(pJson.GetUInt64("dt"));					//!< Current time, Unix, UTC
-	rWeather.mSunrise.Set(pJson.GetUInt64("sunrise"));			//!< Sunrise time, Unix, UTC
-	rWeather.mSunset.Set(pJson.GetUInt64("sunset"));				//!< Sunset time, Unix, UTC
-	rWeather.mTemperature.Set(pJson.GetFloat("temp"));			//!< Temperature. Units - default: kelvin, metric: Celsius, imperial: Fahrenheit. How to change units used
-	rWeather.mFeelsLike.Set(pJson.GetFloat("feels_like"));		//!< This temperature parameter accounts for the human perception of weather. Units – default: kelvin, metric: Celsius, imperial: Fahrenheit.
-	rWeather.mPressure = pJson.GetUInt64("pressure");			//!< Atmospheric pressure on the sea level, hPa
-	rWeather.mHumidity = pJson.GetUInt64("humidity");			//!< Humidity, %
-	rWeather.mDewPoint = pJson.GetFloat("dew_point");			//!< Atmospheric temperature (varying according to pressure and humidity) below which water droplets begin to condense and dew can form. Units – default: kelvin, metric: Celsius, imperial: Fahrenheit.
-	rWeather.mClouds = pJson.GetUInt32("clouds");				//!< Cloudiness, %
-	rWeather.mUVIndex = pJson.GetUInt32("uvi");				//!< Current UV index
-	rWeather.mVisibility = pJson.GetUInt32("visibility");		//!< Average visibility, metres
-	rWeather.mWindSpeed = pJson.GetFloat("wind_speed");		//!< Wind speed. Wind speed. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
-	rWeather.mWindGusts = pJson.GetFloat("wind_deg");			//!< defaults to 0 if not found. (where available) Wind gust. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
-	rWeather.mWindDirection = pJson.GetUInt32("wind_deg");	//!< Wind direction, degrees (meteorological)
+size_t ConditionTable::GetIconCount()
+{
+	return ConditionTableData::Get().mIconCount.load(std::memory_order_acquire);
+}
 
-	if( pJson.GetArraySize("weather") > 0 )
+size_t ConditionTable::GetMemoryUsage()
+{
+	// Entries below the counts are never changed once added, so can be read without the lock.
+	const ConditionTableData& table = ConditionTableData::Get();
+	size_t bytes = sizeof(ConditionTableData);
+	const size_t conditions = GetConditionCount();
+	for( size_t n = 0 ; n < conditions ; n++ )
+	{
+		bytes += GetStringHeap(table.mConditions[n].mTitle) + GetStringHeap(table.mConditions[n].mDescription);
+	}
+	const size_t icons = GetIconCount();
+	for( size_t n = 0 ; n < icons ; n++ )
+	{
+		bytes += GetStringHeap(table.mIcons[n]);
+	}
+	return bytes;
+}
+
+void MinutelyNowcast::Build(const MinutelyForecasts& pMinutely)
+{
+	mStart = pMinutely.size() > 0 ? pMinutely[0].mTime.mUTC : 0;
+	mCount = 0;
+	mTotal[0] = 0.0f;
+	for( const auto& minute : pMinutely )
+	{
+		if( mCount == CAPACITY || minute.mTime.mUTC != mStart + (std::time_t)mCount * ONE_MINUTE )
+			break;
+
+		mPrecipitation[mCount] = minute.mPrecipitation;
+		mTotal[mCount+1] = mTotal[mCount] + minute.mPrecipitation / 60.0f; // mm/h for a minute.
+		mCount++;
+	}
+
+	for( size_t n = 0 ; n < mCount ; n++ )
+	{
+		mMax[0][n] = mMin[0][n] = mPrecipitation[n];
+	}
+	for( size_t level = 1 ; level < LEVELS ; level++ )
 	{
-		const tinyjson::JsonValue& weather = pJson["weather"][0];
-		rWeather.mDisplay.mID = weather.GetUInt32("id");
-		rWeather.mDisplay.mTitle = weather.GetString("main");
-		rWeather.mDisplay.mDescription = weather.GetString("description");
-		rWeather.mDisplay.mIcon = weather.GetString("icon");
+		const size_t half = (size_t)1 << (level - 1);
+		for( size_t n = 0 ; n + (half * 2) <= mCount ; n++ )
+		{
+			mMax[level][n] = std::max(mMax[level-1][n],mMax[level-1][n + half]);
+			mMin[level][n] = std::min(mMin[level-1][n],mMin[level-1][n + half]);
+		}
 	}
 }
 
-static void ReadDailyWeatherData(const tinyjson::JsonValue pJson,DailyWeatherData& rDaily)
+int MinutelyNowcast::GetMinutesLeft(std::time_t pNowUTC)const
+{
+	const int index = GetIndex(pNowUTC);
+	return index < 0 ? 0 : (int)mCount - index;
+}
+
+float MinutelyNowcast::GetTotal(std::time_t pNowUTC,int pMinutes)const
 {
+	const int index = GetIndex(pNowUTC);
+	if( index < 0 || pMinutes <= 0 )
+		return 0.0f;
 
-	rDaily.mTime.Set(pJson.GetUInt64("dt"));					//!< Current time, Unix, UTC
-	rDaily.mSunrise.Set(pJson.GetUInt64("sunrise"));			//!< Sunrise time, Unix, UTC
-	rDaily.mSunset.Set(pJson.GetUInt64("sunset"));				//!< Sunset time, Unix, UTC
-	rDaily.mPressure = pJson.GetUInt64("pressure");			//!< Atmospheric pressure on the sea level, hPa
-	rDaily.mHumidity = pJson.GetUInt64("humidity");			//!< Humidity, %
-	rDaily.mDewPoint = pJson.GetFloat("dew_point");			//!< Atmospheric temperature (varying according to pressure and humidity) below which water droplets begin to condense and dew can form. Units – default: kelvin, metric: Celsius, imperial: Fahrenheit.
-	rDaily.mClouds = pJson.GetUInt32("clouds");				//!< Cloudiness, %
-	rDaily.mUVIndex = pJson.GetUInt32("uvi");				//!< Current UV index
+	const size_t last = std::min(mCount,(size_t)index + pMinutes);
+	return mTotal[last] - mTotal[index];
+}
 
-	rDaily.mWindSpeed = pJson.GetFloat("wind_speed");		//!< Wind speed. Wind speed. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
-	rDaily.mWindGusts = pJson.GetFloat("wind_deg");			//!< defaults to 0 if not found. (where available) Wind gust. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
-	rDaily.mWindDirection = pJson.GetUInt32("wind_deg");	//!< Wind direction, degrees (meteorological)
+float MinutelyNowcast::GetMax(std::time_t pNowUTC,int pMinutes)const
+{
+	const int index = GetIndex(pNowUTC);
+	if( index < 0 || pMinutes <= 0 )
+		return 0.0f;
 
-	rDaily.mPrecipitationProbability = pJson.GetFloat("prop");	//!< Probability of precipitation
-	rDaily.mRain = pJson.GetFloat("rain");						//!< (where available) Precipitation volume, mm
-	rDaily.mSnow = pJson.GetFloat("snow");						//!< (where available) Snow volume, mm
+	return GetRangeMax(index,std::min(mCount,(size_t)index + pMinutes) - 1);
+}
 
-	if( pJson.GetType("temp") == tinyjson::JsonValueType::OBJECT  )
+int MinutelyNowcast::GetMinutesUntilAbove(std::time_t pNowUTC,float pThreshold)const
+{
+	const int index = GetIndex(pNowUTC);
+	if( index < 0 || GetRangeMax(index,mCount - 1) <= pThreshold )
+		return -1;
+
+	// Find the first minute where the max from now goes over.
+	size_t low = index;
+	size_t high = mCount - 1;
+	while( low < high )
 	{
-		const tinyjson::JsonValue& temp = pJson["temp"];
-		rDaily.mTemperature.Set
-		(
-			temp.GetFloat("morn"),
-			temp.GetFloat("day"),
-			temp.GetFloat("eve"),
-			temp.GetFloat("night"),
-			temp.GetFloat("min"),
-			temp.GetFloat("max")
-		);
+		const size_t mid = (low + high) / 2;
+		if( GetRangeMax(index,mid) > pThreshold )
+			high = mid;
+		else
+			low = mid + 1;
 	}
-	else if( pJson.GetType("temp") == tinyjson::JsonValueType::NUMBER  )
+	return (int)low - index;
+}
+
+int MinutelyNowcast::GetMinutesUntilBelow(std::time_t pNowUTC,float pThreshold)const
+{
+	const int index = GetIndex(pNowUTC);
+	if( index < 0 || GetRangeMin(index,mCount - 1) > pThreshold )
+		return -1;
+
+	size_t low = index;
+	size_t high = mCount - 1;
+	while( low < high )
 	{
-		const float k = pJson.GetFloat("temp");
-		rDaily.mTemperature.Set
-		(
-			k,
-			k,
-			k,
-			k,
-			k,
-			k
-		);
+		const size_t mid = (low + high) / 2;
+		if( GetRangeMin(index,mid) <= pThreshold )
+			high = mid;
+		else
+			low = mid + 1;
 	}
+	return (int)low - index;
+}
 
-	if( pJson.GetType("feels_like") == tinyjson::JsonValueType::OBJECT  )
+int MinutelyNowcast::GetIndex(std::time_t pNowUTC)const
+{
+	if( mCount == 0 )
+		return -1;
+
+	// Before the first one counts as the first one.
+	const std::time_t minute = std::max((std::time_t)0,pNowUTC - mStart) / ONE_MINUTE;
+	return minute < (std::time_t)mCount ? (int)minute : -1;
+}
+
+float MinutelyNowcast::GetRangeMax(size_t pFirst,size_t pLast)const
+{
+	assert( pFirst <= pLast && pLast < mCount );
+	// Two spans that cover the range, they overlap but that does not matter for max.
+	const size_t level = 31 - __builtin_clz((uint32_t)(pLast - pFirst + 1));
+	return std::max(mMax[level][pFirst],mMax[level][pLast + 1 - ((size_t)1 << level)]);
+}
+
+float MinutelyNowcast::GetRangeMin(size_t pFirst,size_t pLast)const
+{
+	assert( pFirst <= pLast && pLast < mCount );
+	const size_t level = 31 - __builtin_clz((uint32_t)(pLast - pFirst + 1));
+	return std::min(mMin[level][pFirst],mMin[level][pLast + 1 - ((size_t)1 << level)]);
+}
+
+const double LatencyHistogram::BOUNDS[LatencyHistogram::BUCKETS] =
+{
+	0.0001,0.00025,0.0005,
+	0.001,0.0025,0.005,
+	0.01,0.025,0.05,
+	0.1,0.25,0.5,
+	1.0,2.5,5.0,
+	10.0
+};
+
+void LatencyHistogram::Add(double pSeconds)
+{
+	size_t bucket = 0;
+	while( bucket < BUCKETS && pSeconds > BOUNDS[bucket] )
 	{
-		const tinyjson::JsonValue& feels_like = pJson["feels_like"];
-		rDaily.mFeelsLike.Set
-		(
-			feels_like.GetFloat("morn"),
-			feels_like.GetFloat("day"),
-			feels_like.GetFloat("eve"),
-			feels_like.GetFloat("night")
-		);
+		bucket++;
 	}
-	else if( pJson.GetType("feels_like") == tinyjson::JsonValueType::NUMBER  )
+	mBuckets[bucket]++;
+	mCount++;
+	mSum += pSeconds;
+}
+
+const char* FetchMetrics::GetStageName(FetchStage pStage)
+{
+	switch( pStage )
 	{
-		const float k = pJson.GetFloat("temp");
-		rDaily.mFeelsLike.Set
-		(
-			k,
-			k,
-			k,
-			k
-		);
+	case FetchStage::NAME_LOOKUP:	return "name_lookup";
+	case FetchStage::CONNECT:		return "connect";
+	case FetchStage::FIRST_BYTE:	return "first_byte";
+	case FetchStage::TRANSFER:		return "transfer";
+	case FetchStage::TOTAL:			return "total";
+	case FetchStage::PARSE:			return "parse";
+	case FetchStage::POPULATE:		return "populate";
+	case FetchStage::COUNT:			break;
 	}
+	return "unknown";
+}
 
-	if( pJson.GetArraySize("weather") > 0 )
+const char* MemoryUsage::GetCategoryName(MemoryCategory pCategory)
+{
+	switch( pCategory )
+	{
+	case MemoryCategory::OBJECT:			return "object";
+	case MemoryCategory::STRINGS:			return "strings";
+	case MemoryCategory::MINUTELY:			return "minutely";
+	case MemoryCategory::HOURLY:			return "hourly";
+	case MemoryCategory::DAILY:				return "daily";
+	case MemoryCategory::HOURLY_COLUMNS:	return "hourly_columns";
+	case MemoryCategory::INDEXES:			return "indexes";
+	case MemoryCategory::CHANGES:			return "changes";
+	case MemoryCategory::RESPONSE:			return "response";
+	case MemoryCategory::JSON_NODES:		return "json_nodes";
+	case MemoryCategory::JSON_KEYS:			return "json_keys";
+	case MemoryCategory::JSON_STRINGS:		return "json_strings";
+	case MemoryCategory::COUNT:				break;
+	}
+	return "unknown";
+}
+
+/**
+ * @brief snprintf onto the end of the buffer, once it is full the rest is dropped.
+ */
+static void Append(char* rBuffer,size_t pSize,size_t& rUsed,const char* pFormat,...)
+{
+	if( rUsed + 1 >= pSize )
+		return;
+
+	va_list args;
+	va_start(args,pFormat);
+	const int written = vsnprintf(rBuffer + rUsed,pSize - rUsed,pFormat,args);
+	va_end(args);
+
+	if( written > 0 )
+	{
+		rUsed = std::min(pSize - 1,rUsed + (size_t)written);
+	}
+}
+
+size_t FetchMetrics::WritePrometheus(char* rBuffer,size_t pSize,const char* pLabels)const
+{
+	if( rBuffer == nullptr || pSize == 0 )
+		return 0;
+
+	rBuffer[0] = 0;
+	size_t used = 0;
+	const char* comma = pLabels[0] ? "," : "";
+
+	Append(rBuffer,pSize,used,"# HELP tinyweather_stage_seconds Time taken by each stage of refreshing the weather.\n");
+	Append(rBuffer,pSize,used,"# TYPE tinyweather_stage_seconds histogram\n");
+	for( size_t stage = 0 ; stage < STAGES ; stage++ )
+	{
+		const LatencyHistogram& histogram = mStages[stage];
+		const char* name = GetStageName((FetchStage)stage);
+		uint64_t count = 0;
+		for( size_t n = 0 ; n < LatencyHistogram::BUCKETS ; n++ )
+		{
+			count += histogram.mBuckets[n];
+			Append(rBuffer,pSize,used,"tinyweather_stage_seconds_bucket{%s%sstage=\"%s\",le=\"%g\"} %llu\n",pLabels,comma,name,LatencyHistogram::BOUNDS[n],(unsigned long long)count);
+		}
+		Append(rBuffer,pSize,used,"tinyweather_stage_seconds_bucket{%s%sstage=\"%s\",le=\"+Inf\"} %llu\n",pLabels,comma,name,(unsigned long long)histogram.mCount);
+		Append(rBuffer,pSize,used,"tinyweather_stage_seconds_sum{%s%sstage=\"%s\"} %.9g\n",pLabels,comma,name,histogram.mSum);
+		Append(rBuffer,pSize,used,"tinyweather_stage_seconds_count{%s%sstage=\"%s\"} %llu\n",pLabels,comma,name,(unsigned long long)histogram.mCount);
+	}
+
+	const struct{const char* mName;const char* mHelp;uint64_t mValue;}counters[] =
+	{
+		{"tinyweather_downloads_total","Requests made to the weather api.",mDownloads},
+		{"tinyweather_download_failures_total","Requests that failed.",mDownloadFailures},
+		{"tinyweather_reports_total","Responses processed.",mReports},
+		{"tinyweather_report_failures_total","Responses that were not a weather report.",mReportFailures},
+		{"tinyweather_received_bytes_total","Body bytes downloaded.",mBytesReceived},
+		{"tinyweather_entries_parsed_total","Forecast entries read from the responses.",mEntriesParsed}
+	};
+	for( const auto& counter : counters )
 	{
-		const tinyjson::JsonValue& weather = pJson["weather"][0];
-		rDaily.mDisplay.mID = weather.GetUInt32("id");
-		rDaily.mDisplay.mTitle = weather.GetString("main");
-		rDaily.mDisplay.mDescription = weather.GetString("description");
-		rDaily.mDisplay.mIcon = weather.GetString("icon");
+		Append(rBuffer,pSize,used,"# HELP %s %s\n# TYPE %s counter\n",counter.mName,counter.mHelp,counter.mName);
+		if( pLabels[0] )
+			Append(rBuffer,pSize,used,"%s{%s} %llu\n",counter.mName,pLabels,(unsigned long long)counter.mValue);
+		else
+			Append(rBuffer,pSize,used,"%s %llu\n",counter.mName,(unsigned long long)counter.mValue);
 	}
+
+	Append(rBuffer,pSize,used,"# HELP tinyweather_memory_peak_bytes Most memory used for each part of the forecast.\n");
+	Append(rBuffer,pSize,used,"# TYPE tinyweather_memory_peak_bytes gauge\n");
+	for( size_t category = 0 ; category < MemoryUsage::CATEGORIES ; category++ )
+	{
+		Append(rBuffer,pSize,used,"tinyweather_memory_peak_bytes{%s%scategory=\"%s\"} %llu\n",pLabels,comma,MemoryUsage::GetCategoryName((MemoryCategory)category),(unsigned long long)mPeakMemory.mBytes[category]);
+	}
+
+	return used;
+}
+
+/**
+ * @brief Times the stages of a refresh, when metrics are off it never reads the clock.
+ */
+class StageTimer
+{
+public:
+	StageTimer(bool pEnabled):mEnabled(pEnabled)
+	{
+		if( mEnabled )
+			mLast = std::chrono::steady_clock::now();
+	}
+
+	/**
+	 * @brief Seconds since the last call, or since it was made.
+	 */
+	double Lap()
+	{
+		if( mEnabled == false )
+			return 0.0;
+
+		const auto now = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(now - mLast).count();
+		mLast = now;
+		return seconds;
+	}
+
+private:
+	const bool mEnabled;
+	std::chrono::steady_clock::time_point mLast;
+};
+
+/**
+ * @brief Asks curl where the time went in the download it just did.
+ * Its times are each from the start of the request, so they are turned into how long each stage took.
+ */
+static void AddDownloadMetrics(CURL* pCurl,bool pDownloadedOk,FetchMetrics& rMetrics)
+{
+	rMetrics.mDownloads++;
+	if( pDownloadedOk == false )
+	{
+		rMetrics.mDownloadFailures++;
+		return;
+	}
+
+	curl_off_t lookup = 0,connect = 0,appConnect = 0,startTransfer = 0,total = 0,bytes = 0;
+	curl_easy_getinfo(pCurl,CURLINFO_NAMELOOKUP_TIME_T,&lookup);
+	curl_easy_getinfo(pCurl,CURLINFO_CONNECT_TIME_T,&connect);
+	curl_easy_getinfo(pCurl,CURLINFO_APPCONNECT_TIME_T,&appConnect);	// Zero when not https.
+	curl_easy_getinfo(pCurl,CURLINFO_STARTTRANSFER_TIME_T,&startTransfer);
+	curl_easy_getinfo(pCurl,CURLINFO_TOTAL_TIME_T,&total);
+	curl_easy_getinfo(pCurl,CURLINFO_SIZE_DOWNLOAD_T,&bytes);
+
+	const curl_off_t connected = std::max(connect,appConnect);
+	const double US = 1.0e-6;
+	rMetrics.Add(FetchStage::NAME_LOOKUP,lookup * US);
+	rMetrics.Add(FetchStage::CONNECT,std::max((curl_off_t)0,connected - lookup) * US);
+	rMetrics.Add(FetchStage::FIRST_BYTE,std::max((curl_off_t)0,startTransfer - connected) * US);
+	rMetrics.Add(FetchStage::TRANSFER,std::max((curl_off_t)0,total - startTransfer) * US);
+	rMetrics.Add(FetchStage::TOTAL,total * US);
+
+	rMetrics.mLastBytesReceived = (size_t)bytes;
+	rMetrics.mBytesReceived += (uint64_t)bytes;
+}
+
+static void AddReportMetrics(bool pProcessedOk,double pParse,double pPopulate,FetchMetrics& rMetrics)
+{
+	rMetrics.mReports++;
+	if( pProcessedOk == false )
+	{
+		rMetrics.mReportFailures++;
+		return;
+	}
+	rMetrics.Add(FetchStage::PARSE,pParse);
+	rMetrics.Add(FetchStage::POPULATE,pPopulate);
 }
 
 OpenWeatherMap::OpenWeatherMap(const std::string& pAPIKey):
 	mLatitude(0),
 	mLongitude(0),
 	mTimezoneOffset(0),
-	mAPIKey(pAPIKey)
+	mAPIKey(pAPIKey),
+	mServerURL(ONE_CALL_URL),
+	mCache(nullptr),
+	mReportedCurrent()
 {
 	std::clog << "sizeof time_t = " << sizeof(time_t) << " sizeof uint64_t = " << sizeof(uint64_t) << '\n';
 	curl_global_init(CURL_GLOBAL_DEFAULT);
+#ifdef TINYWEATHER_FIXED_CAPACITY
+	// Room for any time zone name, so setting it never allocates.
+	mTimeZone.reserve(64);
+#endif
 }
 
 OpenWeatherMap::~OpenWeatherMap()
@@ -171,7 +1379,111 @@ OpenWeatherMap::~OpenWeatherMap()
 	curl_global_cleanup();
 }
 
+#ifdef TINYWEATHER_FIXED_CAPACITY
+OpenWeatherMap::CurlHandle::~CurlHandle()
+{
+	if( mHandle )
+	{
+		curl_easy_cleanup(mHandle);
+	}
+}
+#endif
+
 void OpenWeatherMap::Get(double pLatitude,double pLongitude,std::function<void(bool pDownloadedOk,const OpenWeatherMap& pWeather)> pReturnFunction)
+{
+	assert( pReturnFunction != nullptr );
+	Get(pLatitude,pLongitude,[&pReturnFunction](bool pDownloadedOk,const OpenWeatherMap& pWeather,const ForecastChanges&)
+	{
+		pReturnFunction(pDownloadedOk,pWeather);
+	});
+}
+
+#ifdef TINYWEATHER_FIXED_CAPACITY
+void OpenWeatherMap::Get(double pLatitude,double pLongitude,std::function<void(bool pDownloadedOk,const OpenWeatherMap& pWeather,const ForecastChanges& pChanges)> pReturnFunction)
+{
+	assert( pReturnFunction != nullptr );
+	assert( mResponse != nullptr );// Call SetResponseBuffer first.
+
+	bool downloadedOk = false;
+
+	char url[512];
+	snprintf(url,sizeof(url),"%s?lat=%g&lon=%g&appid=%s",mServerURL.c_str(),pLatitude,pLongitude,mAPIKey.c_str());
+
+	if( mCurl.mHandle == nullptr )
+	{
+		mCurl.mHandle = curl_easy_init();
+	}
+
+	ResponseBuffer response = {mResponse,mResponseSize,0};
+	if( mCurl.mHandle && mResponse )
+	{
+		char errorBuffer[CURL_ERROR_SIZE];
+		errorBuffer[0] = 0;
+		curl_easy_setopt(mCurl.mHandle, CURLOPT_ERRORBUFFER, errorBuffer);
+		curl_easy_setopt(mCurl.mHandle, CURLOPT_URL, url);
+		curl_easy_setopt(mCurl.mHandle, CURLOPT_WRITEFUNCTION, CURLBufferWriter);
+		curl_easy_setopt(mCurl.mHandle, CURLOPT_WRITEDATA, &response);
+		const bool performedOk = curl_easy_perform(mCurl.mHandle) == CURLE_OK;
+		if( mMetricsEnabled )
+		{
+			AddDownloadMetrics(mCurl.mHandle,performedOk,mMetrics);
+		}
+
+		if( performedOk )
+		{
+			downloadedOk = ProcessWeatherReport(response.mData,response.mUsed);
+		}
+		else
+		{
+			std::cerr << "Lib curl curl_easy_perform failed, [" << errorBuffer << "]\n";
+		}
+		curl_easy_setopt(mCurl.mHandle, CURLOPT_ERRORBUFFER, nullptr);
+	}
+
+	if( downloadedOk == false )
+	{// Nothing new, so nothing changed.
+		mChanges.Reset();
+	}
+
+	// Always return something. So they know if it failed or not.
+	pReturnFunction(downloadedOk,*this,mChanges);
+}
+
+bool OpenWeatherMap::ProcessWeatherReport(const std::string& pJson)
+{
+	return ProcessWeatherReport(pJson.data(),pJson.size());
+}
+
+bool OpenWeatherMap::ProcessWeatherReport(const char* pJson,size_t pLength)
+{
+	StageTimer timer(mMetricsEnabled);
+	bool processedOk = false;
+	const FixedJson weather(pJson,pJson + pLength);
+	if( weather.GetType() == tinyjson::JsonValueType::OBJECT )
+	{
+		const double parse = timer.Lap();
+		processedOk = ReadWeatherReport(weather);
+		if( mMetricsEnabled )
+		{
+			AddReportMetrics(processedOk,parse,timer.Lap(),mMetrics);
+
+			MemoryUsage usage = GetMemoryUsage();
+			usage[MemoryCategory::RESPONSE] = pLength;
+			mMetrics.mPeakMemory.SetPeak(usage);
+		}
+	}
+	else
+	{
+		std::cerr << "Failed to read weather: the response is not a json object\n";
+		if( mMetricsEnabled )
+		{
+			AddReportMetrics(false,0.0,0.0,mMetrics);
+		}
+	}
+	return processedOk;
+}
+#else
+void OpenWeatherMap::Get(double pLatitude,double pLongitude,std::function<void(bool pDownloadedOk,const OpenWeatherMap& pWeather,const ForecastChanges& pChanges)> pReturnFunction)
 { 
 	assert( pReturnFunction != nullptr );
 
@@ -179,106 +1491,235 @@ void OpenWeatherMap::Get(double pLatitude,double pLongitude,std::function<void(b
 
 	std::string jsonData;
 	std::stringstream url;
-	url << "http://api.openweathermap.org/data/2.5/onecall?";
+	url << mServerURL << "?";
 	url << "lat=" << pLatitude << "&";
 	url << "lon=" << pLongitude << "&";
 	url << "appid=" << mAPIKey;
 
-	if( DownloadWeatherReport(url.str(),jsonData) )
+	if( mCache )
 	{
-		try
+		const std::string key = mCache->MakeKey(pLatitude,pLongitude,mServerURL);
+		switch( mCache->Find(key,std::time(nullptr),jsonData) )
 		{
-			// We got it, now we need to build the weather object from the json.
-			// I would have used rapid json but that is a lot of files to add to this project.
-			// My intention is for someone to beable to drop these two files into their project and continue.
-			// And so I will make my own json reader, it's easy but not the best solution.
-			tinyjson::JsonProcessor json(jsonData);
-			const tinyjson::JsonValue weather = json.GetRoot();
-
-			mTimeZone = weather.GetString("timezone");
-			mTimezoneOffset = weather.GetUInt32("timezone_offset");
-
-			// Lets build up the weather data.
-			if( weather.HasValue("current") )
-			{
-				downloadedOk = true;
-				ReadWeatherData(weather["current"],mCurrent);
-			}
+		case CacheState::FRESH:
+			downloadedOk = ProcessWeatherReport(jsonData);
+			break;
 
-			if( weather.GetArraySize("hourly") > 0 )
+		case CacheState::STALE:
+			// Give them what we have now and fetch a new one in the background for next time.
+			// The background fetch only updates the cache, never this object.
+			downloadedOk = ProcessWeatherReport(jsonData);
+			mCache->Revalidate(key,[request = url.str()](std::string& rJson)
 			{
-				downloadedOk = true;
-				const tinyjson::JsonValue& hourly = weather["hourly"];
-				for( const auto& weather : hourly.mArray )
-				{
-					// Looks odd, but is the easiest / optimal way to reduce memory reallocations using c++14 features.
-					mHourly.resize(mHourly.size()+1);
-					ReadWeatherData(weather,mHourly.back());
-				}
-			}
+				return DownloadWeatherReport(request,rJson) && IsWeatherReport(rJson);
+			});
+			break;
 
-			if( weather.GetArraySize("daily") > 0 )
+		case CacheState::MISS:
+			jsonData.clear();
+			if( DownloadWeatherReport(url.str(),jsonData,mMetricsEnabled ? &mMetrics : nullptr) )
 			{
-				downloadedOk = true;
-				const tinyjson::JsonValue& daily = weather["daily"];
-				for( const auto& weather : daily.mArray )
+				downloadedOk = ProcessWeatherReport(jsonData);
+				if( downloadedOk )
 				{
-					mDaily.resize(mDaily.size()+1);
-					ReadDailyWeatherData(weather,mDaily.back());
+					mCache->Store(key,jsonData,std::time(nullptr));
 				}
-
 			}
+			break;
 		}
-		catch(std::runtime_error &e)
-		{
-			std::cerr << "Failed to download weather: " << e.what() << "\n";
-		}
+	}
+	else if( DownloadWeatherReport(url.str(),jsonData,mMetricsEnabled ? &mMetrics : nullptr) )
+	{
+		downloadedOk = ProcessWeatherReport(jsonData);
+	}
+
+	if( downloadedOk == false )
+	{// Nothing new, so nothing changed.
+		mChanges.Reset();
 	}
 
 	// Always return something. So they know if it failed or not.
-	pReturnFunction(downloadedOk,*this);
+	pReturnFunction(downloadedOk,*this,mChanges);
 }
 
-const WeatherData* OpenWeatherMap::GetHourlyForcast(std::time_t pNowUTC)const
+bool OpenWeatherMap::ProcessWeatherReport(const std::string& pJson)
 {
-	const WeatherData* current = nullptr;
-	for( const auto& t : mHourly )
+	StageTimer timer(mMetricsEnabled);
+	double parse = 0.0;
+	double populate = 0.0;
+	bool processedOk = false;
+	try
 	{
-		if( t.mTime.mUTC < pNowUTC )
-		{
-			current = &t;
+		// We got it, now we need to build the weather object from the json.
+		// I would have used rapid json but that is a lot of files to add to this project.
+		// My intention is for someone to beable to drop these two files into their project and continue.
+		// And so I will make my own json reader, it's easy but not the best solution.
+		tinyjson::JsonProcessor json(pJson);
+		parse = timer.Lap();
+		processedOk = ReadWeatherReport(json.GetRoot());
+		populate = timer.Lap();
+
+		if( mMetricsEnabled )
+		{// Whilst the response and the json are still around.
+			tinyjson::JsonMemoryUsage document;
+			tinyjson::GetMemoryUsage(json.GetRoot(),document);
+			MemoryUsage usage = GetMemoryUsage();
+			usage[MemoryCategory::RESPONSE] = GetStringHeap(pJson);
+			usage[MemoryCategory::JSON_NODES] = document.mNodes;
+			usage[MemoryCategory::JSON_KEYS] = document.mKeys;
+			usage[MemoryCategory::JSON_STRINGS] = document.mStrings;
+			mMetrics.mPeakMemory.SetPeak(usage);
 		}
 	}
+	catch(std::runtime_error &e)
+	{
+		std::cerr << "Failed to read weather: " << e.what() << "\n";
+	}
+
+	if( mMetricsEnabled )
+	{
+		AddReportMetrics(processedOk,parse,populate,mMetrics);
+	}
 
-	return current;
+	return processedOk;
 }
+#endif //#ifdef TINYWEATHER_FIXED_CAPACITY
 
-float OpenWeatherMap::GetHourlyTemperature(std::time_t pNowUTC)const
+template<typename JSON> bool OpenWeatherMap::ReadWeatherReport(const JSON& pWeather)
 {
-	float current = -99.99f;
-	for( const auto& t : mHourly )
+	bool processedOk = false;
+	size_t entries = 0;
+	mLatitude = pWeather.GetDouble("lat",mLatitude);
+	mLongitude = pWeather.GetDouble("lon",mLongitude);
+	mTimeZone = pWeather.GetString("timezone");
+	mTimezoneOffset = pWeather.GetInt32("timezone_offset");
+
+	// Refresh what we have in place, so calling Get again does not grow the vectors or reallocate the strings.
+	// Anything not in the response is left as it was and reported as not changed.
+	mChanges.Reset();
+
+	// Lets build up the weather data.
+	if( pWeather.HasValue("current") )
+	{
+		processedOk = true;
+		mChanges.mCurrent = ReadWeatherData(pWeather["current"],mThresholds,mTimezoneOffset,mCurrent,mReportedCurrent);
+		entries++;
+	}
+
+	if( pWeather.GetArraySize("minutely") > 0 )
 	{
-		if( t.mTime.mUTC < pNowUTC )
+		processedOk = true;
+		const auto& minutely = pWeather["minutely"];
+		mMinutely.resize(std::min(minutely.GetArraySize(),mMinutely.max_size()));
+		for( size_t n = 0 ; n < mMinutely.size() ; n++ )
 		{
-			current = t.mTemperature.c;
+			UpdateValue(mMinutely[n].mTime,minutely[n].GetUInt64("dt"),mTimezoneOffset,0);
+			mMinutely[n].mPrecipitation = minutely[n].GetFloat("precipitation");
 		}
+		mNowcast.Build(mMinutely);
+		entries += mMinutely.size();
+	}
+
+	if( pWeather.GetArraySize("hourly") > 0 )
+	{
+		processedOk = true;
+		ReadEntries(pWeather["hourly"],mThresholds,mTimezoneOffset,ReadWeatherData<JSON>,mHourly,mReportedHourly,mChanges.mHourly);
+		mHourlyColumns.Build(mHourly);
+		mHourlyIndex.Build(mHourly);
+		entries += mHourly.size();
+	}
+
+	if( pWeather.GetArraySize("daily") > 0 )
+	{
+		processedOk = true;
+		ReadEntries(pWeather["daily"],mThresholds,mTimezoneOffset,ReadDailyWeatherData<JSON>,mDaily,mReportedDaily,mChanges.mDaily);
+		mDailyIndex.Build(mDaily);
+		entries += mDaily.size();
+	}
+
+	if( mMetricsEnabled )
+	{
+		mMetrics.mLastEntriesParsed = entries;
+		mMetrics.mEntriesParsed += entries;
 	}
 
-	return current;
+	return processedOk;
 }
 
-HourlyIconVector OpenWeatherMap::GetTodaysHourlyIconCodes(std::time_t pNowUTC)const
+MemoryUsage OpenWeatherMap::GetMemoryUsage()const
 {
-	HourlyIconVector icons;
+	MemoryUsage usage;
+	usage[MemoryCategory::STRINGS] = GetStringHeap(mTimeZone) + GetStringHeap(mAPIKey) + GetStringHeap(mServerURL);
+	usage[MemoryCategory::MINUTELY] = GetContainerBytes(mMinutely) + sizeof(mNowcast);
+	usage[MemoryCategory::HOURLY] = GetContainerBytes(mHourly) + GetContainerBytes(mReportedHourly);
+	usage[MemoryCategory::DAILY] = GetContainerBytes(mDaily) + GetContainerBytes(mReportedDaily);
+
+	size_t columns = GetContainerBytes(mHourlyColumns.mTime) + GetContainerBytes(mHourlyColumns.mConditionID);
+	size_t columnsInline = GetInlineBytes(mHourlyColumns.mTime) + GetInlineBytes(mHourlyColumns.mConditionID);
+	for( const auto& column : mHourlyColumns.mValues )
+	{
+		columns += GetContainerBytes(column);
+		columnsInline += GetInlineBytes(column);
+	}
+	usage[MemoryCategory::HOURLY_COLUMNS] = columns;
+	usage[MemoryCategory::INDEXES] = GetContainerBytes(mHourlyIndex.mTimes) + GetContainerBytes(mDailyIndex.mTimes);
+	usage[MemoryCategory::CHANGES] = GetContainerBytes(mChanges.mHourly) + GetContainerBytes(mChanges.mDaily);
+
+	// What is left of the object, the fixed size containers are in it and have been counted above.
+	const size_t inlineBytes = GetInlineBytes(mMinutely) + sizeof(mNowcast) + GetInlineBytes(mHourly) + GetInlineBytes(mDaily) +
+		GetInlineBytes(mReportedHourly) + GetInlineBytes(mReportedDaily) +
+		columnsInline + GetInlineBytes(mHourlyIndex.mTimes) + GetInlineBytes(mDailyIndex.mTimes) +
+		GetInlineBytes(mChanges.mHourly) + GetInlineBytes(mChanges.mDaily);
+	usage[MemoryCategory::OBJECT] = sizeof(OpenWeatherMap) - inlineBytes;
+	return usage;
+}
+
+const WeatherData* OpenWeatherMap::GetHourlyForcast(std::time_t pNowUTC)const
+{
+	const size_t index = mHourlyIndex.FindBefore(pNowUTC);
+	return index < mHourly.size() ? &mHourly[index] : nullptr;
+}
+
+const DailyWeatherData* OpenWeatherMap::GetDailyForcast(std::time_t pNowUTC)const
+{
+	if( mDaily.size() == 0 )
+		return nullptr;
+
+	// Pick the closer of the one after and the one before.
+	const size_t after = std::min(mDailyIndex.LowerBound(pNowUTC),mDaily.size() - 1);
+	if( after > 0 && pNowUTC - mDaily[after-1].mTime.mUTC < mDaily[after].mTime.mUTC - pNowUTC )
+		return &mDaily[after-1];
+	return &mDaily[after];
+}
 
-	const WeatherTime now(pNowUTC);
+EntryRange<WeatherData> OpenWeatherMap::GetHourlyRange(std::time_t pFromUTC,std::time_t pToUTC)const
+{
+	const size_t first = mHourlyIndex.LowerBound(pFromUTC);
+	const size_t last = std::max(first,mHourlyIndex.LowerBound(pToUTC));
+	return {mHourly.data() + first,mHourly.data() + last};
+}
+
+EntryRange<DailyWeatherData> OpenWeatherMap::GetDailyRange(std::time_t pFromUTC,std::time_t pToUTC)const
+{
+	const size_t first = mDailyIndex.LowerBound(pFromUTC);
+	const size_t last = std::max(first,mDailyIndex.LowerBound(pToUTC));
+	return {mDaily.data() + first,mDaily.data() + last};
+}
+
+float OpenWeatherMap::GetHourlyTemperature(std::time_t pNowUTC)const
+{
+	const WeatherData* current = GetHourlyForcast(pNowUTC);
+	return current ? current->mTemperature.c : -99.99f;
+}
 
-	for( const auto& t : mHourly )
+HourlyIconVector OpenWeatherMap::GetTodaysHourlyIconCodes(std::time_t pNowUTC)const
+{
+	const HourlyIconView view = GetTodaysHourlyIconView(pNowUTC);
+	HourlyIconVector icons;
+	icons.reserve(view.size());
+	for( const HourlyIcon icon : view )
 	{
-		if( t.mTime.mDay == now.mDay )
-		{
-			icons.push_back(std::make_pair(t.mTime.mHour,t.mDisplay.mIcon));
-		}
+		icons.push_back(std::make_pair(icon.mHour,icon.GetIcon()));
 	}
 
 	return icons;
@@ -286,25 +1727,37 @@ HourlyIconVector OpenWeatherMap::GetTodaysHourlyIconCodes(std::time_t pNowUTC)co
 
 HourlyIconVector OpenWeatherMap::GetHourlyIconCodes(std::time_t pNowUTC)const
 {
+	const HourlyIconView view = GetHourlyIconView(pNowUTC);
 	HourlyIconVector icons;
+	icons.reserve(view.size());
+	for( const HourlyIcon icon : view )
+	{
+		icons.push_back(std::make_pair(icon.mHour,icon.GetIcon()));
+	}
 
+	return icons;
+}
+
+HourlyIconView OpenWeatherMap::GetTodaysHourlyIconView(std::time_t pNowUTC)const
+{
+	// Today is the day where the forecast is for, the same time zone as the mDay of the hourly data.
+	const std::time_t local = pNowUTC + mTimezoneOffset;
+	const std::time_t start = local - (((local % ONE_DAY) + ONE_DAY) % ONE_DAY) - mTimezoneOffset;
+	return {GetHourlyRange(start,start + ONE_DAY)};
+}
+
+HourlyIconView OpenWeatherMap::GetHourlyIconView(std::time_t pNowUTC)const
+{
 	// Adjust time to be on the hour.
 	// Done line this as the icons can span days.
 	pNowUTC = RoundToHour(pNowUTC);
 
-	for( const auto& t : mHourly )
-	{
-		if( pNowUTC <= t.mTime.mUTC )
-		{
-			icons.push_back(std::make_pair(t.mTime.mHour,t.mDisplay.mIcon));
-		}
-	}
-
-	return icons;
+	const size_t first = mHourlyIndex.LowerBound(pNowUTC);
+	return {{mHourly.data() + first,mHourly.data() + mHourly.size()}};
 }
 
 
-bool OpenWeatherMap::DownloadWeatherReport(const std::string& pURL,std::string& rJson)const
+bool OpenWeatherMap::DownloadWeatherReport(const std::string& pURL,std::string& rJson,FetchMetrics* pMetrics)
 {
 	bool result = false;
 	CURL *curl = curl_easy_init();
@@ -340,6 +1793,11 @@ bool OpenWeatherMap::DownloadWeatherReport(const std::string& pURL,std::string&
 			std::cerr << "Lib curl " << funcName << " failed, [" << errorBuffer << "]\n";
 		}
 
+		if( pMetrics )
+		{
+			AddDownloadMetrics(curl,result,*pMetrics);
+		}
+
 		/* always cleanup */ 
 		curl_easy_cleanup(curl);
 	}
@@ -24,14 +24,109 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <utility>
+#include <memory>
 #include <functional>
 #include <ctime>
+#include <string_view>
+#include <assert.h>
+#include <stdint.h>
+
+/**
+ * Define TINYWEATHER_FIXED_CAPACITY for boards where the heap can not be trusted to last for weeks of refreshes.
+ * The forecast entries are held in fixed size arrays in the OpenWeatherMap object, sized for the one call api, the json
+ * is read in place from a buffer you give it, no DOM, and a refresh does no allocations at all.
+ * The response cache is not available in this build, and libcurl still does its own mallocs for the connection.
+ */
 
 namespace tinyweather{
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+class ResponseCache;
+
 typedef std::vector<std::pair<int,std::string>> HourlyIconVector;
 
+static const size_t MINUTELY_CAPACITY = 61;	//!< Most entries of each type the one call api sends.
+static const size_t HOURLY_CAPACITY = 48;
+static const size_t DAILY_CAPACITY = 8;
+
+/**
+ * @brief The bits of std::vector the forecast uses, over an array that is part of the object, so it never allocates.
+ * Resizing past the capacity stops at the capacity.
+ */
+template<typename T,size_t CAPACITY> class FixedVector
+{
+public:
+	typedef T value_type;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	size_t size()const{return mSize;}
+	size_t capacity()const{return CAPACITY;}
+	size_t max_size()const{return CAPACITY;}
+	bool empty()const{return mSize == 0;}
+
+	void clear(){mSize = 0;}
+	void reserve(size_t){}
+
+	/**
+	 * @brief As std::vector, new entries are value initialised and the ones kept are left alone.
+	 */
+	void resize(size_t pSize)
+	{
+		assert( pSize <= CAPACITY );
+		pSize = std::min(pSize,CAPACITY);
+		for( size_t n = mSize ; n < pSize ; n++ )
+		{
+			mItems[n] = T();
+		}
+		mSize = pSize;
+	}
+
+	void assign(size_t pSize,const T& pValue)
+	{
+		resize(pSize);
+		std::fill(begin(),end(),pValue);
+	}
+
+	void push_back(const T& pValue)
+	{
+		assert( mSize < CAPACITY );
+		if( mSize < CAPACITY )
+		{
+			mItems[mSize++] = pValue;
+		}
+	}
+
+	T& operator [](size_t pIndex){return mItems[pIndex];}
+	const T& operator [](size_t pIndex)const{return mItems[pIndex];}
+	T& front(){return mItems[0];}
+	const T& front()const{return mItems[0];}
+	T& back(){return mItems[mSize-1];}
+	const T& back()const{return mItems[mSize-1];}
+	T* data(){return mItems;}
+	const T* data()const{return mItems;}
+
+	iterator begin(){return mItems;}
+	iterator end(){return mItems + mSize;}
+	const_iterator begin()const{return mItems;}
+	const_iterator end()const{return mItems + mSize;}
+
+private:
+	T mItems[CAPACITY];
+	size_t mSize = 0;
+};
+
+/**
+ * @brief What the forecast is held in, a std::vector or in the fixed capacity build a FixedVector.
+ */
+#ifdef TINYWEATHER_FIXED_CAPACITY
+	template<typename T,size_t CAPACITY> using ForecastVector = FixedVector<T,CAPACITY>;
+#else
+	template<typename T,size_t CAPACITY> using ForecastVector = std::vector<T>;
+#endif
+
 struct WeatherTime
 {
 	std::time_t mUTC;
@@ -41,18 +136,67 @@ struct WeatherTime
 	{
 		Set(pUTC);
 	}
+
+	WeatherTime(std::time_t pUTC,int32_t pTimezoneOffset)
+	{
+		Set(pUTC,pTimezoneOffset);
+	}
 	
+	/**
+	 * @brief Sets the time, the local fields are in the time zone of the computer this is running on.
+	 */
 	void Set(std::time_t pTime)
 	{
 		mUTC = pTime;
 
-		tm currentTime = *localtime((time_t*)&pTime);
+		tm currentTime;
+		localtime_r(&pTime,&currentTime);
 
 		mYear = currentTime.tm_year + 1900;
 		mMonth = currentTime.tm_mon + 1; // (1 - 12) tm.tm_mon is zero based index 0 - 11 but day in month is not, no consistency!
 		mDay = currentTime.tm_mday;   // (1 - 31) or 30 or 29 or 28..... tm.tm_mday is 1 based index.
 		mHour = currentTime.tm_hour;
 		mMinute = currentTime.tm_min;
+		mTimezoneOffset = (int32_t)currentTime.tm_gmtoff;
+	}
+
+	/**
+	 * @brief Sets the time with the local fields for a time zone pTimezoneOffset seconds from UTC, pass the forecast's mTimezoneOffset
+	 * to get the time where the forecast is for. Just arithmetic, no call to localtime so no lock, and the date of the last day
+	 * worked out is kept per thread so for an hourly forecast the date is only worked out once a day.
+	 */
+	void Set(std::time_t pTime,int32_t pTimezoneOffset)
+	{
+		mUTC = pTime;
+		mTimezoneOffset = pTimezoneOffset;
+
+		int64_t days = ((int64_t)pTime + pTimezoneOffset) / 86400;
+		int64_t seconds = ((int64_t)pTime + pTimezoneOffset) % 86400;
+		if( seconds < 0 )
+		{
+			seconds += 86400;
+			days--;
+		}
+		mHour = (int)(seconds / 3600);
+		mMinute = (int)((seconds / 60) % 60);
+
+		static thread_local struct{int64_t mDays = INT64_MIN;int mYear,mMonth,mDay;}lastDay;
+		if( lastDay.mDays != days )
+		{// Days since 1970 to the date, from http://howardhinnant.github.io/date_algorithms.html civil_from_days
+			const int64_t z = days + 719468;
+			const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+			const int64_t dayOfEra = z - era * 146097;
+			const int64_t yearOfEra = (dayOfEra - dayOfEra/1460 + dayOfEra/36524 - dayOfEra/146096) / 365;
+			const int64_t dayOfYear = dayOfEra - (365*yearOfEra + yearOfEra/4 - yearOfEra/100);
+			const int64_t monthIndex = (5*dayOfYear + 2) / 153; // March is zero.
+			lastDay.mDays = days;
+			lastDay.mDay = (int)(dayOfYear - (153*monthIndex + 2)/5 + 1);
+			lastDay.mMonth = (int)(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+			lastDay.mYear = (int)(yearOfEra + era * 400 + (lastDay.mMonth <= 2 ? 1 : 0));
+		}
+		mYear = lastDay.mYear;
+		mMonth = lastDay.mMonth;
+		mDay = lastDay.mDay;
 	}
 
 	int mYear;
@@ -60,6 +204,7 @@ struct WeatherTime
 	int mDay;   // (1 - 31) or 30 or 29 or 28.....
 	int mHour;
 	int mMinute;
+	int32_t mTimezoneOffset;	//!< Seconds from UTC of the time zone the fields above are in.
 
 	std::string GetDate()const{return std::to_string(mDay) + "/" + std::to_string(mMonth) + "/" + std::to_string(mYear);}
 	std::string GetTime()const{return std::to_string(mHour) + ":" + std::to_string(mMinute);}
@@ -82,12 +227,58 @@ struct Temperature
 	}
 };
 
+/**
+ * @brief Process wide table of the weather conditions and icons, so each forecast entry holds a couple of small
+ * numbers and not three strings. Starts off with all the conditions and icons in the OpenWeather docs,
+ * anything else that turns up, like a description in another language, is added when first seen.
+ * Thread safe, looking up an entry never takes a lock, adding a new one does.
+ */
+class ConditionTable
+{
+public:
+	static const size_t MAX_CONDITIONS = 1024;
+	static const size_t MAX_ICONS = 256;
+
+	/**
+	 * @brief Returns the handle for the condition, adding it if it's new. Zero, the empty condition, if the table is full.
+	 */
+	static uint16_t FindCondition(uint32_t pID,std::string_view pTitle,std::string_view pDescription);
+
+	/**
+	 * @brief Returns the handle for the icon name, adding it if it's new. Zero, the empty icon, if the table is full.
+	 */
+	static uint16_t FindIcon(std::string_view pIcon);
+
+	static uint32_t GetID(uint16_t pCondition);
+	static const std::string& GetTitle(uint16_t pCondition);
+	static const std::string& GetDescription(uint16_t pCondition);
+	static const std::string& GetIcon(uint16_t pIcon);
+
+	static size_t GetConditionCount();
+	static size_t GetIconCount();
+
+	/**
+	 * @brief Memory used by the table and its strings, shared by every forecast.
+	 */
+	static size_t GetMemoryUsage();
+};
+
+/**
+ * @brief The weather condition, a handle into the ConditionTable so copying and comparing is just a few ints.
+ * Zero initialised it is the empty condition, with empty strings.
+ */
 struct DisplayData
 {
 	uint32_t mID;				//!< Weather condition id
-	std::string mTitle;			//!< Group of weather parameters (Rain, Snow, Extreme etc.)
-	std::string mDescription;	//!< Weather condition within the group (full list of weather conditions). Get the output in your language
-	std::string mIcon;			//!< Weather icon id. How to get icons
+	uint16_t mCondition;		//!< Handle in the ConditionTable of the id, title and description.
+	uint16_t mIcon;				//!< Handle in the ConditionTable of the icon name.
+
+	const std::string& GetTitle()const{return ConditionTable::GetTitle(mCondition);}				//!< Group of weather parameters (Rain, Snow, Extreme etc.)
+	const std::string& GetDescription()const{return ConditionTable::GetDescription(mCondition);}	//!< Weather condition within the group (full list of weather conditions). Get the output in your language
+	const std::string& GetIcon()const{return ConditionTable::GetIcon(mIcon);}						//!< Weather icon id. How to get icons
+
+	inline bool operator == (const DisplayData& pOther)const{return mCondition == pOther.mCondition && mIcon == pOther.mIcon;}
+	inline bool operator != (const DisplayData& pOther)const{return !(*this == pOther);}
 };
 
 
@@ -111,6 +302,9 @@ struct WeatherData
 	float mWindSpeed;			//!< Wind speed. Wind speed. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
 	float mWindGusts;			//!< defaults to 0 if not found. (where available) Wind gust. Units – default: metre/sec, metric: metre/sec, imperial: miles/hour. How to change units used
 	uint32_t mWindDirection;	//!< Wind direction, degrees (meteorological)
+	float mPrecipitationProbability;	//!< Probability of precipitation, hourly forecast only.
+	float mRain;						//!< (where available) Rain volume for the last hour, mm
+	float mSnow;						//!< (where available) Snow volume for the last hour, mm
 	DisplayData mDisplay;
 };
 
@@ -129,8 +323,8 @@ struct DailyWeatherData
 			Day.Set(pDay);
 			Evening.Set(pEvening);
 			Night.Set(pNight);
-			Min.Set(pNight);
-			Max.Set(pNight);
+			Min.Set(pMin);
+			Max.Set(pMax);
 		}
 		Temperature Morning,Day,Evening,Night,Min,Max;
 	}mTemperature;	//!< Temperature. Units - default: kelvin, metric: Celsius, imperial: Fahrenheit. How to change units used
@@ -171,7 +365,499 @@ struct DailyWeatherData
 struct MinutelyForecast
 {
 	WeatherTime mTime; //!< Time of the forecasted data, unix, UTC
-	uint32_t mPrecipitation; //!< Precipitation volume, mm
+	float mPrecipitation; //!< Precipitation, mm/h
+};
+
+typedef ForecastVector<MinutelyForecast,MINUTELY_CAPACITY> MinutelyForecasts;
+typedef ForecastVector<WeatherData,HOURLY_CAPACITY> HourlyForecasts;
+typedef ForecastVector<DailyWeatherData,DAILY_CAPACITY> DailyForecasts;
+
+/**
+ * @brief The next hour of precipitation, a minute at a time, set up so the questions a display asks every few seconds are cheap.
+ * Fixed size, so refreshing it never allocates. Running totals make the total over any span one subtraction,
+ * and tables of the max and min over each power of two span make the max or min over any span two lookups,
+ * so finding when the rain starts or stops is a short binary search.
+ * Minutes are counted from the sample that pNowUTC falls in.
+ */
+struct MinutelyNowcast
+{
+	static const size_t CAPACITY = 64;		//!< The api sends 61.
+	static const size_t LEVELS = 7;			//!< floor(log2(CAPACITY)) + 1, so a span can cover all CAPACITY samples.
+
+	std::time_t mStart = 0;					//!< UTC time of the first sample, they are a minute apart.
+	size_t mCount = 0;
+	float mPrecipitation[CAPACITY];			//!< mm/h
+	float mTotal[CAPACITY+1];				//!< mTotal[n] is the mm that falls in the n minutes from the start.
+	float mMax[LEVELS][CAPACITY];			//!< mMax[l][n] is the max of the 2^l samples from n.
+	float mMin[LEVELS][CAPACITY];			//!< mMin[l][n] is the min of the 2^l samples from n.
+
+	/**
+	 * @brief Rebuilds from the samples, any past CAPACITY or not a minute on from the one before are dropped.
+	 */
+	void Build(const MinutelyForecasts& pMinutely);
+
+	/**
+	 * @brief How many of the minutes from pNowUTC are in the nowcast.
+	 */
+	int GetMinutesLeft(std::time_t pNowUTC)const;
+
+	/**
+	 * @brief Expected precipitation in mm for the next pMinutes, only counting minutes in the nowcast.
+	 */
+	float GetTotal(std::time_t pNowUTC,int pMinutes)const;
+
+	/**
+	 * @brief The heaviest precipitation in mm/h in the next pMinutes.
+	 */
+	float GetMax(std::time_t pNowUTC,int pMinutes)const;
+
+	/**
+	 * @brief Minutes until the precipitation is more than pThreshold mm/h, zero if it is already.
+	 * @return -1 if it does not happen within the nowcast.
+	 */
+	int GetMinutesUntilAbove(std::time_t pNowUTC,float pThreshold)const;
+
+	/**
+	 * @brief Minutes until the precipitation is at or below pThreshold mm/h, zero if it is already.
+	 * @return -1 if it does not happen within the nowcast.
+	 */
+	int GetMinutesUntilBelow(std::time_t pNowUTC,float pThreshold)const;
+
+	/**
+	 * @brief How long it stays dry, precipitation at or below pThreshold mm/h, from now.
+	 * If it stays dry for all of the nowcast that is how many minutes are left.
+	 */
+	int GetDryMinutes(std::time_t pNowUTC,float pThreshold = 0.0f)const
+	{
+		const int minutes = GetMinutesUntilAbove(pNowUTC,pThreshold);
+		return minutes < 0 ? GetMinutesLeft(pNowUTC) : minutes;
+	}
+
+private:
+	int GetIndex(std::time_t pNowUTC)const;
+	float GetRangeMax(size_t pFirst,size_t pLast)const;	//!< Inclusive.
+	float GetRangeMin(size_t pFirst,size_t pLast)const;	//!< Inclusive.
+};
+
+/**
+ * @brief Bits set in ForecastChanges for each field that changed in an entry.
+ */
+const uint32_t CHANGED_TIME				= 1<<0;		//!< Time, sunrise or sunset.
+const uint32_t CHANGED_TEMPERATURE		= 1<<1;		//!< Temperature, feels like or dew point.
+const uint32_t CHANGED_PRESSURE			= 1<<2;
+const uint32_t CHANGED_HUMIDITY			= 1<<3;
+const uint32_t CHANGED_CLOUDS			= 1<<4;
+const uint32_t CHANGED_UV_INDEX			= 1<<5;
+const uint32_t CHANGED_VISIBILITY		= 1<<6;
+const uint32_t CHANGED_WIND				= 1<<7;		//!< Speed, gusts or direction.
+const uint32_t CHANGED_PRECIPITATION	= 1<<8;		//!< Probability, rain or snow.
+const uint32_t CHANGED_CONDITION		= 1<<9;		//!< Anything in the display data, id, title, description or icon.
+const uint32_t CHANGED_ALL				= 0xffffffff;	//!< A new entry, was not in the last response.
+
+/**
+ * @brief How much a value has to move by before it is reported as changed, zero reports any change.
+ */
+struct ChangeThresholds
+{
+	float mTemperature = 0.0f;		//!< Kelvin, also used for feels like and dew point.
+	float mPressure = 0.0f;			//!< hPa
+	float mPercent = 0.0f;			//!< Humidity and clouds.
+	float mUVIndex = 0.0f;
+	float mVisibility = 0.0f;		//!< Metres
+	float mWindSpeed = 0.0f;		//!< Also used for gusts.
+	float mWindDirection = 0.0f;	//!< Degrees
+	float mPrecipitation = 0.0f;	//!< mm, rain and snow volume.
+	float mProbability = 0.0f;		//!< 0 to 1, precipitation probability.
+
+	bool IsSet()const
+	{
+		return mTemperature > 0.0f || mPressure > 0.0f || mPercent > 0.0f || mUVIndex > 0.0f || mVisibility > 0.0f ||
+			mWindSpeed > 0.0f || mWindDirection > 0.0f || mPrecipitation > 0.0f || mProbability > 0.0f;
+	}
+};
+
+/**
+ * @brief What changed in the last response, so you only redraw or send on what you need to.
+ * The hourly and daily entries are matched up by time, so the forecast moving on an hour does not look like everything changed.
+ */
+struct ForecastChanges
+{
+	uint32_t mCurrent = 0;			//!< CHANGED_ bits for mCurrent.
+	ForecastVector<uint32_t,HOURLY_CAPACITY> mHourly;	//!< CHANGED_ bits for each entry in mHourly, same index.
+	ForecastVector<uint32_t,DAILY_CAPACITY> mDaily;		//!< CHANGED_ bits for each entry in mDaily, same index.
+
+	/**
+	 * @brief Marks everything as not changed, keeps the sizes.
+	 */
+	void Reset()
+	{
+		mCurrent = 0;
+		std::fill(mHourly.begin(),mHourly.end(),0);
+		std::fill(mDaily.begin(),mDaily.end(),0);
+	}
+
+	bool HasChanged()const
+	{
+		if( mCurrent != 0 )
+			return true;
+		for( uint32_t c : mHourly ){if( c != 0 )return true;}
+		for( uint32_t c : mDaily ){if( c != 0 )return true;}
+		return false;
+	}
+};
+
+/**
+ * @brief Finds entries by their time without scanning them all, rebuilt each time the weather is processed.
+ * Hourly and daily data are evenly spaced so the index is worked out from the first time and the step.
+ * If they are not, which should not happen but the data comes from the internet, a binary search is used.
+ */
+struct TimeIndex
+{
+	ForecastVector<std::time_t,HOURLY_CAPACITY> mTimes;	//!< The time of each entry, in order.
+	std::time_t mStep = 0;				//!< Time between each entry, zero if they are not evenly spaced.
+
+	template<typename ENTRIES> void Build(const ENTRIES& pEntries)
+	{
+		mTimes.resize(pEntries.size());
+		for( size_t n = 0 ; n < pEntries.size() ; n++ )
+		{
+			mTimes[n] = pEntries[n].mTime.mUTC;
+		}
+
+		mStep = mTimes.size() > 1 ? mTimes[1] - mTimes[0] : 0;
+		for( size_t n = 2 ; n < mTimes.size() && mStep != 0 ; n++ )
+		{
+			if( mTimes[n] - mTimes[n-1] != mStep )
+			{
+				mStep = 0;
+			}
+		}
+	}
+
+	size_t GetCount()const{return mTimes.size();}
+
+	/**
+	 * @brief Index of the first entry with a time >= pTimeUTC, GetCount() if there is not one.
+	 */
+	size_t LowerBound(std::time_t pTimeUTC)const
+	{
+		if( mTimes.size() == 0 || pTimeUTC <= mTimes.front() )
+			return 0;
+		if( pTimeUTC > mTimes.back() )
+			return mTimes.size();
+		if( mStep > 0 )
+			return (size_t)((pTimeUTC - mTimes.front() + mStep - 1) / mStep);
+		return std::lower_bound(mTimes.begin(),mTimes.end(),pTimeUTC) - mTimes.begin();
+	}
+
+	/**
+	 * @brief Index of the last entry with a time < pTimeUTC, GetCount() if there is not one.
+	 */
+	size_t FindBefore(std::time_t pTimeUTC)const
+	{
+		const size_t index = LowerBound(pTimeUTC);
+		return index > 0 ? index - 1 : mTimes.size();
+	}
+};
+
+/**
+ * @brief A range of entries, from one of the GetHourly / GetDaily range functions, for use in a range based for loop.
+ */
+template<typename ENTRY> struct EntryRange
+{
+	typedef const ENTRY* Iterator;
+
+	Iterator mBegin;
+	Iterator mEnd;
+
+	Iterator begin()const{return mBegin;}
+	Iterator end()const{return mEnd;}
+	size_t size()const{return mEnd - mBegin;}
+	bool empty()const{return mBegin == mEnd;}
+};
+
+/**
+ * @brief The icon for an hour, the name is in the ConditionTable so nothing is copied.
+ */
+struct HourlyIcon
+{
+	int mHour;					//!< 24h, EG 19 for 7pm.
+	const std::string* mIcon;	//!< Icon name, good for the life of the process.
+
+	const std::string& GetIcon()const{return *mIcon;}
+};
+
+/**
+ * @brief The icons for a range of hours, read from the hourly data as you go so making one and looping over it allocates nothing.
+ * for( const HourlyIcon icon : weather.GetHourlyIconView(now) ){...}
+ * Only good until the weather is next refreshed.
+ */
+struct HourlyIconView
+{
+	struct Iterator
+	{
+		EntryRange<WeatherData>::Iterator mEntry;
+
+		HourlyIcon operator*()const{return {mEntry->mTime.mHour,&mEntry->mDisplay.GetIcon()};}
+		Iterator& operator++(){++mEntry;return *this;}
+		bool operator == (const Iterator& pOther)const{return mEntry == pOther.mEntry;}
+		bool operator != (const Iterator& pOther)const{return mEntry != pOther.mEntry;}
+	};
+
+	EntryRange<WeatherData> mHours;
+
+	Iterator begin()const{return {mHours.begin()};}
+	Iterator end()const{return {mHours.end()};}
+	size_t size()const{return mHours.size();}
+	bool empty()const{return mHours.empty();}
+
+	/**
+	 * @brief Copies the icons into your buffer.
+	 * @return size_t The number written, at most pMaxIcons.
+	 */
+	size_t Copy(HourlyIcon* rIcons,size_t pMaxIcons)const
+	{
+		size_t count = 0;
+		for( auto i = begin() ; i != end() && count < pMaxIcons ; ++i )
+		{
+			rIcons[count++] = *i;
+		}
+		return count;
+	}
+};
+
+/**
+ * @brief The hourly values kept in HourlyColumns, all as floats so they can share the same code.
+ */
+enum struct HourlyColumn
+{
+	TEMPERATURE,				//!< Kelvin
+	FEELS_LIKE,					//!< Kelvin
+	HUMIDITY,
+	PRESSURE,
+	CLOUDS,
+	WIND_SPEED,
+	WIND_GUSTS,
+	PRECIPITATION_PROBABILITY,
+	RAIN,
+	SNOW,
+	UV_INDEX,
+	COUNT
+};
+
+/**
+ * @brief How HourlyColumns::Interpolate works out the values between the hours.
+ */
+enum struct Interpolation
+{
+	LINEAR,			//!< Straight line between the hours.
+	MONOTONE_CUBIC	//!< Smooth curve that never overshoots the hourly values, so no made up peaks on your graph.
+};
+
+/**
+ * @brief What HourlyColumns::Interpolate does with a time before the first hour or after the last.
+ */
+enum struct OutOfRange
+{
+	CLAMP,			//!< Use the first or last value.
+	NOT_A_NUMBER	//!< Set to NAN so you can see it and not draw it.
+};
+
+/**
+ * @brief Result of HourlyColumns::Summarise.
+ */
+struct ColumnSummary
+{
+	size_t mCount = 0;		//!< Number of hours in the window, if zero the rest is not set.
+	float mMin = 0.0f;
+	float mMax = 0.0f;
+	float mMean = 0.0f;
+	size_t mMinIndex = 0;	//!< Index, into mHourly and the columns, of the first hour with the lowest value.
+	size_t mMaxIndex = 0;	//!< Index of the first hour with the highest value.
+};
+
+/**
+ * @brief The hourly forecast held column by column, built each time the weather is processed.
+ * Reading one value for all the hours in mHourly strides over the whole WeatherData struct for each one,
+ * here they are next to each other so a scan touches a few cache lines and the compiler can vectorise it.
+ * Index n in every column is the same hour as mHourly[n].
+ */
+struct HourlyColumns
+{
+	typedef ForecastVector<float,HOURLY_CAPACITY> Column;
+
+	ForecastVector<std::time_t,HOURLY_CAPACITY> mTime;		//!< UTC, in order.
+	Column mValues[(size_t)HourlyColumn::COUNT];
+	ForecastVector<uint32_t,HOURLY_CAPACITY> mConditionID;	//!< Weather condition id.
+
+	/**
+	 * @brief Rebuilds the columns, reusing the memory from last time.
+	 */
+	void Build(const HourlyForecasts& pHourly);
+
+	size_t GetCount()const{return mTime.size();}
+	const Column& GetColumn(HourlyColumn pColumn)const{return mValues[(size_t)pColumn];}
+
+	/**
+	 * @brief Finds the hours with a time that is >= pFromUTC and < pToUTC.
+	 * @param rFirst Set to the index of the first hour in the window, rLast to one past the last.
+	 */
+	void GetWindow(std::time_t pFromUTC,std::time_t pToUTC,size_t& rFirst,size_t& rLast)const;
+
+	/**
+	 * @brief Min, max, mean and where the min and max are for the hours >= pFromUTC and < pToUTC.
+	 */
+	ColumnSummary Summarise(HourlyColumn pColumn,std::time_t pFromUTC,std::time_t pToUTC)const;
+
+	float GetMin(HourlyColumn pColumn,std::time_t pFromUTC,std::time_t pToUTC)const{return Summarise(pColumn,pFromUTC,pToUTC).mMin;}
+	float GetMax(HourlyColumn pColumn,std::time_t pFromUTC,std::time_t pToUTC)const{return Summarise(pColumn,pFromUTC,pToUTC).mMax;}
+	float GetMean(HourlyColumn pColumn,std::time_t pFromUTC,std::time_t pToUTC)const{return Summarise(pColumn,pFromUTC,pToUTC).mMean;}
+
+	/**
+	 * @brief Works out the value of the column at each of the times passed in, for drawing smooth graphs.
+	 * Times in order, like one per pixel, are the fastest as the hour each is in is found by moving on from the last.
+	 * Temperatures are in kelvin, like the column.
+	 * @param pTimesUTC The times, pCount of them.
+	 * @param rValues Where the values are written, must have room for pCount.
+	 * @return size_t How many of the times were within the hourly data, the rest are set as pOutOfRange says.
+	 */
+	size_t Interpolate(HourlyColumn pColumn,const std::time_t* pTimesUTC,size_t pCount,float* rValues,
+					Interpolation pInterpolation = Interpolation::LINEAR,
+					OutOfRange pOutOfRange = OutOfRange::CLAMP)const;
+
+	/**
+	 * @brief As above for one time.
+	 * @return true if the time was within the hourly data.
+	 */
+	bool Interpolate(HourlyColumn pColumn,std::time_t pTimeUTC,float& rValue,Interpolation pInterpolation = Interpolation::LINEAR)const
+	{
+		return Interpolate(pColumn,&pTimeUTC,1,&rValue,pInterpolation,OutOfRange::CLAMP) == 1;
+	}
+};
+
+/**
+ * @brief The parts of a refresh that are timed, see FetchMetrics.
+ * The network ones come from curl, a reused connection has no name lookup or connect time.
+ */
+enum struct FetchStage
+{
+	NAME_LOOKUP,	//!< DNS.
+	CONNECT,		//!< TCP connect and, for https, the TLS handshake.
+	FIRST_BYTE,		//!< From the request being sent to the first byte back, the time the server took.
+	TRANSFER,		//!< From the first byte to the last.
+	TOTAL,			//!< The whole download, the four above and anything curl did in between.
+	PARSE,			//!< Reading the json.
+	POPULATE,		//!< Filling in the forecast from it, working out what changed and building the indexes.
+	COUNT
+};
+
+/**
+ * @brief What the memory of a forecast is used for, see OpenWeatherMap::GetMemoryUsage.
+ */
+enum struct MemoryCategory
+{
+	OBJECT,			//!< The rest of the OpenWeatherMap, the current weather, settings and metrics.
+	STRINGS,		//!< Time zone name, api key and server url.
+	MINUTELY,		//!< mMinutely and mNowcast.
+	HOURLY,
+	DAILY,
+	HOURLY_COLUMNS,
+	INDEXES,		//!< mHourlyIndex and mDailyIndex.
+	CHANGES,		//!< The ForecastChanges of the last refresh.
+	RESPONSE,		//!< The json text, only held during a refresh.
+	JSON_NODES,		//!< The parsed json, only held during a refresh. Not used in the fixed capacity build, it reads in place.
+	JSON_KEYS,
+	JSON_STRINGS,
+	COUNT
+};
+
+/**
+ * @brief Bytes used for each MemoryCategory, heap and the object itself.
+ */
+struct MemoryUsage
+{
+	static const size_t CATEGORIES = (size_t)MemoryCategory::COUNT;
+
+	size_t mBytes[CATEGORIES] = {};
+
+	size_t& operator [](MemoryCategory pCategory){return mBytes[(size_t)pCategory];}
+	size_t operator [](MemoryCategory pCategory)const{return mBytes[(size_t)pCategory];}
+
+	size_t GetTotal()const
+	{
+		size_t total = 0;
+		for( size_t bytes : mBytes ){total += bytes;}
+		return total;
+	}
+
+	/**
+	 * @brief Keeps the larger of each category.
+	 */
+	void SetPeak(const MemoryUsage& pUsage)
+	{
+		for( size_t n = 0 ; n < CATEGORIES ; n++ ){mBytes[n] = std::max(mBytes[n],pUsage.mBytes[n]);}
+	}
+
+	static const char* GetCategoryName(MemoryCategory pCategory);	//!< Lower case, as used in the prometheus labels.
+};
+
+/**
+ * @brief Counts of how long something took, in buckets with fixed upper bounds from 100us to 10s.
+ * The counts are kept per bucket, they are added up when exported as prometheus wants them.
+ */
+struct LatencyHistogram
+{
+	static const size_t BUCKETS = 16;			//!< Plus one for anything over the last bound.
+	static const double BOUNDS[BUCKETS];		//!< Upper bound of each bucket, seconds.
+
+	uint64_t mBuckets[BUCKETS+1] = {};
+	uint64_t mCount = 0;
+	double mSum = 0.0;							//!< Seconds
+
+	void Add(double pSeconds);
+};
+
+/**
+ * @brief Where the time went in each refresh, and how much came in, turned on with OpenWeatherMap::EnableMetrics.
+ * When off the only cost is checking the flag, the clock is not read and curl is not asked.
+ * Fixed size, so it is fine in the fixed capacity build.
+ */
+struct FetchMetrics
+{
+	static const size_t STAGES = (size_t)FetchStage::COUNT;
+
+	double mLast[STAGES] = {};				//!< Seconds each stage took in the last refresh that got that far.
+	LatencyHistogram mStages[STAGES];		//!< Every refresh since it was enabled or reset.
+
+	uint64_t mDownloads = 0;				//!< Requests made, not counting ones served from the cache.
+	uint64_t mDownloadFailures = 0;
+	uint64_t mReports = 0;					//!< Responses processed, from the network, the cache or ProcessWeatherReport.
+	uint64_t mReportFailures = 0;			//!< Ones that were not a weather report.
+	uint64_t mBytesReceived = 0;			//!< Body bytes downloaded.
+	uint64_t mEntriesParsed = 0;			//!< Current, minutely, hourly and daily entries read.
+	size_t mLastBytesReceived = 0;
+	size_t mLastEntriesParsed = 0;
+	MemoryUsage mPeakMemory;				//!< Most each category has used, including the response and parsed json during a refresh.
+
+	void Reset(){*this = FetchMetrics();}
+
+	/**
+	 * @brief Adds the time for the stage to the last values and the histogram.
+	 */
+	void Add(FetchStage pStage,double pSeconds)
+	{
+		mLast[(size_t)pStage] = pSeconds;
+		mStages[(size_t)pStage].Add(pSeconds);
+	}
+
+	/**
+	 * @brief Writes the metrics in the prometheus text format, without allocating.
+	 * pLabels are added to every metric, for example location="home", or pass an empty string.
+	 * @return size_t The length written, not counting the terminating zero. If it did not fit it is cut short and pSize - 1 is returned.
+	 */
+	size_t WritePrometheus(char* rBuffer,size_t pSize,const char* pLabels = "")const;
+
+	static const char* GetStageName(FetchStage pStage);	//!< Lower case, as used in the prometheus labels.
 };
 
 /**
@@ -185,12 +871,16 @@ struct OpenWeatherMap
 	double mLatitude;			//!< Geographical coordinates of the location (latitude)
 	double mLongitude;			//!< Geographical coordinates of the location (longitude)
 	std::string mTimeZone;		//!< timezone Timezone name for the requested location
-	uint32_t mTimezoneOffset;	//!< timezone_offset Shift in seconds from UTC
+	int32_t mTimezoneOffset;	//!< timezone_offset Shift in seconds from UTC, the times in the forecast have their local fields in this time zone.
 	WeatherData mCurrent; 		//<! Current weather data API response
 
-	std::vector<MinutelyForecast>mMinutely; //!< Minute forecast weather data API response
-	std::vector<WeatherData>mHourly;		//!< Hourly forecast weather data API response
-	std::vector<DailyWeatherData>mDaily;	//!< Daily forecast weather data API response
+	MinutelyForecasts mMinutely;			//!< Minute forecast weather data API response
+	MinutelyNowcast mNowcast;				//!< mMinutely set up for fast queries.
+	HourlyForecasts mHourly;				//!< Hourly forecast weather data API response
+	DailyForecasts mDaily;					//!< Daily forecast weather data API response
+	HourlyColumns mHourlyColumns;			//!< mHourly by column, for fast scans over a window of hours.
+	TimeIndex mHourlyIndex;					//!< Finds entries in mHourly by time.
+	TimeIndex mDailyIndex;					//!< Finds entries in mDaily by time.
 
 
 
@@ -204,22 +894,112 @@ struct OpenWeatherMap
 	OpenWeatherMap(const std::string& pAPIKey);
 	~OpenWeatherMap();
 
+	// Movable, so it can be handed over whole, EG ForecastChannel::Publish(T&&).
+	OpenWeatherMap(OpenWeatherMap&&) = default;
+	OpenWeatherMap& operator=(OpenWeatherMap&&) = default;
+#ifdef TINYWEATHER_FIXED_CAPACITY
+	// Owns a curl handle, a copy would clean it up twice.
+	OpenWeatherMap(const OpenWeatherMap&) = delete;
+	OpenWeatherMap& operator=(const OpenWeatherMap&) = delete;
+#else
+	OpenWeatherMap(const OpenWeatherMap&) = default;
+	OpenWeatherMap& operator=(const OpenWeatherMap&) = default;
+#endif
+
 	void Get(double pLatitude,double pLongitude,std::function<void(bool pDownloadedOk,const OpenWeatherMap& pWeather)> pReturnFunction);
 
+	/**
+	 * @brief As above but also tells you what changed since the last call.
+	 * Calling Get again refreshes the data in place, the entries and their strings are reused so there are no allocations once warmed up.
+	 */
+	void Get(double pLatitude,double pLongitude,std::function<void(bool pDownloadedOk,const OpenWeatherMap& pWeather,const ForecastChanges& pChanges)> pReturnFunction);
+
+	/**
+	 * @brief Builds the weather data from a one call api json response that you already have.
+	 * This is what Get does once it has downloaded the json. Replaces what was there before, see GetLastChanges for what changed.
+	 * @return true if the json contained weather data.
+	 */
+	bool ProcessWeatherReport(const std::string& pJson);
+
+#ifdef TINYWEATHER_FIXED_CAPACITY
+	/**
+	 * @brief As above, reading the json in place, nothing is allocated.
+	 */
+	bool ProcessWeatherReport(const char* pJson,size_t pLength);
+
+	/**
+	 * @brief Where Get downloads the response to, it must be set before calling Get. A one call response with
+	 * everything in it is about 30KB, a response that does not fit is dropped. Not owned, must out live this object.
+	 */
+	void SetResponseBuffer(char* pBuffer,size_t pSize){mResponse = pBuffer;mResponseSize = pSize;}
+#endif
+
+	/**
+	 * @brief What changed in the last call to ProcessWeatherReport.
+	 */
+	const ForecastChanges& GetLastChanges()const{return mChanges;}
+
+	/**
+	 * @brief Set how much values have to move by before they are reported as changed.
+	 * Measured from the value last reported, so small changes add up until they are reported.
+	 */
+	void SetChangeThresholds(const ChangeThresholds& pThresholds){mThresholds = pThresholds;}
+
+	/**
+	 * @brief Where Get sends the request, the lat, lon and appid are added to it. Defaults to the one call api.
+	 * Handy for pointing it at a local server with recorded responses for testing.
+	 */
+	void SetServerURL(const std::string& pURL){mServerURL = pURL;}
+
+	/**
+	 * @brief Turn on timing each stage of the refresh, see FetchMetrics. Off by default.
+	 */
+	void EnableMetrics(bool pEnable){mMetricsEnabled = pEnable;}
+	const FetchMetrics& GetMetrics()const{return mMetrics;}
+	void ResetMetrics(){mMetrics.Reset();}
+
+	/**
+	 * @brief What the forecast is using now, the object and the heap it owns. The shared ConditionTable is not included.
+	 * The peak, which includes the response and the parsed json, is kept in the metrics when they are enabled.
+	 */
+	MemoryUsage GetMemoryUsage()const;
+
+#ifndef TINYWEATHER_FIXED_CAPACITY
+	/**
+	 * @brief Optional, have Get use a response cache so it only goes to the network when it has to.
+	 * The cache is not owned, it must out live this object. Pass nullptr to stop using it.
+	 */
+	void SetResponseCache(ResponseCache* pCache){mCache = pCache;}
+#endif
+
 	/**
 	 * @brief Get the current temperature forcast from the hourly forcast data.
 	 * @param pNowUTC When the forcast is for.
 	 */
 	const WeatherData* GetHourlyForcast(std::time_t pNowUTC)const;
 
+	/**
+	 * @brief The daily forcast nearest to the time passed in, nullptr if there is no daily data.
+	 */
+	const DailyWeatherData* GetDailyForcast(std::time_t pNowUTC)const;
+
+	/**
+	 * @brief The hourly / daily entries with a time >= pFromUTC and < pToUTC.
+	 * for( const auto& hour : weather.GetHourlyRange(from,to) ){...}
+	 */
+	EntryRange<WeatherData> GetHourlyRange(std::time_t pFromUTC,std::time_t pToUTC)const;
+	EntryRange<DailyWeatherData> GetDailyRange(std::time_t pFromUTC,std::time_t pToUTC)const;
+
 	/**
 	 * @brief Get the hourly temperature forcast.
+	 * This is the value for the hour, for a smooth value between the hours use mHourlyColumns.Interpolate.
 	 * @param pNowUTC When the forcast is for.
 	 */
 	float GetHourlyTemperature(std::time_t pNowUTC)const;
 
 	/**
 	 * @brief For the day passed in UTC time you'll get a map of weather icon names for each hour.
+	 * The day is the day where the forecast is for, using mTimezoneOffset.
 	 * I send back the hour as that helps when you do the display, you can mark it as 6am for example.
 	 * @param pNowUTC 
 	 * @return const HourlyIconVector The map is <24h,name>. EG the icon for 7pm is 'icon name == map[19]'
@@ -235,14 +1015,67 @@ struct OpenWeatherMap
 	 */
 	HourlyIconVector GetHourlyIconCodes(std::time_t pNowUTC)const;
 
+	/**
+	 * @brief Same hours as GetTodaysHourlyIconCodes and GetHourlyIconCodes but without building a vector or copying the names.
+	 * Use these if you are calling them every frame.
+	 */
+	HourlyIconView GetTodaysHourlyIconView(std::time_t pNowUTC)const;
+	HourlyIconView GetHourlyIconView(std::time_t pNowUTC)const;
+
+	/**
+	 * @brief Fills your buffer with the icons, no allocations.
+	 * HourlyIcon icons[48];
+	 * const size_t count = weather.GetHourlyIconCodes(now,icons);
+	 * @return size_t The number written, at most the size of the buffer.
+	 */
+	template<size_t SIZE> size_t GetTodaysHourlyIconCodes(std::time_t pNowUTC,HourlyIcon (&rIcons)[SIZE])const{return GetTodaysHourlyIconView(pNowUTC).Copy(rIcons,SIZE);}
+	template<size_t SIZE> size_t GetHourlyIconCodes(std::time_t pNowUTC,HourlyIcon (&rIcons)[SIZE])const{return GetHourlyIconView(pNowUTC).Copy(rIcons,SIZE);}
+
 private:
 
-	const std::string mAPIKey;
+	std::string mAPIKey;
+	std::string mServerURL;
+	ResponseCache* mCache;
+	ChangeThresholds mThresholds;
+	ForecastChanges mChanges;
+	WeatherData mReportedCurrent;			//!< The values last reported as changed, what the thresholds are measured from.
+	HourlyForecasts mReportedHourly;		//!< Only used when thresholds are set, else the values last reported are the ones we have.
+	DailyForecasts mReportedDaily;
+	bool mMetricsEnabled = false;
+	FetchMetrics mMetrics;
+
+#ifdef TINYWEATHER_FIXED_CAPACITY
+	char* mResponse = nullptr;
+	size_t mResponseSize = 0;
+
+	/**
+	 * @brief Kept between calls, so the connection and its buffers are reused. Move only, a move hands the handle over.
+	 */
+	struct CurlHandle
+	{
+		void* mHandle = nullptr;
+
+		CurlHandle() = default;
+		CurlHandle(CurlHandle&& pOther):mHandle(pOther.mHandle){pOther.mHandle = nullptr;}
+		CurlHandle& operator=(CurlHandle&& pOther){std::swap(mHandle,pOther.mHandle);return *this;}// Ours is cleaned up by the one moved from.
+		~CurlHandle();
+	}mCurl;
+#endif
+
+	/**
+	 * @brief Downloads the response, if pMetrics is not null the network stages are added to it.
+	 */
+	static bool DownloadWeatherReport(const std::string& pURL,std::string& rJson,FetchMetrics* pMetrics = nullptr);
 
-	bool DownloadWeatherReport(const std::string& pURL,std::string& rJson)const;
+	/**
+	 * @brief Reads the parsed json into the forecast, for either json reader.
+	 */
+	template<typename JSON> bool ReadWeatherReport(const JSON& pWeather);
 
 };
 
+typedef std::shared_ptr<const OpenWeatherMap> ForecastPtr;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 }; //namespace tinyweather{
 
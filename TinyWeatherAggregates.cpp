@@ -0,0 +1,298 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <cmath>
+#include <algorithm>
+#include <assert.h>
+
+#include "TinyWeatherAggregates.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const std::time_t ONE_HOUR = 60 * 60;
+static const std::time_t ONE_DAY = ONE_HOUR * 24;
+
+/**
+ * @brief Local midnight, as UTC, of the day the time is in.
+ */
+static std::time_t GetLocalMidnight(std::time_t pTimeUTC,int32_t pTimezoneOffset)
+{
+	const std::time_t local = pTimeUTC + pTimezoneOffset;
+	const std::time_t day = local >= 0 ? local / ONE_DAY : ((local + 1) / ONE_DAY) - 1;
+	return (day * ONE_DAY) - pTimezoneOffset;
+}
+
+AggregateDefinition AggregateDefinition::Rolling(HourlyColumn pColumn,Aggregate pAggregate,int pHours,float pThreshold)
+{
+	AggregateDefinition definition;
+	definition.mColumn = pColumn;
+	definition.mAggregate = pAggregate;
+	definition.mHours = std::max(1,pHours);
+	definition.mThreshold = pThreshold;
+	return definition;
+}
+
+AggregateDefinition AggregateDefinition::DayPart(HourlyColumn pColumn,Aggregate pAggregate,int pFromHour,int pToHour,float pThreshold)
+{
+	AggregateDefinition definition;
+	definition.mColumn = pColumn;
+	definition.mAggregate = pAggregate;
+	definition.mHours = 0;
+	definition.mFromHour = std::max(0,std::min(24,pFromHour));
+	definition.mToHour = std::max(definition.mFromHour,std::min(24,pToHour));
+	definition.mThreshold = pThreshold;
+	return definition;
+}
+
+size_t HourlyAggregates::Add(const AggregateDefinition& pDefinition)
+{
+	mResults.push_back({pDefinition,{}});
+	return mResults.size() - 1;
+}
+
+void HourlyAggregates::Update(const OpenWeatherMap& pWeather)
+{
+	const HourlyColumns& columns = pWeather.mHourlyColumns;
+	mHours.Build(pWeather.mHourly);
+	mTimezoneOffset = pWeather.mTimezoneOffset;
+
+	mDays.clear();
+	if( columns.GetCount() > 0 )
+	{
+		const std::time_t last = columns.mTime.back();
+		for( std::time_t day = GetLocalMidnight(columns.mTime.front(),mTimezoneOffset) ; day <= last ; day += ONE_DAY )
+		{
+			mDays.push_back(day);
+		}
+	}
+
+	for( auto& result : mResults )
+	{
+		if( result.mDefinition.mHours > 0 )
+			UpdateRolling(columns,result);
+		else
+			UpdateDayPart(columns,result);
+	}
+
+	// What FillDaily needs, the whole of each day.
+	const Aggregate daily[] = {Aggregate::MIN,Aggregate::MAX,Aggregate::SUM,Aggregate::SUM};
+	const HourlyColumn dailyColumns[] = {HourlyColumn::TEMPERATURE,HourlyColumn::TEMPERATURE,HourlyColumn::RAIN,HourlyColumn::SNOW};
+	std::vector<float>* dailyValues[] = {&mDailyMin,&mDailyMax,&mDailyRain,&mDailySnow};
+	for( size_t n = 0 ; n < 4 ; n++ )
+	{
+		Result whole;
+		whole.mDefinition = AggregateDefinition::DayPart(dailyColumns[n],daily[n],0,24);
+		whole.mValues.swap(*dailyValues[n]);
+		UpdateDayPart(columns,whole);
+		whole.mValues.swap(*dailyValues[n]);
+	}
+}
+
+bool HourlyAggregates::Get(size_t pHandle,std::time_t pTimeUTC,float& rValue)const
+{
+	assert( pHandle < mResults.size() );
+	const Result& result = mResults[pHandle];
+	size_t index;
+	if( result.mDefinition.mHours > 0 )
+	{
+		// The hour the time is in, the last that starts at or before it.
+		index = mHours.FindBefore(pTimeUTC + 1);
+		if( index == mHours.GetCount() || pTimeUTC >= mHours.mTimes[index] + ONE_HOUR )
+			return false;
+	}
+	else
+	{
+		index = FindDay(pTimeUTC);
+		if( index == mDays.size() )
+			return false;
+	}
+
+	rValue = result.mValues[index];
+	return std::isnan(rValue) == false;
+}
+
+void HourlyAggregates::FillDaily(DailyForecasts& rDaily)const
+{
+	for( auto& day : rDaily )
+	{
+		const size_t index = FindDay(day.mTime.mUTC);
+		if( index == mDays.size() || std::isnan(mDailyMin[index]) )
+			continue;
+
+		if( day.mTemperature.Min.k == day.mTemperature.Max.k )
+		{
+			day.mTemperature.Min.Set(mDailyMin[index]);
+			day.mTemperature.Max.Set(mDailyMax[index]);
+		}
+
+		if( day.mRain == 0.0f )
+		{
+			day.mRain = mDailyRain[index];
+		}
+
+		if( day.mSnow == 0.0f )
+		{
+			day.mSnow = mDailySnow[index];
+		}
+	}
+}
+
+void HourlyAggregates::UpdateRolling(const HourlyColumns& pColumns,Result& rResult)
+{
+	const AggregateDefinition& definition = rResult.mDefinition;
+	const size_t count = pColumns.GetCount();
+	const size_t window = (size_t)definition.mHours;
+	const float threshold = definition.mThreshold;
+	const float* in = pColumns.GetColumn(definition.mColumn).data();
+
+	rResult.mValues.resize(count);
+	float* out = rResult.mValues.data();
+
+	// First hour of each window.
+	for( size_t n = 0 ; n < count ; n++ )
+	{
+		switch( definition.mAggregate )
+		{
+		case Aggregate::HOURS_ABOVE:
+			out[n] = in[n] > threshold ? 1.0f : 0.0f;
+			break;
+
+		case Aggregate::HOURS_BELOW:
+			out[n] = in[n] < threshold ? 1.0f : 0.0f;
+			break;
+
+		default:
+			out[n] = in[n];
+			break;
+		}
+	}
+
+	// Then each hour after, for all the windows at once. The inner loops are just the column against the results
+	// one hour along, no branches or dependence from one to the next, so they vectorise. The last windows get
+	// fewer hours as they run off the end of the forecast.
+	for( size_t offset = 1 ; offset < window && offset < count ; offset++ )
+	{
+		const float* next = in + offset;
+		const size_t windows = count - offset;
+		switch( definition.mAggregate )
+		{
+		case Aggregate::MIN:
+			for( size_t n = 0 ; n < windows ; n++ )
+				out[n] = next[n] < out[n] ? next[n] : out[n];
+			break;
+
+		case Aggregate::MAX:
+			for( size_t n = 0 ; n < windows ; n++ )
+				out[n] = next[n] > out[n] ? next[n] : out[n];
+			break;
+
+		case Aggregate::MEAN:
+		case Aggregate::SUM:
+			for( size_t n = 0 ; n < windows ; n++ )
+				out[n] += next[n];
+			break;
+
+		case Aggregate::HOURS_ABOVE:
+			for( size_t n = 0 ; n < windows ; n++ )
+				out[n] += next[n] > threshold ? 1.0f : 0.0f;
+			break;
+
+		case Aggregate::HOURS_BELOW:
+			for( size_t n = 0 ; n < windows ; n++ )
+				out[n] += next[n] < threshold ? 1.0f : 0.0f;
+			break;
+		}
+	}
+
+	if( definition.mAggregate == Aggregate::MEAN )
+	{
+		for( size_t n = 0 ; n < count ; n++ )
+		{
+			out[n] /= (float)std::min(window,count - n);
+		}
+	}
+}
+
+void HourlyAggregates::UpdateDayPart(const HourlyColumns& pColumns,Result& rResult)
+{
+	const AggregateDefinition& definition = rResult.mDefinition;
+	const float* in = pColumns.GetColumn(definition.mColumn).data();
+
+	rResult.mValues.resize(mDays.size());
+	for( size_t day = 0 ; day < mDays.size() ; day++ )
+	{
+		// Hours are in order so the day part is a run of them.
+		const size_t first = mHours.LowerBound(mDays[day] + (definition.mFromHour * ONE_HOUR));
+		const size_t last = mHours.LowerBound(mDays[day] + (definition.mToHour * ONE_HOUR));
+		if( first < last )
+			rResult.mValues[day] = Reduce(in + first,last - first,definition.mAggregate,definition.mThreshold);
+		else
+			rResult.mValues[day] = NAN;
+	}
+}
+
+float HourlyAggregates::Reduce(const float* pValues,size_t pCount,Aggregate pAggregate,float pThreshold)const
+{
+	assert( pCount > 0 );
+	float result = pAggregate == Aggregate::MIN || pAggregate == Aggregate::MAX ? pValues[0] : 0.0f;
+	for( size_t n = 0 ; n < pCount ; n++ )
+	{
+		const float value = pValues[n];
+		switch( pAggregate )
+		{
+		case Aggregate::MIN:
+			result = value < result ? value : result;
+			break;
+
+		case Aggregate::MAX:
+			result = value > result ? value : result;
+			break;
+
+		case Aggregate::MEAN:
+		case Aggregate::SUM:
+			result += value;
+			break;
+
+		case Aggregate::HOURS_ABOVE:
+			result += value > pThreshold ? 1.0f : 0.0f;
+			break;
+
+		case Aggregate::HOURS_BELOW:
+			result += value < pThreshold ? 1.0f : 0.0f;
+			break;
+		}
+	}
+	return pAggregate == Aggregate::MEAN ? result / pCount : result;
+}
+
+size_t HourlyAggregates::FindDay(std::time_t pTimeUTC)const
+{
+	if( mDays.size() == 0 )
+		return 0;
+
+	const std::time_t midnight = GetLocalMidnight(pTimeUTC,mTimezoneOffset);
+	if( midnight < mDays.front() || midnight > mDays.back() )
+		return mDays.size();
+
+	return (size_t)((midnight - mDays.front()) / ONE_DAY);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
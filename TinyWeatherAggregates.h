@@ -0,0 +1,142 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_AGGREGATES_H
+#define TINY_WEATHER_AGGREGATES_H
+
+#include <vector>
+#include <ctime>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief What is worked out over the hours of a window.
+ */
+enum struct Aggregate
+{
+	MIN,
+	MAX,
+	MEAN,
+	SUM,			//!< For rain and snow this is the mm that falls in the window.
+	HOURS_ABOVE,	//!< Number of hours with a value > mThreshold.
+	HOURS_BELOW		//!< Number of hours with a value < mThreshold.
+};
+
+/**
+ * @brief One aggregate you want worked out each refresh, make them with Rolling or DayPart.
+ */
+struct AggregateDefinition
+{
+	HourlyColumn mColumn = HourlyColumn::TEMPERATURE;
+	Aggregate mAggregate = Aggregate::MAX;
+	int mHours = 0;				//!< Rolling, how many hours from each hour. Zero for a day part.
+	int mFromHour = 0;			//!< Day part, the local hour it starts at.
+	int mToHour = 24;			//!< Day part, the local hour it ends before.
+	float mThreshold = 0.0f;	//!< For HOURS_ABOVE and HOURS_BELOW.
+
+	/**
+	 * @brief Worked out for the pHours starting at each hour of the forecast, so 'max gust in the next 12 hours' is
+	 * Rolling(HourlyColumn::WIND_GUSTS,Aggregate::MAX,12). Near the end of the forecast the window has fewer hours.
+	 */
+	static AggregateDefinition Rolling(HourlyColumn pColumn,Aggregate pAggregate,int pHours,float pThreshold = 0.0f);
+
+	/**
+	 * @brief Worked out for the same hours of each local day, so 'afternoon max' is
+	 * DayPart(HourlyColumn::TEMPERATURE,Aggregate::MAX,12,18).
+	 */
+	static AggregateDefinition DayPart(HourlyColumn pColumn,Aggregate pAggregate,int pFromHour,int pToHour,float pThreshold = 0.0f);
+};
+
+/**
+ * @brief Works out a set of aggregates over the hourly forecast once per refresh and answers from the results.
+ * Add what your widgets want once at start up, call Update each time the weather is processed, then Get is a lookup.
+ * Rolling aggregates are worked out for every start hour together, a pass over the column for each hour in the window
+ * that the compiler turns into vector instructions, so a dozen of them over 48 hours is a few microseconds.
+ * Day parts are worked out for each local day of the forecast, in the forecast's time zone.
+ * Update reuses the memory from last time.
+ */
+class HourlyAggregates
+{
+public:
+	/**
+	 * @brief Adds an aggregate, do this before calling Update.
+	 * @return size_t The handle to pass to Get.
+	 */
+	size_t Add(const AggregateDefinition& pDefinition);
+
+	/**
+	 * @brief Works out all the aggregates from the forecast, throwing away the results from last time.
+	 */
+	void Update(const OpenWeatherMap& pWeather);
+
+	/**
+	 * @brief The value of the aggregate for the rolling window starting in the hour pTimeUTC is in, or for a day part, the local day it is in.
+	 * @return false if the time is outside of the forecast, or there are no hours of that day part in the forecast for that day.
+	 */
+	bool Get(size_t pHandle,std::time_t pTimeUTC,float& rValue)const;
+
+	/**
+	 * @brief All the results for an aggregate, one for each hour of the forecast for rolling, one for each day for day parts.
+	 * Days with none of the hours of the day part are NAN.
+	 */
+	const std::vector<float>& GetValues(size_t pHandle)const{return mResults[pHandle].mValues;}
+
+	size_t GetDayCount()const{return mDays.size();}
+	std::time_t GetDayStart(size_t pDay)const{return mDays[pDay];}	//!< UTC time of the local midnight the day starts at.
+
+	/**
+	 * @brief Fills in the parts of the daily forecast the response did not have with ones worked out from the hourly forecast.
+	 * Only days the hourly forecast reaches are touched. Today, for example, only has the hours from now.
+	 *   mTemperature.Min and Max when the response only gave one temperature for the day, so they are equal.
+	 *   mRain and mSnow when the response did not have them, from the sum of the hours.
+	 * Call after Update.
+	 */
+	void FillDaily(DailyForecasts& rDaily)const;
+
+private:
+	struct Result
+	{
+		AggregateDefinition mDefinition;
+		std::vector<float> mValues;
+	};
+
+	std::vector<Result> mResults;
+	TimeIndex mHours;						//!< Times of the hours the results were worked out from.
+	int32_t mTimezoneOffset = 0;
+	std::vector<std::time_t> mDays;			//!< UTC time of each local midnight the hourly forecast reaches.
+	std::vector<float> mDailyMin;			//!< Temperature, for FillDaily.
+	std::vector<float> mDailyMax;
+	std::vector<float> mDailyRain;
+	std::vector<float> mDailySnow;
+
+	void UpdateRolling(const HourlyColumns& pColumns,Result& rResult);
+	void UpdateDayPart(const HourlyColumns& pColumns,Result& rResult);
+	float Reduce(const float* pValues,size_t pCount,Aggregate pAggregate,float pThreshold)const;
+	size_t FindDay(std::time_t pTimeUTC)const;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_AGGREGATES_H
@@ -0,0 +1,342 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_CACHE_H
+#define TINY_WEATHER_CACHE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <ctime>
+#include <cmath>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+enum struct CacheState
+{
+	MISS,	//!< Nothing usable, go to the network.
+	FRESH,	//!< Younger than the time to live, use it.
+	STALE	//!< Past the time to live but still usable, use it and refresh in the background.
+};
+
+/**
+ * @brief Caches one call api responses keyed on the location, rounded to a grid, and the request options.
+ * Each response is also written to a directory so a restart can serve the last forecast straight away.
+ * Responses past their time to live, but within the stale allowance, are handed back at once whilst a
+ * background thread fetches a new one. This also means an upstream outage is ridden out for as long as the
+ * stale allowance.
+ * Thread safe, one cache can be shared by many OpenWeatherMap objects.
+ */
+class ResponseCache
+{
+public:
+	/**
+	 * @param pDirectory Where the responses are persisted, must exist. Pass an empty string to only cache in memory.
+	 * @param pTimeToLive Seconds a response is fresh for.
+	 * @param pStaleAllowance Seconds after the time to live that a response can still be used.
+	 * @param pGridSize Degrees to round the location to, 0.01 is about a kilometre.
+	 */
+	ResponseCache(const std::string& pDirectory,std::time_t pTimeToLive,std::time_t pStaleAllowance,double pGridSize = 0.01);
+	~ResponseCache();
+
+	ResponseCache(const ResponseCache&) = delete;
+	ResponseCache& operator=(const ResponseCache&) = delete;
+
+	/**
+	 * @brief Builds the key used for the location and request options. Also used as the file name.
+	 */
+	std::string MakeKey(double pLatitude,double pLongitude,const std::string& pOptions)const;
+
+	/**
+	 * @brief Looks for the response, first in memory then on disk.
+	 * @param rJson Set to the cached response if the state is not MISS.
+	 */
+	CacheState Find(const std::string& pKey,std::time_t pNow,std::string& rJson);
+
+	/**
+	 * @brief Adds, or replaces, a response. Writes it to disk too.
+	 */
+	void Store(const std::string& pKey,const std::string& pJson,std::time_t pFetched);
+
+	/**
+	 * @brief Queues a background fetch of the key. If one is already queued for the key this does nothing.
+	 * @param pFetch Called on the background thread, return true if it filled in the json. Must not reference objects that can go away.
+	 */
+	void Revalidate(const std::string& pKey,std::function<bool(std::string& rJson)> pFetch);
+
+private:
+	struct Entry
+	{
+		std::time_t mFetched;
+		std::string mJson;
+	};
+
+	struct Job
+	{
+		std::string mKey;
+		std::function<bool(std::string& rJson)> mFetch;
+	};
+
+	const std::string mDirectory;
+	const std::time_t mTimeToLive;
+	const std::time_t mStaleAllowance;
+	const double mGridSize;
+
+	std::mutex mLock;
+	std::map<std::string,Entry> mEntries;
+
+	// The background refresh, started on first use.
+	std::thread mWorker;
+	std::condition_variable mWorkReady;
+	std::deque<Job> mJobs;
+	std::set<std::string> mPending;	//!< Keys queued or being fetched, stops the same one being fetched twice.
+	bool mQuit;
+
+	static const char* GetFileMagic(){return "TinyWeatherCache1";}
+
+	/**
+	 * @brief FNV-1a, used so the key for the options is the same from one run to the next, std::hash does not promise that.
+	 */
+	static uint32_t HashString(const std::string& pString);
+
+	std::string GetFileName(const std::string& pKey)const;
+	bool ReadFile(const std::string& pKey,Entry& rEntry)const;
+	void WriteFile(const std::string& pKey,const Entry& pEntry)const;
+	void Worker();
+};
+
+inline uint32_t ResponseCache::HashString(const std::string& pString)
+{
+	uint32_t hash = 2166136261u;
+	for( const char c : pString )
+	{
+		hash ^= (uint8_t)c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+inline ResponseCache::ResponseCache(const std::string& pDirectory,std::time_t pTimeToLive,std::time_t pStaleAllowance,double pGridSize):
+	mDirectory(pDirectory),
+	mTimeToLive(pTimeToLive),
+	mStaleAllowance(pStaleAllowance),
+	mGridSize(pGridSize),
+	mQuit(false)
+{
+	assert( pGridSize > 0.0 );
+}
+
+inline ResponseCache::~ResponseCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mQuit = true;
+	}
+	mWorkReady.notify_all();
+
+	if( mWorker.joinable() )
+	{
+		mWorker.join();
+	}
+}
+
+inline std::string ResponseCache::MakeKey(double pLatitude,double pLongitude,const std::string& pOptions)const
+{
+	// Rounded to the grid so that positions a few meters apart share the same response.
+	const long lat = std::lround(pLatitude / mGridSize);
+	const long lon = std::lround(pLongitude / mGridSize);
+
+	char key[64];
+	snprintf(key,sizeof(key),"%ld_%ld_%08x",lat,lon,HashString(pOptions));
+	return key;
+}
+
+inline CacheState ResponseCache::Find(const std::string& pKey,std::time_t pNow,std::string& rJson)
+{
+	std::unique_lock<std::mutex> lock(mLock);
+
+	auto found = mEntries.find(pKey);
+	if( found == mEntries.end() )
+	{
+		// Not seen it since we started, see if a previous run saved it.
+		// Read outside of the lock as it may take a while.
+		lock.unlock();
+		Entry loaded;
+		if( ReadFile(pKey,loaded) == false )
+			return CacheState::MISS;
+
+		lock.lock();
+		found = mEntries.emplace(pKey,std::move(loaded)).first;
+	}
+
+	const Entry& entry = found->second;
+	const std::time_t age = pNow - entry.mFetched;
+	if( age > mTimeToLive + mStaleAllowance )
+		return CacheState::MISS;
+
+	rJson = entry.mJson;
+	return age <= mTimeToLive ? CacheState::FRESH : CacheState::STALE;
+}
+
+inline void ResponseCache::Store(const std::string& pKey,const std::string& pJson,std::time_t pFetched)
+{
+	Entry entry;
+	entry.mFetched = pFetched;
+	entry.mJson = pJson;
+	WriteFile(pKey,entry);
+
+	std::lock_guard<std::mutex> lock(mLock);
+	mEntries[pKey] = std::move(entry);
+}
+
+inline void ResponseCache::Revalidate(const std::string& pKey,std::function<bool(std::string& rJson)> pFetch)
+{
+	assert( pFetch != nullptr );
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		if( mQuit || mPending.insert(pKey).second == false )
+			return;// Already on its way.
+
+		mJobs.push_back({pKey,pFetch});
+
+		if( mWorker.joinable() == false )
+		{
+			mWorker = std::thread([this](){Worker();});
+		}
+	}
+	mWorkReady.notify_one();
+}
+
+inline std::string ResponseCache::GetFileName(const std::string& pKey)const
+{
+	return mDirectory + "/" + pKey + ".json";
+}
+
+inline bool ResponseCache::ReadFile(const std::string& pKey,Entry& rEntry)const
+{
+	if( mDirectory.size() == 0 )
+		return false;
+
+	std::ifstream file(GetFileName(pKey),std::ios::binary);
+	if( !file )
+		return false;
+
+	// First line is the magic and when it was fetched, the rest is the response as it came.
+	std::string magic;
+	file >> magic >> rEntry.mFetched;
+	if( !file || magic != GetFileMagic() || file.get() != '\n' )
+	{
+		std::cerr << "Ignoring invalid weather cache file " << GetFileName(pKey) << "\n";
+		return false;
+	}
+
+	std::stringstream json;
+	json << file.rdbuf();
+	rEntry.mJson = json.str();
+	return rEntry.mJson.size() > 0;
+}
+
+inline void ResponseCache::WriteFile(const std::string& pKey,const Entry& pEntry)const
+{
+	if( mDirectory.size() == 0 )
+		return;
+
+	// Write to a temp file then rename, so a crash part way through does not leave half a response behind.
+	// The temp name is unique, mkstemp makes it, so two writers of the same key, threads or processes, never share one.
+	const std::string fileName = GetFileName(pKey);
+	std::string tempName = fileName + ".XXXXXX";
+	const int fd = mkstemp(&tempName[0]);
+	if( fd < 0 )
+	{
+		std::cerr << "Failed to create weather cache temp file " << tempName << "\n";
+		return;
+	}
+	fchmod(fd,0644);// mkstemp makes it private to us, cache files are read by anyone.
+
+	FILE* file = fdopen(fd,"wb");
+	if( file == nullptr )
+	{
+		close(fd);
+		unlink(tempName.c_str());
+		std::cerr << "Failed to open weather cache temp file " << tempName << "\n";
+		return;
+	}
+
+	const std::string header = std::string(GetFileMagic()) + " " + std::to_string(pEntry.mFetched) + "\n";
+	const bool writtenOk = fwrite(header.data(),1,header.size(),file) == header.size() &&
+							fwrite(pEntry.mJson.data(),1,pEntry.mJson.size(),file) == pEntry.mJson.size();
+	if( fclose(file) != 0 || writtenOk == false )
+	{
+		unlink(tempName.c_str());
+		std::cerr << "Failed to write weather cache file " << tempName << "\n";
+		return;
+	}
+
+	if( rename(tempName.c_str(),fileName.c_str()) != 0 )
+	{
+		unlink(tempName.c_str());
+		std::cerr << "Failed to rename weather cache file " << tempName << " to " << fileName << "\n";
+	}
+}
+
+inline void ResponseCache::Worker()
+{
+	std::unique_lock<std::mutex> lock(mLock);
+	for(;;)
+	{
+		mWorkReady.wait(lock,[this](){return mQuit || mJobs.size() > 0;});
+		if( mQuit )
+			return;
+
+		Job job = std::move(mJobs.front());
+		mJobs.pop_front();
+
+		lock.unlock();
+		std::string json;
+		const bool fetched = job.mFetch(json);
+		if( fetched )
+		{
+			Store(job.mKey,json,std::time(nullptr));
+		}
+		lock.lock();
+
+		mPending.erase(job.mKey);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_CACHE_H
@@ -0,0 +1,124 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_CHANNEL_H
+#define TINY_WEATHER_CHANNEL_H
+
+#include <atomic>
+#include <utility>
+#include <stdint.h>
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief A wait free single producer, single consumer channel for handing completed forecasts from the thread
+ * that does the downloading to the thread that does the drawing.
+ * It is a triple buffer, three objects are made up front and then just passed around, so once running there are
+ * no copies, no locks and no memory allocations. The producer fills in the write buffer and publishes it.
+ * The consumer polls once a frame and if there is something new swaps it in. Any snapshot that is replaced before
+ * the consumer saw it, or the one the consumer has finished with, goes back to the producer to be written over.
+ *
+ * Typical use with OpenWeatherMap, in the background thread.
+ *   tinyweather::ForecastChannel<tinyweather::OpenWeatherMap> channel("__PUT_YOUR_APP_ID_HERE__");
+ *   channel.GetWriteBuffer().Get(lat,lon,[&channel](bool pDownloadedOk,const tinyweather::OpenWeatherMap&)
+ *   {
+ *       if( pDownloadedOk )
+ *           channel.Publish();
+ *   });
+ *
+ * Then in the render loop.
+ *   channel.Poll();
+ *   const tinyweather::OpenWeatherMap& weather = channel.GetReadBuffer();
+ */
+template<typename T> class ForecastChannel
+{
+public:
+	/**
+	 * @brief Construct the three buffers, the arguments are passed to each of their constructors.
+	 */
+	template<typename... ARGS> ForecastChannel(ARGS&&... pArgs):
+		mBuffers{T(pArgs...),T(pArgs...),T(pArgs...)},
+		mBack(0),
+		mMiddle(1),
+		mFront(2)
+	{
+	}
+
+	ForecastChannel(const ForecastChannel&) = delete;
+	ForecastChannel& operator=(const ForecastChannel&) = delete;
+
+	/**
+	 * @brief Producer side. The buffer that is yours to write into, it will contain an old snapshot so overwrite it.
+	 */
+	T& GetWriteBuffer(){return mBuffers[mBack];}
+
+	/**
+	 * @brief Producer side. Moves the passed object into the write buffer and publishes it.
+	 */
+	void Publish(T&& pSnapshot)
+	{
+		mBuffers[mBack] = std::move(pSnapshot);
+		Publish();
+	}
+
+	/**
+	 * @brief Producer side. Hands the write buffer over to the consumer.
+	 * If the consumer has not picked up the last one it is superseded and becomes the new write buffer.
+	 */
+	void Publish()
+	{
+		const uint8_t old = mMiddle.exchange(mBack | FRESH_BIT,std::memory_order_acq_rel);
+		mBack = old & INDEX_MASK;
+	}
+
+	/**
+	 * @brief Consumer side. Call once a frame, cheap when there is nothing new, a single atomic load.
+	 * @return true if the read buffer now holds a newer snapshot.
+	 */
+	bool Poll()
+	{
+		if( (mMiddle.load(std::memory_order_relaxed) & FRESH_BIT) == 0 )
+			return false;
+
+		const uint8_t old = mMiddle.exchange(mFront,std::memory_order_acq_rel);
+		mFront = old & INDEX_MASK;
+		return true;
+	}
+
+	/**
+	 * @brief Consumer side. The last snapshot that was picked up by Poll. Valid until the next call to Poll.
+	 */
+	const T& GetReadBuffer()const{return mBuffers[mFront];}
+
+private:
+	static const uint8_t INDEX_MASK = 0x03;
+	static const uint8_t FRESH_BIT = 0x04;	//!< Set when the middle buffer has been published but not yet picked up.
+
+	T mBuffers[3];
+	alignas(64) uint8_t mBack;					//!< Only touched by the producer.
+	alignas(64) std::atomic<uint8_t> mMiddle;	//!< The buffer in transit, index and fresh bit.
+	alignas(64) uint8_t mFront;					//!< Only touched by the consumer.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_CHANNEL_H
@@ -0,0 +1,172 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "TinyWeatherCompact.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Scales, rounds to nearest and clamps to what the type can hold.
+ */
+template<typename T> static T Quantize(double pValue,double pScale)
+{
+	const double scaled = std::round(pValue * pScale);
+	const double low = (double)std::numeric_limits<T>::min();
+	const double high = (double)std::numeric_limits<T>::max();
+	return (T)std::min(high,std::max(low,scaled));
+}
+
+void CompactTemperature::Set(float pKelvin)
+{
+	mCentiCelsius = Quantize<int16_t>(pKelvin - 273.15,100.0);
+}
+
+void CompactWeatherData::Set(const WeatherData& pWeather)
+{
+	mTime = (uint32_t)pWeather.mTime.mUTC;
+	mSunrise = (uint32_t)pWeather.mSunrise.mUTC;
+	mSunset = (uint32_t)pWeather.mSunset.mUTC;
+	mTemperature.Set(pWeather.mTemperature.k);
+	mFeelsLike.Set(pWeather.mFeelsLike.k);
+	mDewPoint.Set(pWeather.mDewPoint);
+	mPressure = Quantize<uint16_t>(pWeather.mPressure,1.0);
+	mVisibility = Quantize<uint16_t>(pWeather.mVisibility,1.0);
+	mWindSpeed = Quantize<uint16_t>(pWeather.mWindSpeed,100.0);
+	mWindGusts = Quantize<uint16_t>(pWeather.mWindGusts,100.0);
+	mWindDirection = Quantize<uint16_t>(pWeather.mWindDirection,1.0);
+	mRain = Quantize<uint16_t>(pWeather.mRain,100.0);
+	mSnow = Quantize<uint16_t>(pWeather.mSnow,100.0);
+	mID = Quantize<uint16_t>(pWeather.mDisplay.mID,1.0);
+	mCondition = pWeather.mDisplay.mCondition;
+	mIcon = pWeather.mDisplay.mIcon;
+	mHumidity = Quantize<uint8_t>(pWeather.mHumidity,1.0);
+	mClouds = Quantize<uint8_t>(pWeather.mClouds,1.0);
+	mUVIndex = Quantize<uint8_t>(pWeather.mUVIndex,1.0);
+	mPrecipitationProbability = Quantize<uint8_t>(pWeather.mPrecipitationProbability,100.0);
+}
+
+void CompactWeatherData::Get(int32_t pTimezoneOffset,WeatherData& rWeather)const
+{
+	rWeather.mTime.Set(mTime,pTimezoneOffset);
+	rWeather.mSunrise.Set(mSunrise,pTimezoneOffset);
+	rWeather.mSunset.Set(mSunset,pTimezoneOffset);
+	rWeather.mTemperature = mTemperature.Get();
+	rWeather.mFeelsLike = mFeelsLike.Get();
+	rWeather.mDewPoint = mDewPoint.k();
+	rWeather.mPressure = mPressure;
+	rWeather.mHumidity = mHumidity;
+	rWeather.mClouds = mClouds;
+	rWeather.mUVIndex = mUVIndex;
+	rWeather.mVisibility = mVisibility;
+	rWeather.mWindSpeed = GetWindSpeed();
+	rWeather.mWindGusts = GetWindGusts();
+	rWeather.mWindDirection = mWindDirection;
+	rWeather.mPrecipitationProbability = GetPrecipitationProbability();
+	rWeather.mRain = GetRain();
+	rWeather.mSnow = GetSnow();
+	rWeather.mDisplay = GetDisplay();
+}
+
+void CompactDailyWeatherData::Set(const DailyWeatherData& pDaily)
+{
+	mTime = (uint32_t)pDaily.mTime.mUTC;
+	mSunrise = (uint32_t)pDaily.mSunrise.mUTC;
+	mSunset = (uint32_t)pDaily.mSunset.mUTC;
+	mTemperature.Morning.Set(pDaily.mTemperature.Morning.k);
+	mTemperature.Day.Set(pDaily.mTemperature.Day.k);
+	mTemperature.Evening.Set(pDaily.mTemperature.Evening.k);
+	mTemperature.Night.Set(pDaily.mTemperature.Night.k);
+	mTemperature.Min.Set(pDaily.mTemperature.Min.k);
+	mTemperature.Max.Set(pDaily.mTemperature.Max.k);
+	mFeelsLike.Morning.Set(pDaily.mFeelsLike.Morning.k);
+	mFeelsLike.Day.Set(pDaily.mFeelsLike.Day.k);
+	mFeelsLike.Evening.Set(pDaily.mFeelsLike.Evening.k);
+	mFeelsLike.Night.Set(pDaily.mFeelsLike.Night.k);
+	mDewPoint.Set(pDaily.mDewPoint);
+	mPressure = Quantize<uint16_t>(pDaily.mPressure,1.0);
+	mWindSpeed = Quantize<uint16_t>(pDaily.mWindSpeed,100.0);
+	mWindGusts = Quantize<uint16_t>(pDaily.mWindGusts,100.0);
+	mWindDirection = Quantize<uint16_t>(pDaily.mWindDirection,1.0);
+	mRain = Quantize<uint16_t>(pDaily.mRain,100.0);
+	mSnow = Quantize<uint16_t>(pDaily.mSnow,100.0);
+	mID = Quantize<uint16_t>(pDaily.mDisplay.mID,1.0);
+	mCondition = pDaily.mDisplay.mCondition;
+	mIcon = pDaily.mDisplay.mIcon;
+	mHumidity = Quantize<uint8_t>(pDaily.mHumidity,1.0);
+	mClouds = Quantize<uint8_t>(pDaily.mClouds,1.0);
+	mUVIndex = Quantize<uint8_t>(pDaily.mUVIndex,1.0);
+	mPrecipitationProbability = Quantize<uint8_t>(pDaily.mPrecipitationProbability,100.0);
+}
+
+void CompactDailyWeatherData::Get(int32_t pTimezoneOffset,DailyWeatherData& rDaily)const
+{
+	rDaily.mTime.Set(mTime,pTimezoneOffset);
+	rDaily.mSunrise.Set(mSunrise,pTimezoneOffset);
+	rDaily.mSunset.Set(mSunset,pTimezoneOffset);
+	rDaily.mTemperature.Morning = mTemperature.Morning.Get();
+	rDaily.mTemperature.Day = mTemperature.Day.Get();
+	rDaily.mTemperature.Evening = mTemperature.Evening.Get();
+	rDaily.mTemperature.Night = mTemperature.Night.Get();
+	rDaily.mTemperature.Min = mTemperature.Min.Get();
+	rDaily.mTemperature.Max = mTemperature.Max.Get();
+	rDaily.mFeelsLike.Morning = mFeelsLike.Morning.Get();
+	rDaily.mFeelsLike.Day = mFeelsLike.Day.Get();
+	rDaily.mFeelsLike.Evening = mFeelsLike.Evening.Get();
+	rDaily.mFeelsLike.Night = mFeelsLike.Night.Get();
+	rDaily.mDewPoint = mDewPoint.k();
+	rDaily.mPressure = mPressure;
+	rDaily.mHumidity = mHumidity;
+	rDaily.mClouds = mClouds;
+	rDaily.mUVIndex = mUVIndex;
+	rDaily.mWindSpeed = GetWindSpeed();
+	rDaily.mWindGusts = GetWindGusts();
+	rDaily.mWindDirection = mWindDirection;
+	rDaily.mPrecipitationProbability = GetPrecipitationProbability();
+	rDaily.mRain = GetRain();
+	rDaily.mSnow = GetSnow();
+	rDaily.mDisplay = GetDisplay();
+}
+
+void CompactForecast::Set(const OpenWeatherMap& pWeather)
+{
+	mLatitude = pWeather.mLatitude;
+	mLongitude = pWeather.mLongitude;
+	mTimezoneOffset = pWeather.mTimezoneOffset;
+	mCurrent.Set(pWeather.mCurrent);
+
+	mHourly.resize(pWeather.mHourly.size());
+	for( size_t n = 0 ; n < mHourly.size() ; n++ )
+	{
+		mHourly[n].Set(pWeather.mHourly[n]);
+	}
+
+	mDaily.resize(pWeather.mDaily.size());
+	for( size_t n = 0 ; n < mDaily.size() ; n++ )
+	{
+		mDaily[n].Set(pWeather.mDaily[n]);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
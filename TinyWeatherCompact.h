@@ -0,0 +1,166 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_COMPACT_H
+#define TINY_WEATHER_COMPACT_H
+
+#include <vector>
+#include <ctime>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief A temperature in hundredths of a degree celsius, -327.68C to 327.67C, converted to the other units when read.
+ */
+struct CompactTemperature
+{
+	int16_t mCentiCelsius;
+
+	void Set(float pKelvin);
+
+	float k()const{return c() + 273.15f;}
+	float c()const{return mCentiCelsius * 0.01f;}
+	float f()const{return k() * 9.0f/5.0f - 459.670f;}
+
+	Temperature Get()const{Temperature t;t.Set(k());return t;}
+};
+
+/**
+ * @brief The same as WeatherData packed into a quarter of the memory.
+ * Times are just the UTC seconds, the date and time fields are worked out when you ask for them. Everything else is
+ * stored in 8 or 16 bits to a resolution finer than the forecast is given in.
+ *   Temperatures 0.01C, pressure 1hPa, wind and rain 0.01, wind direction 1 degree, percentages 1%.
+ * Values outside of what the field can hold are clamped.
+ */
+struct CompactWeatherData
+{
+	uint32_t mTime;					//!< UTC, good until 2106.
+	uint32_t mSunrise;
+	uint32_t mSunset;
+	CompactTemperature mTemperature;
+	CompactTemperature mFeelsLike;
+	CompactTemperature mDewPoint;
+	uint16_t mPressure;				//!< hPa
+	uint16_t mVisibility;			//!< Metres
+	uint16_t mWindSpeed;			//!< Hundredths
+	uint16_t mWindGusts;			//!< Hundredths
+	uint16_t mWindDirection;		//!< Degrees
+	uint16_t mRain;					//!< Hundredths of a mm
+	uint16_t mSnow;					//!< Hundredths of a mm
+	uint16_t mID;					//!< Weather condition id
+	uint16_t mCondition;			//!< ConditionTable handle.
+	uint16_t mIcon;					//!< ConditionTable handle.
+	uint8_t mHumidity;				//!< %
+	uint8_t mClouds;				//!< %
+	uint8_t mUVIndex;
+	uint8_t mPrecipitationProbability;	//!< %
+
+	void Set(const WeatherData& pWeather);
+
+	/**
+	 * @brief Unpacks into the full struct.
+	 * @param pTimezoneOffset For the local date and time fields, use the forecast's mTimezoneOffset.
+	 */
+	void Get(int32_t pTimezoneOffset,WeatherData& rWeather)const;
+
+	WeatherTime GetTime(int32_t pTimezoneOffset)const{return WeatherTime(mTime,pTimezoneOffset);}
+	WeatherTime GetSunrise(int32_t pTimezoneOffset)const{return WeatherTime(mSunrise,pTimezoneOffset);}
+	WeatherTime GetSunset(int32_t pTimezoneOffset)const{return WeatherTime(mSunset,pTimezoneOffset);}
+	float GetWindSpeed()const{return mWindSpeed * 0.01f;}
+	float GetWindGusts()const{return mWindGusts * 0.01f;}
+	float GetRain()const{return mRain * 0.01f;}
+	float GetSnow()const{return mSnow * 0.01f;}
+	float GetPrecipitationProbability()const{return mPrecipitationProbability * 0.01f;}
+	DisplayData GetDisplay()const{return {mID,mCondition,mIcon};}
+};
+
+/**
+ * @brief The same as DailyWeatherData packed into a fifth of the memory, see CompactWeatherData.
+ */
+struct CompactDailyWeatherData
+{
+	uint32_t mTime;
+	uint32_t mSunrise;
+	uint32_t mSunset;
+	struct
+	{
+		CompactTemperature Morning,Day,Evening,Night,Min,Max;
+	}mTemperature;
+	struct
+	{
+		CompactTemperature Morning,Day,Evening,Night;
+	}mFeelsLike;
+	CompactTemperature mDewPoint;
+	uint16_t mPressure;
+	uint16_t mWindSpeed;
+	uint16_t mWindGusts;
+	uint16_t mWindDirection;
+	uint16_t mRain;
+	uint16_t mSnow;
+	uint16_t mID;
+	uint16_t mCondition;
+	uint16_t mIcon;
+	uint8_t mHumidity;
+	uint8_t mClouds;
+	uint8_t mUVIndex;
+	uint8_t mPrecipitationProbability;
+
+	void Set(const DailyWeatherData& pDaily);
+	void Get(int32_t pTimezoneOffset,DailyWeatherData& rDaily)const;
+
+	WeatherTime GetTime(int32_t pTimezoneOffset)const{return WeatherTime(mTime,pTimezoneOffset);}
+	WeatherTime GetSunrise(int32_t pTimezoneOffset)const{return WeatherTime(mSunrise,pTimezoneOffset);}
+	WeatherTime GetSunset(int32_t pTimezoneOffset)const{return WeatherTime(mSunset,pTimezoneOffset);}
+	float GetWindSpeed()const{return mWindSpeed * 0.01f;}
+	float GetWindGusts()const{return mWindGusts * 0.01f;}
+	float GetRain()const{return mRain * 0.01f;}
+	float GetSnow()const{return mSnow * 0.01f;}
+	float GetPrecipitationProbability()const{return mPrecipitationProbability * 0.01f;}
+	DisplayData GetDisplay()const{return {mID,mCondition,mIcon};}
+};
+
+static_assert(sizeof(CompactWeatherData) == 44,"CompactWeatherData has grown, check the packing");
+static_assert(sizeof(CompactDailyWeatherData) == 56,"CompactDailyWeatherData has grown, check the packing");
+
+/**
+ * @brief A whole forecast in compact records, for when you are holding the forecasts of lots of locations.
+ */
+struct CompactForecast
+{
+	double mLatitude = 0.0;
+	double mLongitude = 0.0;
+	int32_t mTimezoneOffset = 0;
+	CompactWeatherData mCurrent;
+	std::vector<CompactWeatherData> mHourly;
+	std::vector<CompactDailyWeatherData> mDaily;
+
+	void Set(const OpenWeatherMap& pWeather);
+
+	size_t GetMemoryUsage()const{return sizeof(*this) + mHourly.capacity() * sizeof(CompactWeatherData) + mDaily.capacity() * sizeof(CompactDailyWeatherData);}
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_COMPACT_H
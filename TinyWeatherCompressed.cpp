@@ -0,0 +1,520 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <algorithm>
+#include <assert.h>
+
+#include "TinyWeatherCompressed.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const uint8_t NO_WINDOW = 0xff;	//!< Leading zero count when there is no previous window to reuse.
+
+static inline uint64_t Mask(uint32_t pCount)
+{
+	return pCount >= 64 ? ~0ull : (1ull << pCount) - 1;
+}
+
+static inline int64_t SignExtend(uint64_t pValue,uint32_t pCount)
+{
+	const uint64_t sign = 1ull << (pCount - 1);
+	return (int64_t)((pValue ^ sign) - sign);
+}
+
+void CompressedTimeSeries::Build(const std::time_t* pTimes,const uint32_t* pValues,size_t pCount,size_t pColumnCount)
+{
+	mBits.clear();
+	mTimeCheckpoints.clear();
+	mColumns.assign(pColumnCount,std::vector<Checkpoint>());
+	mCount = pCount;
+	mFirstTime = pCount > 0 ? pTimes[0] : 0;
+	mStep = pCount > 1 ? pTimes[1] - pTimes[0] : 0;
+
+	uint64_t bit = 0;
+
+	// The times.
+	int64_t lastTime = 0;
+	int64_t lastDelta = 0;
+	for( size_t row = 0 ; row < pCount ; row++ )
+	{
+		if( row % CHECKPOINT_INTERVAL == 0 )
+		{
+			mTimeCheckpoints.push_back({(uint32_t)bit,lastTime,lastDelta});
+		}
+
+		if( row == 0 )
+		{
+			WriteBits(bit,(uint64_t)pTimes[0],64);
+		}
+		else
+		{
+			const int64_t delta = (int64_t)pTimes[row] - lastTime;
+			WriteTime(bit,delta - lastDelta);
+			lastDelta = delta;
+
+			if( delta != mStep )
+			{
+				mStep = 0;
+			}
+		}
+		lastTime = pTimes[row];
+	}
+
+	// Then each column.
+	for( size_t column = 0 ; column < pColumnCount ; column++ )
+	{
+		uint32_t last = 0;
+		uint8_t leading = NO_WINDOW;
+		uint8_t trailing = 0;
+		for( size_t row = 0 ; row < pCount ; row++ )
+		{
+			if( row % CHECKPOINT_INTERVAL == 0 )
+			{
+				mColumns[column].push_back({(uint32_t)bit,last,leading,trailing});
+			}
+
+			const uint32_t value = pValues[row * pColumnCount + column];
+			if( row == 0 )
+			{
+				WriteBits(bit,value,32);
+			}
+			else
+			{
+				WriteValue(bit,value ^ last,leading,trailing);
+			}
+			last = value;
+		}
+	}
+
+	mBits.shrink_to_fit();
+	mTimeCheckpoints.shrink_to_fit();
+	for( auto& column : mColumns )
+	{
+		column.shrink_to_fit();
+	}
+}
+
+std::time_t CompressedTimeSeries::GetTime(size_t pIndex)const
+{
+	assert( pIndex < mCount );
+	if( mStep != 0 )
+		return mFirstTime + (std::time_t)pIndex * mStep;
+
+	const size_t first = pIndex - (pIndex % CHECKPOINT_INTERVAL);
+	const TimeCheckpoint& checkpoint = mTimeCheckpoints[first / CHECKPOINT_INTERVAL];
+	uint64_t bit = checkpoint.mBit;
+	int64_t time = checkpoint.mTime;
+	int64_t delta = checkpoint.mDelta;
+	for( size_t row = first ; row <= pIndex ; row++ )
+	{
+		if( row == 0 )
+		{
+			time = (int64_t)ReadBits(bit,64);
+		}
+		else
+		{
+			delta += ReadTime(bit);
+			time += delta;
+		}
+	}
+	return (std::time_t)time;
+}
+
+uint32_t CompressedTimeSeries::GetValue(size_t pColumn,size_t pIndex)const
+{
+	assert( pColumn < mColumns.size() );
+	assert( pIndex < mCount );
+
+	const size_t first = pIndex - (pIndex % CHECKPOINT_INTERVAL);
+	const Checkpoint& checkpoint = mColumns[pColumn][first / CHECKPOINT_INTERVAL];
+	uint64_t bit = checkpoint.mBit;
+	uint32_t value = checkpoint.mValue;
+	uint8_t leading = checkpoint.mLeading;
+	uint8_t trailing = checkpoint.mTrailing;
+	for( size_t row = first ; row <= pIndex ; row++ )
+	{
+		value = row == 0 ? (uint32_t)ReadBits(bit,32) : value ^ ReadValue(bit,leading,trailing);
+	}
+	return value;
+}
+
+size_t CompressedTimeSeries::FindIndex(std::time_t pTime)const
+{
+	if( mCount == 0 || pTime < mFirstTime )
+		return mCount;
+
+	if( mStep != 0 )
+		return std::min(mCount - 1,(size_t)((pTime - mFirstTime) / mStep));
+
+	// Not evenly spaced, binary search for the last one at or before the time.
+	size_t low = 0;
+	size_t high = mCount;
+	while( high - low > 1 )
+	{
+		const size_t mid = (low + high) / 2;
+		if( GetTime(mid) <= pTime )
+			low = mid;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+size_t CompressedTimeSeries::GetMemoryUsage()const
+{
+	size_t bytes = mBits.capacity() * sizeof(uint64_t);
+	bytes += mTimeCheckpoints.capacity() * sizeof(TimeCheckpoint);
+	bytes += mColumns.capacity() * sizeof(std::vector<Checkpoint>);
+	for( const auto& column : mColumns )
+	{
+		bytes += column.capacity() * sizeof(Checkpoint);
+	}
+	return bytes;
+}
+
+CompressedTimeSeries::ColumnReader::ColumnReader(const CompressedTimeSeries& pSeries,size_t pColumn):
+	mSeries(pSeries),
+	mColumn(pColumn),
+	mRow(0),
+	mTimeBit(0),
+	mValueBit(pSeries.mCount > 0 ? pSeries.mColumns[pColumn][0].mBit : 0),
+	mTime(0),
+	mDelta(0),
+	mValue(0),
+	mLeading(NO_WINDOW),
+	mTrailing(0)
+{
+	assert( pColumn < pSeries.mColumns.size() );
+}
+
+bool CompressedTimeSeries::ColumnReader::Next(std::time_t& rTime,uint32_t& rValue)
+{
+	if( mRow >= mSeries.mCount )
+		return false;
+
+	if( mRow == 0 )
+	{
+		mTime = (int64_t)mSeries.ReadBits(mTimeBit,64);
+		mValue = (uint32_t)mSeries.ReadBits(mValueBit,32);
+	}
+	else
+	{
+		mDelta += mSeries.ReadTime(mTimeBit);
+		mTime += mDelta;
+		mValue ^= mSeries.ReadValue(mValueBit,mLeading,mTrailing);
+	}
+	mRow++;
+
+	rTime = (std::time_t)mTime;
+	rValue = mValue;
+	return true;
+}
+
+bool CompressedTimeSeries::ColumnReader::Next(std::time_t& rTime,float& rValue)
+{
+	uint32_t bits;
+	if( Next(rTime,bits) == false )
+		return false;
+
+	rValue = ToFloat(bits);
+	return true;
+}
+
+void CompressedTimeSeries::WriteBits(uint64_t& rBit,uint64_t pValue,uint32_t pCount)
+{
+	assert( pCount > 0 && pCount <= 64 );
+	pValue &= Mask(pCount);
+	while( pCount > 0 )
+	{
+		const size_t word = rBit / 64;
+		const uint32_t space = 64 - (rBit % 64);
+		const uint32_t count = std::min(space,pCount);
+		if( word >= mBits.size() )
+		{
+			mBits.push_back(0);
+		}
+
+		// Most significant bits first.
+		const uint64_t chunk = (pValue >> (pCount - count)) & Mask(count);
+		mBits[word] |= chunk << (space - count);
+		rBit += count;
+		pCount -= count;
+	}
+}
+
+uint64_t CompressedTimeSeries::ReadBits(uint64_t& rBit,uint32_t pCount)const
+{
+	assert( pCount > 0 && pCount <= 64 );
+	uint64_t value = 0;
+	while( pCount > 0 )
+	{
+		const size_t word = rBit / 64;
+		const uint32_t space = 64 - (rBit % 64);
+		const uint32_t count = std::min(space,pCount);
+		const uint64_t chunk = (mBits[word] >> (space - count)) & Mask(count);
+		value = count == 64 ? chunk : (value << count) | chunk;
+		rBit += count;
+		pCount -= count;
+	}
+	return value;
+}
+
+void CompressedTimeSeries::WriteTime(uint64_t& rBit,int64_t pDeltaOfDelta)
+{
+#ifndef NDEBUG
+	const uint64_t start = rBit;
+#endif
+
+	// Variable length, an evenly spaced series only ever writes the single zero bit.
+	if( pDeltaOfDelta == 0 )
+	{
+		WriteBits(rBit,0,1);
+	}
+	else if( pDeltaOfDelta >= -64 && pDeltaOfDelta <= 63 )
+	{
+		WriteBits(rBit,0x2,2);
+		WriteBits(rBit,(uint64_t)pDeltaOfDelta,7);
+	}
+	else if( pDeltaOfDelta >= -256 && pDeltaOfDelta <= 255 )
+	{
+		WriteBits(rBit,0x6,3);
+		WriteBits(rBit,(uint64_t)pDeltaOfDelta,9);
+	}
+	else if( pDeltaOfDelta >= -2048 && pDeltaOfDelta <= 2047 )
+	{
+		WriteBits(rBit,0xe,4);
+		WriteBits(rBit,(uint64_t)pDeltaOfDelta,12);
+	}
+	else
+	{
+		WriteBits(rBit,0xf,4);
+		WriteBits(rBit,(uint64_t)pDeltaOfDelta,64);
+	}
+
+#ifndef NDEBUG
+	// The ranges above must be what the sign extend in ReadTime gives back, an edge value out by one comes back negated.
+	uint64_t check = start;
+	assert( ReadTime(check) == pDeltaOfDelta && check == rBit );
+#endif
+}
+
+int64_t CompressedTimeSeries::ReadTime(uint64_t& rBit)const
+{
+	if( ReadBits(rBit,1) == 0 )
+		return 0;
+	if( ReadBits(rBit,1) == 0 )
+		return SignExtend(ReadBits(rBit,7),7);
+	if( ReadBits(rBit,1) == 0 )
+		return SignExtend(ReadBits(rBit,9),9);
+	if( ReadBits(rBit,1) == 0 )
+		return SignExtend(ReadBits(rBit,12),12);
+	return (int64_t)ReadBits(rBit,64);
+}
+
+void CompressedTimeSeries::WriteValue(uint64_t& rBit,uint32_t pXor,uint8_t& rLeading,uint8_t& rTrailing)
+{
+	if( pXor == 0 )
+	{// Same as last time.
+		WriteBits(rBit,0,1);
+		return;
+	}
+
+	WriteBits(rBit,1,1);
+	const uint8_t leading = (uint8_t)__builtin_clz(pXor);
+	const uint8_t trailing = (uint8_t)__builtin_ctz(pXor);
+	if( rLeading != NO_WINDOW && leading >= rLeading && trailing >= rTrailing )
+	{// Fits in the window of meaningful bits we used last time, just write those.
+		WriteBits(rBit,0,1);
+		WriteBits(rBit,pXor >> rTrailing,32 - rLeading - rTrailing);
+	}
+	else
+	{// New window.
+		const uint32_t length = 32 - leading - trailing;
+		WriteBits(rBit,1,1);
+		WriteBits(rBit,leading,5);
+		WriteBits(rBit,length - 1,5);
+		WriteBits(rBit,pXor >> trailing,length);
+		rLeading = leading;
+		rTrailing = trailing;
+	}
+}
+
+uint32_t CompressedTimeSeries::ReadValue(uint64_t& rBit,uint8_t& rLeading,uint8_t& rTrailing)const
+{
+	if( ReadBits(rBit,1) == 0 )
+		return 0;
+
+	if( ReadBits(rBit,1) == 0 )
+		return (uint32_t)ReadBits(rBit,32 - rLeading - rTrailing) << rTrailing;
+
+	rLeading = (uint8_t)ReadBits(rBit,5);
+	const uint32_t length = (uint32_t)ReadBits(rBit,5) + 1;
+	rTrailing = (uint8_t)(32 - rLeading - length);
+	return (uint32_t)ReadBits(rBit,length) << rTrailing;
+}
+
+void CompressedForecast::Compress(const OpenWeatherMap& pWeather)
+{
+	mTimezoneOffset = pWeather.mTimezoneOffset;
+
+	const size_t hourlyColumns = (size_t)CompressedHourlyColumn::COUNT;
+	std::vector<std::time_t> times;
+	std::vector<uint32_t> values;
+
+	times.reserve(pWeather.mHourly.size());
+	values.reserve(pWeather.mHourly.size() * hourlyColumns);
+	for( const auto& hour : pWeather.mHourly )
+	{
+		times.push_back(hour.mTime.mUTC);
+		// Same order as CompressedHourlyColumn.
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mTemperature.k));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mFeelsLike.k));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mPressure));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mHumidity));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mDewPoint));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mClouds));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mUVIndex));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mVisibility));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mWindSpeed));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mWindGusts));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mWindDirection));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mPrecipitationProbability));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mRain));
+		values.push_back(CompressedTimeSeries::FromFloat(hour.mSnow));
+		values.push_back(hour.mDisplay.mID);
+		values.push_back(hour.mDisplay.mCondition);
+		values.push_back(hour.mDisplay.mIcon);
+	}
+	mHourly.Build(times.data(),values.data(),times.size(),hourlyColumns);
+
+	const size_t dailyColumns = (size_t)CompressedDailyColumn::COUNT;
+	times.clear();
+	values.clear();
+	for( const auto& day : pWeather.mDaily )
+	{
+		times.push_back(day.mTime.mUTC);
+		// Same order as CompressedDailyColumn.
+		values.push_back((uint32_t)(int32_t)(day.mSunrise.mUTC - day.mTime.mUTC));
+		values.push_back((uint32_t)(int32_t)(day.mSunset.mUTC - day.mTime.mUTC));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mTemperature.Morning.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mTemperature.Day.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mTemperature.Evening.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mTemperature.Night.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mTemperature.Min.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mTemperature.Max.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mFeelsLike.Morning.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mFeelsLike.Day.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mFeelsLike.Evening.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mFeelsLike.Night.k));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mPressure));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mHumidity));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mDewPoint));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mClouds));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mUVIndex));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mWindSpeed));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mWindGusts));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mWindDirection));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mPrecipitationProbability));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mRain));
+		values.push_back(CompressedTimeSeries::FromFloat(day.mSnow));
+		values.push_back(day.mDisplay.mID);
+		values.push_back(day.mDisplay.mCondition);
+		values.push_back(day.mDisplay.mIcon);
+	}
+	mDaily.Build(times.data(),values.data(),times.size(),dailyColumns);
+}
+
+bool CompressedForecast::GetHourly(size_t pIndex,WeatherData& rHourly)const
+{
+	if( pIndex >= mHourly.GetCount() )
+		return false;
+
+	auto get = [this,pIndex](CompressedHourlyColumn pColumn){return mHourly.GetFloat((size_t)pColumn,pIndex);};
+
+	rHourly.mTime.Set(mHourly.GetTime(pIndex),mTimezoneOffset);
+	rHourly.mSunrise.Set(0,mTimezoneOffset);// Not in the hourly data.
+	rHourly.mSunset.Set(0,mTimezoneOffset);
+	rHourly.mTemperature.Set(get(CompressedHourlyColumn::TEMPERATURE));
+	rHourly.mFeelsLike.Set(get(CompressedHourlyColumn::FEELS_LIKE));
+	rHourly.mPressure = (uint32_t)get(CompressedHourlyColumn::PRESSURE);
+	rHourly.mHumidity = (uint32_t)get(CompressedHourlyColumn::HUMIDITY);
+	rHourly.mDewPoint = get(CompressedHourlyColumn::DEW_POINT);
+	rHourly.mClouds = (uint32_t)get(CompressedHourlyColumn::CLOUDS);
+	rHourly.mUVIndex = (uint32_t)get(CompressedHourlyColumn::UV_INDEX);
+	rHourly.mVisibility = (uint32_t)get(CompressedHourlyColumn::VISIBILITY);
+	rHourly.mWindSpeed = get(CompressedHourlyColumn::WIND_SPEED);
+	rHourly.mWindGusts = get(CompressedHourlyColumn::WIND_GUSTS);
+	rHourly.mWindDirection = (uint32_t)get(CompressedHourlyColumn::WIND_DIRECTION);
+	rHourly.mPrecipitationProbability = get(CompressedHourlyColumn::PRECIPITATION_PROBABILITY);
+	rHourly.mRain = get(CompressedHourlyColumn::RAIN);
+	rHourly.mSnow = get(CompressedHourlyColumn::SNOW);
+	rHourly.mDisplay.mID = mHourly.GetValue((size_t)CompressedHourlyColumn::CONDITION_ID,pIndex);
+	rHourly.mDisplay.mCondition = (uint16_t)mHourly.GetValue((size_t)CompressedHourlyColumn::CONDITION,pIndex);
+	rHourly.mDisplay.mIcon = (uint16_t)mHourly.GetValue((size_t)CompressedHourlyColumn::ICON,pIndex);
+	return true;
+}
+
+bool CompressedForecast::GetDaily(size_t pIndex,DailyWeatherData& rDaily)const
+{
+	if( pIndex >= mDaily.GetCount() )
+		return false;
+
+	auto get = [this,pIndex](CompressedDailyColumn pColumn){return mDaily.GetFloat((size_t)pColumn,pIndex);};
+	auto getInt = [this,pIndex](CompressedDailyColumn pColumn){return (int32_t)mDaily.GetValue((size_t)pColumn,pIndex);};
+
+	const std::time_t time = mDaily.GetTime(pIndex);
+	rDaily.mTime.Set(time,mTimezoneOffset);
+	rDaily.mSunrise.Set(time + getInt(CompressedDailyColumn::SUNRISE),mTimezoneOffset);
+	rDaily.mSunset.Set(time + getInt(CompressedDailyColumn::SUNSET),mTimezoneOffset);
+	rDaily.mTemperature.Set
+	(
+		get(CompressedDailyColumn::TEMPERATURE_MORNING),
+		get(CompressedDailyColumn::TEMPERATURE_DAY),
+		get(CompressedDailyColumn::TEMPERATURE_EVENING),
+		get(CompressedDailyColumn::TEMPERATURE_NIGHT),
+		get(CompressedDailyColumn::TEMPERATURE_MIN),
+		get(CompressedDailyColumn::TEMPERATURE_MAX)
+	);
+	rDaily.mFeelsLike.Set
+	(
+		get(CompressedDailyColumn::FEELS_LIKE_MORNING),
+		get(CompressedDailyColumn::FEELS_LIKE_DAY),
+		get(CompressedDailyColumn::FEELS_LIKE_EVENING),
+		get(CompressedDailyColumn::FEELS_LIKE_NIGHT)
+	);
+	rDaily.mPressure = (uint32_t)get(CompressedDailyColumn::PRESSURE);
+	rDaily.mHumidity = (uint32_t)get(CompressedDailyColumn::HUMIDITY);
+	rDaily.mDewPoint = get(CompressedDailyColumn::DEW_POINT);
+	rDaily.mClouds = (uint32_t)get(CompressedDailyColumn::CLOUDS);
+	rDaily.mUVIndex = (uint32_t)get(CompressedDailyColumn::UV_INDEX);
+	rDaily.mWindSpeed = get(CompressedDailyColumn::WIND_SPEED);
+	rDaily.mWindGusts = get(CompressedDailyColumn::WIND_GUSTS);
+	rDaily.mWindDirection = (uint32_t)get(CompressedDailyColumn::WIND_DIRECTION);
+	rDaily.mPrecipitationProbability = get(CompressedDailyColumn::PRECIPITATION_PROBABILITY);
+	rDaily.mRain = get(CompressedDailyColumn::RAIN);
+	rDaily.mSnow = get(CompressedDailyColumn::SNOW);
+	rDaily.mDisplay.mID = mDaily.GetValue((size_t)CompressedDailyColumn::CONDITION_ID,pIndex);
+	rDaily.mDisplay.mCondition = (uint16_t)mDaily.GetValue((size_t)CompressedDailyColumn::CONDITION,pIndex);
+	rDaily.mDisplay.mIcon = (uint16_t)mDaily.GetValue((size_t)CompressedDailyColumn::ICON,pIndex);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
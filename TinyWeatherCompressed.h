@@ -0,0 +1,218 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_COMPRESSED_H
+#define TINY_WEATHER_COMPRESSED_H
+
+#include <vector>
+#include <ctime>
+#include <string.h>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The hourly values kept when compressed. Condition id is the weather id, condition and icon are the handles in the ConditionTable.
+ */
+enum struct CompressedHourlyColumn
+{
+	TEMPERATURE,
+	FEELS_LIKE,
+	PRESSURE,
+	HUMIDITY,
+	DEW_POINT,
+	CLOUDS,
+	UV_INDEX,
+	VISIBILITY,
+	WIND_SPEED,
+	WIND_GUSTS,
+	WIND_DIRECTION,
+	PRECIPITATION_PROBABILITY,
+	RAIN,
+	SNOW,
+	CONDITION_ID,
+	CONDITION,
+	ICON,
+	COUNT
+};
+
+/**
+ * @brief The daily values kept when compressed. Sunrise and sunset are stored as seconds from the time of the day.
+ */
+enum struct CompressedDailyColumn
+{
+	SUNRISE,
+	SUNSET,
+	TEMPERATURE_MORNING,
+	TEMPERATURE_DAY,
+	TEMPERATURE_EVENING,
+	TEMPERATURE_NIGHT,
+	TEMPERATURE_MIN,
+	TEMPERATURE_MAX,
+	FEELS_LIKE_MORNING,
+	FEELS_LIKE_DAY,
+	FEELS_LIKE_EVENING,
+	FEELS_LIKE_NIGHT,
+	PRESSURE,
+	HUMIDITY,
+	DEW_POINT,
+	CLOUDS,
+	UV_INDEX,
+	WIND_SPEED,
+	WIND_GUSTS,
+	WIND_DIRECTION,
+	PRECIPITATION_PROBABILITY,
+	RAIN,
+	SNOW,
+	CONDITION_ID,
+	CONDITION,
+	ICON,
+	COUNT
+};
+
+/**
+ * @brief A time series compressed the way Facebook's Gorilla paper does it.
+ * Times are stored as the change in the difference from the last time, for hourly data that is one bit each.
+ * Values are 32 bits, floats by their bits, and stored as the xor with the one before. Weather changes slowly
+ * so the xor has lots of leading and trailing zeros and only the bits in between are stored.
+ * Each column is its own stream so one value can be scanned without touching the others, and every
+ * CHECKPOINT_INTERVAL rows the state of the decoder is saved so random access only decodes a few values.
+ */
+class CompressedTimeSeries
+{
+public:
+	static const size_t CHECKPOINT_INTERVAL = 16;
+
+	/**
+	 * @brief Compresses the series.
+	 * @param pTimes The time of each row, pCount of them.
+	 * @param pValues Row by row, pColumnCount values for each row.
+	 */
+	void Build(const std::time_t* pTimes,const uint32_t* pValues,size_t pCount,size_t pColumnCount);
+
+	size_t GetCount()const{return mCount;}
+	size_t GetColumnCount()const{return mColumns.size();}
+
+	std::time_t GetTime(size_t pIndex)const;
+	uint32_t GetValue(size_t pColumn,size_t pIndex)const;
+	float GetFloat(size_t pColumn,size_t pIndex)const{return ToFloat(GetValue(pColumn,pIndex));}
+
+	/**
+	 * @brief Index of the last row at or before the time, or GetCount() if the time is before the first row.
+	 * When the rows are evenly spaced it is worked out directly, else binary search.
+	 */
+	size_t FindIndex(std::time_t pTime)const;
+
+	/**
+	 * @brief Heap used by the compressed data.
+	 */
+	size_t GetMemoryUsage()const;
+
+	/**
+	 * @brief Sequential decode of one column, much faster than GetValue in a loop.
+	 *   CompressedTimeSeries::ColumnReader reader(series,column);
+	 *   while( reader.Next(time,value) ){...}
+	 */
+	class ColumnReader
+	{
+	public:
+		ColumnReader(const CompressedTimeSeries& pSeries,size_t pColumn);
+		bool Next(std::time_t& rTime,uint32_t& rValue);
+		bool Next(std::time_t& rTime,float& rValue);
+
+	private:
+		const CompressedTimeSeries& mSeries;
+		const size_t mColumn;
+		size_t mRow;
+		uint64_t mTimeBit,mValueBit;
+		int64_t mTime,mDelta;
+		uint32_t mValue;
+		uint8_t mLeading,mTrailing;
+	};
+
+	static uint32_t FromFloat(float pValue){uint32_t bits;memcpy(&bits,&pValue,sizeof(bits));return bits;}
+	static float ToFloat(uint32_t pBits){float value;memcpy(&value,&pBits,sizeof(value));return value;}
+
+private:
+	/**
+	 * @brief Decoder state at the start of a row.
+	 */
+	struct Checkpoint
+	{
+		uint32_t mBit;
+		uint32_t mValue;	//!< Value of the row before.
+		uint8_t mLeading;
+		uint8_t mTrailing;
+	};
+
+	struct TimeCheckpoint
+	{
+		uint32_t mBit;
+		int64_t mTime;
+		int64_t mDelta;
+	};
+
+	std::vector<uint64_t> mBits;	//!< All the streams, times first then each column.
+	size_t mCount = 0;
+	std::time_t mFirstTime = 0;
+	std::time_t mStep = 0;			//!< Non zero if all the rows are evenly spaced.
+	std::vector<TimeCheckpoint> mTimeCheckpoints;
+	std::vector<std::vector<Checkpoint>> mColumns;
+
+	void WriteBits(uint64_t& rBit,uint64_t pValue,uint32_t pCount);
+	uint64_t ReadBits(uint64_t& rBit,uint32_t pCount)const;
+
+	void WriteTime(uint64_t& rBit,int64_t pDeltaOfDelta);
+	int64_t ReadTime(uint64_t& rBit)const;
+	void WriteValue(uint64_t& rBit,uint32_t pXor,uint8_t& rLeading,uint8_t& rTrailing);
+	uint32_t ReadValue(uint64_t& rBit,uint8_t& rLeading,uint8_t& rTrailing)const;
+};
+
+/**
+ * @brief An hourly and daily forecast held compressed, a fifth or less of the memory of mHourly and mDaily.
+ * Only the fields in CompressedHourlyColumn and CompressedDailyColumn are kept. The display data is kept as
+ * its ConditionTable handles, so is only good for the life of the process.
+ */
+struct CompressedForecast
+{
+	CompressedTimeSeries mHourly;
+	CompressedTimeSeries mDaily;
+	int32_t mTimezoneOffset = 0;	//!< From the forecast, for the local time fields.
+
+	void Compress(const OpenWeatherMap& pWeather);
+
+	/**
+	 * @brief Rebuilds an entry, returns false if the index is out of range.
+	 */
+	bool GetHourly(size_t pIndex,WeatherData& rHourly)const;
+	bool GetDaily(size_t pIndex,DailyWeatherData& rDaily)const;
+
+	float GetHourly(CompressedHourlyColumn pColumn,size_t pIndex)const{return mHourly.GetFloat((size_t)pColumn,pIndex);}
+
+	size_t GetMemoryUsage()const{return mHourly.GetMemoryUsage() + mDaily.GetMemoryUsage();}
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_COMPRESSED_H
@@ -0,0 +1,414 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <iostream>
+#include <cmath>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TinyWeatherHistory.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const char HISTORY_FILE_MAGIC[8] = {'T','W','H','I','S','T',0,0};
+static const size_t HISTORY_FILE_HEADER_SIZE = 16;
+
+/**
+ * @brief Checks the block header makes sense and the whole block is in the pAvailable bytes from its start.
+ */
+static bool IsBlockValid(const HistoryBlockHeader& pBlock,uint64_t pAvailable)
+{
+	if( pBlock.mMagic != HISTORY_BLOCK_MAGIC || pBlock.mBlockSize < sizeof(HistoryBlockHeader) || pBlock.mBlockSize > pAvailable )
+		return false;
+
+	uint64_t columns = 0;
+	for( uint32_t size : pBlock.mColumnSize )
+	{
+		columns += size;
+	}
+	return sizeof(HistoryBlockHeader) + columns <= pBlock.mBlockSize;
+}
+
+double GetHistoryColumnScale(HistoryColumn pColumn)
+{
+	switch(pColumn)
+	{
+#define DEF_COLUMN(COLUMN_ENUM__,COLUMN_NAME__,COLUMN_SCALE__) case HistoryColumn::COLUMN_ENUM__:return COLUMN_SCALE__;
+	HISTORY_COLUMNS
+#undef DEF_COLUMN
+	case HistoryColumn::COUNT:
+		break;
+	}
+	return 1.0;
+}
+
+const char* GetHistoryColumnName(HistoryColumn pColumn)
+{
+	switch(pColumn)
+	{
+#define DEF_COLUMN(COLUMN_ENUM__,COLUMN_NAME__,COLUMN_SCALE__) case HistoryColumn::COLUMN_ENUM__:return COLUMN_NAME__;
+	HISTORY_COLUMNS
+#undef DEF_COLUMN
+	case HistoryColumn::COUNT:
+		break;
+	}
+	return "unknown";
+}
+
+static void WriteVarint(std::vector<uint8_t>& rColumn,uint64_t pValue)
+{
+	while( pValue >= 0x80 )
+	{
+		rColumn.push_back((uint8_t)(pValue | 0x80));
+		pValue >>= 7;
+	}
+	rColumn.push_back((uint8_t)pValue);
+}
+
+static void WriteZigzag(std::vector<uint8_t>& rColumn,int64_t pValue)
+{
+	WriteVarint(rColumn,((uint64_t)pValue << 1) ^ (uint64_t)(pValue >> 63));
+}
+
+/**
+ * @brief Writes each value as the difference from the one before, weather changes slowly so these are small.
+ */
+struct DeltaColumn
+{
+	std::vector<uint8_t>& mColumn;
+	const double mScale;
+	int64_t mLast;
+
+	DeltaColumn(std::vector<uint8_t>& rColumn,HistoryColumn pColumn):mColumn(rColumn),mScale(GetHistoryColumnScale(pColumn)),mLast(0){}
+
+	void Add(double pValue)
+	{
+		const int64_t value = std::llround(pValue * mScale);
+		WriteZigzag(mColumn,value - mLast);
+		mLast = value;
+	}
+};
+
+/**
+ * @brief Time is written as the change in the difference, with a regular step nearly all of them are zero.
+ */
+struct TimeColumn
+{
+	std::vector<uint8_t>& mColumn;
+	int64_t mLast;
+	int64_t mLastDelta;
+
+	TimeColumn(std::vector<uint8_t>& rColumn):mColumn(rColumn),mLast(0),mLastDelta(0){}
+
+	void Add(std::time_t pTime)
+	{
+		const int64_t delta = (int64_t)pTime - mLast;
+		WriteZigzag(mColumn,delta - mLastDelta);
+		mLast = pTime;
+		mLastDelta = delta;
+	}
+};
+
+HistoryWriter::~HistoryWriter()
+{
+	Close();
+}
+
+bool HistoryWriter::Open(const std::string& pFileName)
+{
+	Close();
+
+	// Read as well so the version of a log already there can be checked, writes still always go on the end.
+	mFile = fopen(pFileName.c_str(),"a+b");
+	if( mFile == nullptr || fseek(mFile,0,SEEK_END) != 0 )
+	{
+		std::cerr << "Failed to open weather history " << pFileName << "\n";
+		Close();
+		return false;
+	}
+
+	const long fileSize = ftell(mFile);
+	if( fileSize > 0 )
+	{// Appending blocks of another version would leave a log no reader can make sense of.
+		uint8_t header[HISTORY_FILE_HEADER_SIZE] = {0};
+		uint32_t version = 0;
+		rewind(mFile);
+		if( fread(header,sizeof(header),1,mFile) == 1 )
+		{
+			memcpy(&version,header + sizeof(HISTORY_FILE_MAGIC),sizeof(version));
+		}
+		if( memcmp(header,HISTORY_FILE_MAGIC,sizeof(HISTORY_FILE_MAGIC)) != 0 || version != HISTORY_VERSION )
+		{
+			std::cerr << "Invalid weather history " << pFileName << ", not appending to it\n";
+			Close();
+			return false;
+		}
+
+		// Find the end of the last whole block. After a crash part way through an append there is a torn block on
+		// the end, anything appended after it would be read as part of it and lost, so it is cut off.
+		long end = HISTORY_FILE_HEADER_SIZE;
+		HistoryBlockHeader block;
+		while( fseek(mFile,end,SEEK_SET) == 0 && fread(&block,sizeof(block),1,mFile) == 1 && IsBlockValid(block,fileSize - end) )
+		{
+			end += block.mBlockSize;
+		}
+
+		if( end < fileSize )
+		{
+			std::cerr << "Weather history " << pFileName << " has " << (fileSize - end) << " bytes of a torn block on the end, removing them\n";
+			if( ftruncate(fileno(mFile),end) != 0 )
+			{
+				std::cerr << "Failed to truncate weather history " << pFileName << "\n";
+				Close();
+				return false;
+			}
+		}
+		fseek(mFile,0,SEEK_END);
+	}
+	else
+	{// New file, write the header.
+		uint8_t header[HISTORY_FILE_HEADER_SIZE] = {0};
+		memcpy(header,HISTORY_FILE_MAGIC,sizeof(HISTORY_FILE_MAGIC));
+		memcpy(header + sizeof(HISTORY_FILE_MAGIC),&HISTORY_VERSION,sizeof(HISTORY_VERSION));
+		if( fwrite(header,sizeof(header),1,mFile) != 1 || fflush(mFile) != 0 )
+		{
+			std::cerr << "Failed to write weather history header " << pFileName << "\n";
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void HistoryWriter::Close()
+{
+	if( mFile )
+	{
+		fclose(mFile);
+		mFile = nullptr;
+	}
+}
+
+bool HistoryWriter::Append(const OpenWeatherMap& pWeather,std::time_t pFetched)
+{
+	if( mFile == nullptr )
+		return false;
+
+	const bool ok = WriteBlock(pWeather,HistorySeries::HOURLY,pFetched) && WriteBlock(pWeather,HistorySeries::DAILY,pFetched);
+	return fflush(mFile) == 0 && ok;
+}
+
+bool HistoryWriter::WriteBlock(const OpenWeatherMap& pWeather,HistorySeries pSeries,std::time_t pFetched)
+{
+	for( auto& column : mColumns )
+	{
+		column.clear();
+	}
+
+	TimeColumn time(mColumns[(size_t)HistoryColumn::TIME]);
+	DeltaColumn temperature(mColumns[(size_t)HistoryColumn::TEMPERATURE],HistoryColumn::TEMPERATURE);
+	DeltaColumn feelsLike(mColumns[(size_t)HistoryColumn::FEELS_LIKE],HistoryColumn::FEELS_LIKE);
+	DeltaColumn pressure(mColumns[(size_t)HistoryColumn::PRESSURE],HistoryColumn::PRESSURE);
+	DeltaColumn humidity(mColumns[(size_t)HistoryColumn::HUMIDITY],HistoryColumn::HUMIDITY);
+	DeltaColumn clouds(mColumns[(size_t)HistoryColumn::CLOUDS],HistoryColumn::CLOUDS);
+	DeltaColumn windSpeed(mColumns[(size_t)HistoryColumn::WIND_SPEED],HistoryColumn::WIND_SPEED);
+	DeltaColumn windDirection(mColumns[(size_t)HistoryColumn::WIND_DIRECTION],HistoryColumn::WIND_DIRECTION);
+	DeltaColumn probability(mColumns[(size_t)HistoryColumn::PRECIPITATION_PROBABILITY],HistoryColumn::PRECIPITATION_PROBABILITY);
+	DeltaColumn rain(mColumns[(size_t)HistoryColumn::RAIN],HistoryColumn::RAIN);
+	DeltaColumn snow(mColumns[(size_t)HistoryColumn::SNOW],HistoryColumn::SNOW);
+	DeltaColumn conditionID(mColumns[(size_t)HistoryColumn::CONDITION_ID],HistoryColumn::CONDITION_ID);
+
+	uint32_t rowCount = 0;
+	if( pSeries == HistorySeries::HOURLY )
+	{
+		for( const auto& hour : pWeather.mHourly )
+		{
+			time.Add(hour.mTime.mUTC);
+			temperature.Add(hour.mTemperature.k);
+			feelsLike.Add(hour.mFeelsLike.k);
+			pressure.Add(hour.mPressure);
+			humidity.Add(hour.mHumidity);
+			clouds.Add(hour.mClouds);
+			windSpeed.Add(hour.mWindSpeed);
+			windDirection.Add(hour.mWindDirection);
+			probability.Add(hour.mPrecipitationProbability);
+			rain.Add(hour.mRain);
+			snow.Add(hour.mSnow);
+			conditionID.Add(hour.mDisplay.mID);
+		}
+		rowCount = (uint32_t)pWeather.mHourly.size();
+	}
+	else
+	{
+		for( const auto& day : pWeather.mDaily )
+		{
+			time.Add(day.mTime.mUTC);
+			temperature.Add(day.mTemperature.Day.k);
+			feelsLike.Add(day.mFeelsLike.Day.k);
+			pressure.Add(day.mPressure);
+			humidity.Add(day.mHumidity);
+			clouds.Add(day.mClouds);
+			windSpeed.Add(day.mWindSpeed);
+			windDirection.Add(day.mWindDirection);
+			probability.Add(day.mPrecipitationProbability);
+			rain.Add(day.mRain);
+			snow.Add(day.mSnow);
+			conditionID.Add(day.mDisplay.mID);
+		}
+		rowCount = (uint32_t)pWeather.mDaily.size();
+	}
+
+	if( rowCount == 0 )
+		return true;
+
+	HistoryBlockHeader header;
+	memset(&header,0,sizeof(header));
+	header.mMagic = HISTORY_BLOCK_MAGIC;
+	header.mFetched = pFetched;
+	header.mLatitude = pWeather.mLatitude;
+	header.mLongitude = pWeather.mLongitude;
+	header.mSeries = pSeries;
+	header.mRowCount = rowCount;
+
+	size_t blockSize = sizeof(header);
+	for( size_t n = 0 ; n < HISTORY_COLUMN_COUNT ; n++ )
+	{
+		header.mColumnSize[n] = (uint32_t)mColumns[n].size();
+		blockSize += mColumns[n].size();
+	}
+	// Pad so the next header is aligned.
+	blockSize = (blockSize + 7) & ~(size_t)7;
+	header.mBlockSize = (uint32_t)blockSize;
+
+	// One write for the whole block so a reader never sees a header without its data unless we crash.
+	mBlock.assign((const uint8_t*)&header,(const uint8_t*)&header + sizeof(header));
+	for( const auto& column : mColumns )
+	{
+		mBlock.insert(mBlock.end(),column.begin(),column.end());
+	}
+	mBlock.resize(blockSize,0);
+
+	if( fwrite(mBlock.data(),mBlock.size(),1,mFile) != 1 )
+	{
+		std::cerr << "Failed to write to weather history\n";
+		return false;
+	}
+	return true;
+}
+
+HistoryReader::~HistoryReader()
+{
+	Close();
+}
+
+bool HistoryReader::Open(const std::string& pFileName)
+{
+	Close();
+
+	const int file = open(pFileName.c_str(),O_RDONLY);
+	if( file < 0 )
+	{
+		std::cerr << "Failed to open weather history " << pFileName << "\n";
+		return false;
+	}
+
+	struct stat info;
+	void* mapped = MAP_FAILED;
+	if( fstat(file,&info) == 0 && (size_t)info.st_size >= HISTORY_FILE_HEADER_SIZE )
+	{
+		mapped = mmap(nullptr,info.st_size,PROT_READ,MAP_SHARED,file,0);
+	}
+	close(file);
+
+	if( mapped == MAP_FAILED )
+	{
+		std::cerr << "Failed to map weather history " << pFileName << "\n";
+		return false;
+	}
+
+	mData = (const uint8_t*)mapped;
+	mSize = info.st_size;
+
+	uint32_t version;
+	memcpy(&version,mData + sizeof(HISTORY_FILE_MAGIC),sizeof(version));
+	if( memcmp(mData,HISTORY_FILE_MAGIC,sizeof(HISTORY_FILE_MAGIC)) != 0 || version != HISTORY_VERSION )
+	{
+		std::cerr << "Invalid weather history " << pFileName << "\n";
+		Close();
+		return false;
+	}
+
+	// We are read only and scan from front to back, tell the kernel.
+	madvise((void*)mData,mSize,MADV_SEQUENTIAL);
+	return true;
+}
+
+void HistoryReader::Close()
+{
+	if( mData )
+	{
+		munmap((void*)mData,mSize);
+	}
+	mData = nullptr;
+	mSize = 0;
+}
+
+size_t HistoryReader::GetBlockCount()const
+{
+	size_t count = 0;
+	for( const HistoryBlockHeader* block = GetFirstBlock() ; block != nullptr ; block = GetNextBlock(block) )
+	{
+		count++;
+	}
+	return count;
+}
+
+/**
+ * @brief Checks the block is complete, the last one may be half written if the writer was killed.
+ */
+static const HistoryBlockHeader* CheckBlock(const uint8_t* pStart,const uint8_t* pEnd)
+{
+	if( pStart + sizeof(HistoryBlockHeader) > pEnd )
+		return nullptr;
+
+	const HistoryBlockHeader* block = (const HistoryBlockHeader*)pStart;
+	if( IsBlockValid(*block,pEnd - pStart) == false )
+		return nullptr;
+
+	return block;
+}
+
+const HistoryBlockHeader* HistoryReader::GetFirstBlock()const
+{
+	if( mData == nullptr )
+		return nullptr;
+	return CheckBlock(mData + HISTORY_FILE_HEADER_SIZE,mData + mSize);
+}
+
+const HistoryBlockHeader* HistoryReader::GetNextBlock(const HistoryBlockHeader* pBlock)const
+{
+	return CheckBlock((const uint8_t*)pBlock + pBlock->mBlockSize,mData + mSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
@@ -0,0 +1,222 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_HISTORY_H
+#define TINY_WEATHER_HISTORY_H
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The history log is an append only file of every forecast fetched, for measuring how good the forecasts were.
+ * Each fetch adds a block for the hourly series and a block for the daily series. Within a block the data is
+ * stored column by column, the times as delta of delta and the values as deltas, all zigzag varints, so most
+ * values take a byte. The block header holds the size of each column so a reader can skip the ones it does not want.
+ *
+ *   File header, magic and HISTORY_VERSION, sixteen bytes.
+ *   HistoryBlockHeader, column data, HistoryBlockHeader, column data......
+ *
+ * Values with a fraction are stored as hundredths. Daily temperature is the day temperature.
+ */
+#define HISTORY_COLUMNS                                 \
+	DEF_COLUMN(TIME,"time",1)                           \
+	DEF_COLUMN(TEMPERATURE,"temperature",100)           \
+	DEF_COLUMN(FEELS_LIKE,"feels_like",100)             \
+	DEF_COLUMN(PRESSURE,"pressure",1)                   \
+	DEF_COLUMN(HUMIDITY,"humidity",1)                   \
+	DEF_COLUMN(CLOUDS,"clouds",1)                       \
+	DEF_COLUMN(WIND_SPEED,"wind_speed",100)             \
+	DEF_COLUMN(WIND_DIRECTION,"wind_direction",1)       \
+	DEF_COLUMN(PRECIPITATION_PROBABILITY,"pop",100)     \
+	DEF_COLUMN(RAIN,"rain",100)                         \
+	DEF_COLUMN(SNOW,"snow",100)                         \
+	DEF_COLUMN(CONDITION_ID,"condition_id",1)
+
+enum struct HistoryColumn
+{
+#define DEF_COLUMN(COLUMN_ENUM__,COLUMN_NAME__,COLUMN_SCALE__) COLUMN_ENUM__,
+	HISTORY_COLUMNS
+#undef DEF_COLUMN
+	COUNT
+};
+
+enum struct HistorySeries : uint8_t
+{
+	HOURLY,
+	DAILY
+};
+
+const size_t HISTORY_COLUMN_COUNT = (size_t)HistoryColumn::COUNT;
+const uint32_t HISTORY_VERSION = 2;
+const uint32_t HISTORY_BLOCK_MAGIC = 0x314b4c42; // "BLK1"
+
+/**
+ * @brief What the values in the column are multiplied by when stored.
+ */
+double GetHistoryColumnScale(HistoryColumn pColumn);
+const char* GetHistoryColumnName(HistoryColumn pColumn);
+
+struct HistoryBlockHeader
+{
+	uint32_t mMagic;				//!< HISTORY_BLOCK_MAGIC, used to spot a damaged file.
+	uint32_t mBlockSize;			//!< Header and column data, add to the start of this block to get to the next.
+	int64_t mFetched;				//!< When the forecast was fetched, UTC.
+	double mLatitude;
+	double mLongitude;
+	HistorySeries mSeries;
+	uint8_t mPadding[3];
+	uint32_t mRowCount;
+	uint32_t mColumnSize[HISTORY_COLUMN_COUNT];	//!< In bytes, columns follow the header in enum order.
+};
+
+static_assert(sizeof(HistoryBlockHeader) % 8 == 0,"History blocks are padded to eight bytes so the header is always aligned");
+
+/**
+ * @brief Appends forecasts to the history log.
+ */
+class HistoryWriter
+{
+public:
+	HistoryWriter() = default;
+	~HistoryWriter();
+
+	HistoryWriter(const HistoryWriter&) = delete;
+	HistoryWriter& operator=(const HistoryWriter&) = delete;
+
+	/**
+	 * @brief Opens the log for appending, creating it if it is not there.
+	 * An existing log is checked block by block, a torn block on the end, from a crash part way through an append,
+	 * is truncated away so the blocks appended after it can be read.
+	 */
+	bool Open(const std::string& pFileName);
+	void Close();
+
+	/**
+	 * @brief Adds a block for the hourly and the daily forecast, flushed to disk before returning.
+	 * @param pFetched When it was fetched, UTC.
+	 */
+	bool Append(const OpenWeatherMap& pWeather,std::time_t pFetched);
+
+private:
+	FILE* mFile = nullptr;
+	std::vector<uint8_t> mColumns[HISTORY_COLUMN_COUNT];	//!< Kept to save allocating each append.
+	std::vector<uint8_t> mBlock;
+
+	bool WriteBlock(const OpenWeatherMap& pWeather,HistorySeries pSeries,std::time_t pFetched);
+};
+
+/**
+ * @brief Maps the history log and scans columns in place.
+ */
+class HistoryReader
+{
+public:
+	HistoryReader() = default;
+	~HistoryReader();
+
+	HistoryReader(const HistoryReader&) = delete;
+	HistoryReader& operator=(const HistoryReader&) = delete;
+
+	bool Open(const std::string& pFileName);
+	void Close();
+
+	/**
+	 * @brief Calls pFunction(const HistoryBlockHeader& pBlock,std::time_t pForecastTime,double pValue) for every value in the
+	 * column of the series for forecasts fetched between pFrom and pTo. Only the time column and the one asked for are decoded,
+	 * blocks outside of the time range are skipped without being looked at.
+	 * @return size_t The number of values passed to the function.
+	 */
+	template<typename FUNCTION> size_t ScanColumn(HistorySeries pSeries,HistoryColumn pColumn,std::time_t pFrom,std::time_t pTo,FUNCTION pFunction)const;
+
+	/**
+	 * @brief Number of blocks in the log, a damaged or half written block at the end is not counted.
+	 */
+	size_t GetBlockCount()const;
+
+private:
+	const uint8_t* mData = nullptr;
+	size_t mSize = 0;
+
+	const HistoryBlockHeader* GetFirstBlock()const;
+	const HistoryBlockHeader* GetNextBlock(const HistoryBlockHeader* pBlock)const;
+
+	static inline uint64_t ReadVarint(const uint8_t*& rPos)
+	{
+		uint64_t value = 0;
+		int shift = 0;
+		while( *rPos & 0x80 )
+		{
+			value |= (uint64_t)(*rPos++ & 0x7f) << shift;
+			shift += 7;
+		}
+		return value | ((uint64_t)*rPos++ << shift);
+	}
+
+	static inline int64_t ReadZigzag(const uint8_t*& rPos)
+	{
+		const uint64_t value = ReadVarint(rPos);
+		return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+	}
+};
+
+template<typename FUNCTION> size_t HistoryReader::ScanColumn(HistorySeries pSeries,HistoryColumn pColumn,std::time_t pFrom,std::time_t pTo,FUNCTION pFunction)const
+{
+	const double scale = 1.0 / GetHistoryColumnScale(pColumn);
+	size_t count = 0;
+	for( const HistoryBlockHeader* block = GetFirstBlock() ; block != nullptr ; block = GetNextBlock(block) )
+	{
+		if( block->mSeries != pSeries || block->mFetched < pFrom || block->mFetched >= pTo )
+			continue;
+
+		// Time is always the first column, find the start of the one asked for.
+		const uint8_t* timePos = (const uint8_t*)(block + 1);
+		const uint8_t* valuePos = timePos;
+		for( size_t n = 0 ; n < (size_t)pColumn ; n++ )
+		{
+			valuePos += block->mColumnSize[n];
+		}
+
+		int64_t time = 0;
+		int64_t delta = 0;
+		int64_t value = 0;
+		for( uint32_t row = 0 ; row < block->mRowCount ; row++ )
+		{
+			delta += ReadZigzag(timePos);
+			time += delta;
+			value += pColumn == HistoryColumn::TIME ? 0 : ReadZigzag(valuePos);
+			pFunction(*block,(std::time_t)time,pColumn == HistoryColumn::TIME ? (double)time : value * scale);
+		}
+		count += block->mRowCount;
+	}
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_HISTORY_H
@@ -0,0 +1,316 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <algorithm>
+#include <assert.h>
+
+#include "TinyWeatherQuery.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const size_t MAX_ENTRIES = 64;
+static const size_t FIELD_COUNT = (size_t)QueryField::CONDITION_ID + 1;
+
+ConditionClass GetConditionClass(uint32_t pID)
+{
+	switch( pID / 100 )
+	{
+	case 2:
+		return ConditionClass::THUNDERSTORM;
+	case 3:
+		return ConditionClass::DRIZZLE;
+	case 5:
+		return ConditionClass::RAIN;
+	case 6:
+		return ConditionClass::SNOW;
+	case 7:
+		return ConditionClass::ATMOSPHERE;
+	case 8:
+		return pID == 800 ? ConditionClass::CLEAR : ConditionClass::CLOUDS;
+	}
+	return ConditionClass::COUNT;
+}
+
+float GetQueryField(const WeatherData& pHour,QueryField pField)
+{
+	switch( pField )
+	{
+	case QueryField::TEMPERATURE:
+	case QueryField::TEMPERATURE_MIN:
+	case QueryField::TEMPERATURE_MAX:
+		return pHour.mTemperature.c;
+	case QueryField::FEELS_LIKE:
+		return pHour.mFeelsLike.c;
+	case QueryField::DEW_POINT:
+		return pHour.mDewPoint - 273.15f;
+	case QueryField::PRESSURE:
+		return (float)pHour.mPressure;
+	case QueryField::HUMIDITY:
+		return (float)pHour.mHumidity;
+	case QueryField::CLOUDS:
+		return (float)pHour.mClouds;
+	case QueryField::UV_INDEX:
+		return (float)pHour.mUVIndex;
+	case QueryField::VISIBILITY:
+		return (float)pHour.mVisibility;
+	case QueryField::WIND_SPEED:
+		return pHour.mWindSpeed;
+	case QueryField::WIND_GUSTS:
+		return pHour.mWindGusts;
+	case QueryField::WIND_DIRECTION:
+		return (float)pHour.mWindDirection;
+	case QueryField::PRECIPITATION_PROBABILITY:
+		return pHour.mPrecipitationProbability;
+	case QueryField::RAIN:
+		return pHour.mRain;
+	case QueryField::SNOW:
+		return pHour.mSnow;
+	case QueryField::CONDITION_ID:
+		return (float)pHour.mDisplay.mID;
+	}
+	return 0.0f;
+}
+
+float GetQueryField(const DailyWeatherData& pDay,QueryField pField)
+{
+	switch( pField )
+	{
+	case QueryField::TEMPERATURE:
+		return pDay.mTemperature.Day.c;
+	case QueryField::TEMPERATURE_MIN:
+		return pDay.mTemperature.Min.c;
+	case QueryField::TEMPERATURE_MAX:
+		return pDay.mTemperature.Max.c;
+	case QueryField::FEELS_LIKE:
+		return pDay.mFeelsLike.Day.c;
+	case QueryField::DEW_POINT:
+		return pDay.mDewPoint - 273.15f;
+	case QueryField::PRESSURE:
+		return (float)pDay.mPressure;
+	case QueryField::HUMIDITY:
+		return (float)pDay.mHumidity;
+	case QueryField::CLOUDS:
+		return (float)pDay.mClouds;
+	case QueryField::UV_INDEX:
+		return (float)pDay.mUVIndex;
+	case QueryField::VISIBILITY:
+		return 0.0f;
+	case QueryField::WIND_SPEED:
+		return pDay.mWindSpeed;
+	case QueryField::WIND_GUSTS:
+		return pDay.mWindGusts;
+	case QueryField::WIND_DIRECTION:
+		return (float)pDay.mWindDirection;
+	case QueryField::PRECIPITATION_PROBABILITY:
+		return pDay.mPrecipitationProbability;
+	case QueryField::RAIN:
+		return pDay.mRain;
+	case QueryField::SNOW:
+		return pDay.mSnow;
+	case QueryField::CONDITION_ID:
+		return (float)pDay.mDisplay.mID;
+	}
+	return 0.0f;
+}
+
+/**
+ * @brief Compares all the values with the one from the predicate, setting a bit for each that passes.
+ */
+static uint64_t Compare(const float* pValues,size_t pCount,QueryCompare pCompare,float pValue)
+{
+	uint64_t bits = 0;
+	for( size_t n = 0 ; n < pCount ; n++ )
+	{
+		bool pass = false;
+		switch( pCompare )
+		{
+		case QueryCompare::LESS:			pass = pValues[n] < pValue;		break;
+		case QueryCompare::LESS_EQUAL:		pass = pValues[n] <= pValue;	break;
+		case QueryCompare::GREATER:			pass = pValues[n] > pValue;		break;
+		case QueryCompare::GREATER_EQUAL:	pass = pValues[n] >= pValue;	break;
+		case QueryCompare::EQUAL:			pass = pValues[n] == pValue;	break;
+		case QueryCompare::NOT_EQUAL:		pass = pValues[n] != pValue;	break;
+		}
+		bits |= (uint64_t)pass << n;
+	}
+	return bits;
+}
+
+ForecastQuery& ForecastQuery::Where(QueryField pField,QueryCompare pCompare,float pValue)
+{
+	mGroups.back().push_back({Term::FIELD,pField,pCompare,pValue,ConditionClass::COUNT,false});
+	return *this;
+}
+
+ForecastQuery& ForecastQuery::Is(ConditionClass pClass)
+{
+	mGroups.back().push_back({Term::CLASS,QueryField::CONDITION_ID,QueryCompare::EQUAL,0.0f,pClass,false});
+	return *this;
+}
+
+ForecastQuery& ForecastQuery::IsNot(ConditionClass pClass)
+{
+	mGroups.back().push_back({Term::CLASS,QueryField::CONDITION_ID,QueryCompare::EQUAL,0.0f,pClass,true});
+	return *this;
+}
+
+ForecastQuery& ForecastQuery::Daylight()
+{
+	mGroups.back().push_back({Term::DAYLIGHT,QueryField::CONDITION_ID,QueryCompare::EQUAL,0.0f,ConditionClass::COUNT,false});
+	return *this;
+}
+
+ForecastQuery& ForecastQuery::Night()
+{
+	mGroups.back().push_back({Term::DAYLIGHT,QueryField::CONDITION_ID,QueryCompare::EQUAL,0.0f,ConditionClass::COUNT,true});
+	return *this;
+}
+
+ForecastQuery& ForecastQuery::Or()
+{
+	if( mGroups.back().size() > 0 )
+	{
+		mGroups.emplace_back();
+	}
+	return *this;
+}
+
+size_t QueryEngine::Compile(const ForecastQuery& pQuery)
+{
+	Plan plan;
+	plan.mTarget = pQuery.mTarget;
+	for( const auto& group : pQuery.mGroups )
+	{
+		if( group.size() == 0 )
+			continue;
+
+		std::vector<Slot> slots;
+		for( const auto& term : group )
+		{
+			switch( term.mKind )
+			{
+			case ForecastQuery::Term::FIELD:
+				slots.push_back({FindPredicate(pQuery.mTarget,term.mField,term.mCompare,term.mValue),term.mNot});
+				break;
+
+			case ForecastQuery::Term::CLASS:
+				assert( term.mClass != ConditionClass::COUNT );
+				slots.push_back({(uint32_t)term.mClass,term.mNot});
+				break;
+
+			case ForecastQuery::Term::DAYLIGHT:
+				slots.push_back({(uint32_t)DAYLIGHT_SLOT,term.mNot});
+				break;
+			}
+		}
+		plan.mGroups.push_back(slots);
+	}
+
+	mPlans.push_back(plan);
+	return mPlans.size() - 1;
+}
+
+void QueryEngine::Index(const OpenWeatherMap& pWeather,ForecastBitmaps& rBitmaps)const
+{
+	IndexEntries(QueryTarget::HOURLY,pWeather.mHourly,rBitmaps.mHourly,rBitmaps.mHourlyValid);
+	IndexEntries(QueryTarget::DAILY,pWeather.mDaily,rBitmaps.mDaily,rBitmaps.mDailyValid);
+}
+
+uint64_t QueryEngine::Match(size_t pQuery,const ForecastBitmaps& pBitmaps)const
+{
+	assert( pQuery < mPlans.size() );
+	const Plan& plan = mPlans[pQuery];
+	const std::vector<uint64_t>& bitmaps = plan.mTarget == QueryTarget::HOURLY ? pBitmaps.mHourly : pBitmaps.mDaily;
+	const uint64_t valid = plan.mTarget == QueryTarget::HOURLY ? pBitmaps.mHourlyValid : pBitmaps.mDailyValid;
+
+	uint64_t matches = 0;
+	for( const auto& group : plan.mGroups )
+	{
+		uint64_t bits = valid;
+		for( const auto& slot : group )
+		{
+			assert( slot.mSlot < bitmaps.size() );// Indexed before the query was compiled?
+			bits &= slot.mNot ? ~bitmaps[slot.mSlot] : bitmaps[slot.mSlot];
+		}
+		matches |= bits;
+	}
+	return matches;
+}
+
+uint32_t QueryEngine::FindPredicate(QueryTarget pTarget,QueryField pField,QueryCompare pCompare,float pValue)
+{
+	for( size_t n = 0 ; n < mPredicates.size() ; n++ )
+	{
+		const Predicate& p = mPredicates[n];
+		if( p.mTarget == pTarget && p.mField == pField && p.mCompare == pCompare && p.mValue == pValue )
+			return (uint32_t)(FIRST_PREDICATE_SLOT + n);
+	}
+
+	mPredicates.push_back({pTarget,pField,pCompare,pValue});
+	return (uint32_t)(FIRST_PREDICATE_SLOT + mPredicates.size() - 1);
+}
+
+template<typename ENTRIES> void QueryEngine::IndexEntries(QueryTarget pTarget,const ENTRIES& pEntries,std::vector<uint64_t>& rBitmaps,uint64_t& rValid)const
+{
+	const size_t count = std::min(MAX_ENTRIES,pEntries.size());
+	rValid = count == MAX_ENTRIES ? ~0ull : ((1ull << count) - 1);
+
+	rBitmaps.assign(FIRST_PREDICATE_SLOT + mPredicates.size(),0);
+	for( size_t n = 0 ; n < count ; n++ )
+	{
+		const DisplayData& display = pEntries[n].mDisplay;
+		const ConditionClass conditionClass = GetConditionClass(display.mID);
+		if( conditionClass != ConditionClass::COUNT )
+		{
+			rBitmaps[(size_t)conditionClass] |= 1ull << n;
+		}
+
+		const std::string& icon = display.GetIcon();
+		if( icon.size() > 0 && icon.back() == 'd' )
+		{
+			rBitmaps[DAYLIGHT_SLOT] |= 1ull << n;
+		}
+	}
+
+	// Pull out each field the first time a predicate wants it, then compare the lot in one go.
+	float values[FIELD_COUNT][MAX_ENTRIES];
+	bool read[FIELD_COUNT] = {};
+	for( size_t p = 0 ; p < mPredicates.size() ; p++ )
+	{
+		const Predicate& predicate = mPredicates[p];
+		if( predicate.mTarget != pTarget )
+			continue;
+
+		const size_t field = (size_t)predicate.mField;
+		if( read[field] == false )
+		{
+			for( size_t n = 0 ; n < count ; n++ )
+			{
+				values[field][n] = GetQueryField(pEntries[n],predicate.mField);
+			}
+			read[field] = true;
+		}
+
+		rBitmaps[FIRST_PREDICATE_SLOT + p] = Compare(values[field],count,predicate.mCompare,predicate.mValue);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
@@ -0,0 +1,226 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_QUERY_H
+#define TINY_WEATHER_QUERY_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The fields a query can test. Temperatures are in celsius.
+ * For daily entries TEMPERATURE and FEELS_LIKE are the day values, for hourly entries the min and max are the temperature.
+ */
+enum struct QueryField
+{
+	TEMPERATURE,
+	TEMPERATURE_MIN,
+	TEMPERATURE_MAX,
+	FEELS_LIKE,
+	DEW_POINT,
+	PRESSURE,
+	HUMIDITY,
+	CLOUDS,
+	UV_INDEX,
+	VISIBILITY,					//!< Hourly only, zero for daily.
+	WIND_SPEED,
+	WIND_GUSTS,
+	WIND_DIRECTION,
+	PRECIPITATION_PROBABILITY,	//!< 0 to 1
+	RAIN,
+	SNOW,
+	CONDITION_ID
+};
+
+enum struct QueryCompare
+{
+	LESS,
+	LESS_EQUAL,
+	GREATER,
+	GREATER_EQUAL,
+	EQUAL,
+	NOT_EQUAL
+};
+
+/**
+ * @brief The groups of the weather condition ids, https://openweathermap.org/weather-conditions
+ */
+enum struct ConditionClass
+{
+	THUNDERSTORM,	//!< 2xx
+	DRIZZLE,		//!< 3xx
+	RAIN,			//!< 5xx
+	SNOW,			//!< 6xx
+	ATMOSPHERE,		//!< 7xx, mist, fog, dust and the like.
+	CLEAR,			//!< 800
+	CLOUDS,			//!< 80x
+	COUNT
+};
+
+/**
+ * @brief The class a weather condition id is in, ConditionClass::COUNT if it's not one we know.
+ */
+ConditionClass GetConditionClass(uint32_t pID);
+
+/**
+ * @brief Reads the field from an entry, in the units the queries use.
+ */
+float GetQueryField(const WeatherData& pHour,QueryField pField);
+float GetQueryField(const DailyWeatherData& pDay,QueryField pField);
+
+/**
+ * @brief Which entries a query looks at.
+ */
+enum struct QueryTarget
+{
+	HOURLY,
+	DAILY
+};
+
+/**
+ * @brief A query, built up like this and then compiled with QueryEngine::Compile.
+ *   ForecastQuery(QueryTarget::HOURLY).Where(QueryField::WIND_SPEED,QueryCompare::GREATER,10).Where(QueryField::PRECIPITATION_PROBABILITY,QueryCompare::GREATER,0.5f)
+ *   ForecastQuery(QueryTarget::HOURLY).Daylight().Is(ConditionClass::CLEAR)
+ * Each term is and'ed with the ones before, Or starts a new group of terms that is or'ed with the groups before.
+ */
+struct ForecastQuery
+{
+	struct Term
+	{
+		enum Kind {FIELD,CLASS,DAYLIGHT};
+		Kind mKind;
+		QueryField mField;
+		QueryCompare mCompare;
+		float mValue;
+		ConditionClass mClass;
+		bool mNot;
+	};
+
+	QueryTarget mTarget;
+	std::vector<std::vector<Term>> mGroups;
+
+	ForecastQuery(QueryTarget pTarget = QueryTarget::HOURLY):mTarget(pTarget),mGroups(1){}
+
+	ForecastQuery& Where(QueryField pField,QueryCompare pCompare,float pValue);
+	ForecastQuery& Is(ConditionClass pClass);
+	ForecastQuery& IsNot(ConditionClass pClass);
+	ForecastQuery& Daylight();	//!< The icon is a day one, it ends in 'd'.
+	ForecastQuery& Night();
+	ForecastQuery& Or();
+};
+
+/**
+ * @brief The bitmaps of one location's forecast, built by QueryEngine::Index each time the weather is processed.
+ * Bit n is for mHourly[n] or mDaily[n], entries past the 64th are not indexed.
+ */
+struct ForecastBitmaps
+{
+	std::vector<uint64_t> mHourly;	//!< One for each class, then daylight, then each predicate in the engine.
+	std::vector<uint64_t> mDaily;
+	uint64_t mHourlyValid = 0;		//!< A bit for each entry there is.
+	uint64_t mDailyValid = 0;
+};
+
+/**
+ * @brief Runs queries over the forecasts of lots of locations.
+ * Compile turns each query into a plan, the comparisons in all the plans are kept in one table with repeats
+ * merged. When a location's weather is processed Index tests each comparison once against each entry and
+ * stores the results as a 64 bit mask, along with masks for each condition class and for daylight.
+ * Running a query is then just and'ing and or'ing a few of those masks, so asking the same question of
+ * thousands of locations costs a handful of instructions each and does not touch the forecast data at all.
+ * Compile all the queries before indexing, a location indexed before a query was added has to be indexed again.
+ */
+class QueryEngine
+{
+public:
+	/**
+	 * @brief Compiles the query.
+	 * @return size_t The handle to pass to Match.
+	 */
+	size_t Compile(const ForecastQuery& pQuery);
+
+	/**
+	 * @brief Builds the bitmaps for the location, reusing the memory of the ones passed in.
+	 */
+	void Index(const OpenWeatherMap& pWeather,ForecastBitmaps& rBitmaps)const;
+
+	/**
+	 * @brief Runs the query against the indexed location.
+	 * @return uint64_t Bit n set if hourly or daily entry n matches.
+	 */
+	uint64_t Match(size_t pQuery,const ForecastBitmaps& pBitmaps)const;
+
+	/**
+	 * @brief Index of the first match at or after pFrom, or -1 if there is not one.
+	 * Use with OpenWeatherMap::mHourlyIndex to find the next hour from now that matches.
+	 */
+	static int GetFirst(uint64_t pMatches,size_t pFrom = 0)
+	{
+		const uint64_t from = pFrom < 64 ? pMatches & (~0ull << pFrom) : 0;
+		return from ? __builtin_ctzll(from) : -1;
+	}
+
+	static int GetCount(uint64_t pMatches){return __builtin_popcountll(pMatches);}
+
+	size_t GetPredicateCount()const{return mPredicates.size();}
+
+private:
+	static const size_t DAYLIGHT_SLOT = (size_t)ConditionClass::COUNT;
+	static const size_t FIRST_PREDICATE_SLOT = DAYLIGHT_SLOT + 1;
+
+	struct Predicate
+	{
+		QueryTarget mTarget;
+		QueryField mField;
+		QueryCompare mCompare;
+		float mValue;
+	};
+
+	/**
+	 * @brief A bitmap used in a plan, and if it's inverted.
+	 */
+	struct Slot
+	{
+		uint32_t mSlot;
+		bool mNot;
+	};
+
+	struct Plan
+	{
+		QueryTarget mTarget;
+		std::vector<std::vector<Slot>> mGroups;
+	};
+
+	std::vector<Predicate> mPredicates;
+	std::vector<Plan> mPlans;
+
+	uint32_t FindPredicate(QueryTarget pTarget,QueryField pField,QueryCompare pCompare,float pValue);
+	template<typename ENTRIES> void IndexEntries(QueryTarget pTarget,const ENTRIES& pEntries,std::vector<uint64_t>& rBitmaps,uint64_t& rValid)const;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_QUERY_H
@@ -0,0 +1,276 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <algorithm>
+#include <assert.h>
+
+#include "TinyWeatherRules.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const std::time_t ONE_MINUTE = 60;
+
+static bool Compare(float pValue,QueryCompare pCompare,float pWith)
+{
+	switch( pCompare )
+	{
+	case QueryCompare::LESS:			return pValue < pWith;
+	case QueryCompare::LESS_EQUAL:		return pValue <= pWith;
+	case QueryCompare::GREATER:			return pValue > pWith;
+	case QueryCompare::GREATER_EQUAL:	return pValue >= pWith;
+	case QueryCompare::EQUAL:			return pValue == pWith;
+	case QueryCompare::NOT_EQUAL:		return pValue != pWith;
+	}
+	return false;
+}
+
+WeatherRule WeatherRule::Current(QueryField pField,QueryCompare pCompare,float pValue)
+{
+	WeatherRule rule;
+	rule.mSource = RuleSource::CURRENT;
+	rule.mField = pField;
+	rule.mCompare = pCompare;
+	rule.mValue = pValue;
+	rule.mCount = 1;
+	return rule;
+}
+
+WeatherRule WeatherRule::Hourly(QueryField pField,QueryCompare pCompare,float pValue,int pHours)
+{
+	WeatherRule rule = Current(pField,pCompare,pValue);
+	rule.mSource = RuleSource::HOURLY;
+	rule.mCount = std::max(1,pHours);
+	return rule;
+}
+
+WeatherRule WeatherRule::Daily(QueryField pField,QueryCompare pCompare,float pValue,int pDays)
+{
+	WeatherRule rule = Current(pField,pCompare,pValue);
+	rule.mSource = RuleSource::DAILY;
+	rule.mCount = std::max(1,pDays);
+	return rule;
+}
+
+WeatherRule WeatherRule::Nowcast(float pThreshold,int pMinutes)
+{
+	WeatherRule rule = Current(QueryField::RAIN,QueryCompare::GREATER,pThreshold);
+	rule.mSource = RuleSource::NOWCAST;
+	rule.mCount = std::max(1,pMinutes);
+	return rule;
+}
+
+size_t RuleEngine::Add(const WeatherRule& pRule)
+{
+	const size_t handle = mRules.size();
+	mRules.push_back(pRule);
+
+	const size_t count = std::min(MAX_ENTRIES,(size_t)std::max(1,pRule.mCount));
+	mWindows.push_back(count == MAX_ENTRIES ? ~0ull : ((1ull << count) - 1));
+
+	mRulesByChange[(size_t)pRule.mSource][GetChangedBit(pRule.mField)].push_back(handle);
+	return handle;
+}
+
+size_t RuleEngine::Update(const OpenWeatherMap& pWeather,const ForecastChanges& pChanges,RuleState& rState,std::vector<RuleEvent>& rEvents)const
+{
+	// A new location, or rules added since the last Update, have everything checked.
+	const bool all = rState.mActive.size() != mRules.size();
+	rState.mActive.resize(mRules.size(),false);
+
+	size_t evaluated = 0;
+	const std::time_t now = pWeather.mCurrent.mTime.mUTC;
+
+	// Current, just the bits that changed.
+	const uint32_t current = all ? CHANGED_ALL : pChanges.mCurrent;
+	for( size_t bit = 0 ; bit < CHANGED_BITS ; bit++ )
+	{
+		if( (current & (1u << bit)) == 0 )
+			continue;
+
+		for( size_t rule : mRulesByChange[(size_t)RuleSource::CURRENT][bit] )
+		{
+			const WeatherRule& r = mRules[rule];
+			const float value = GetQueryField(pWeather.mCurrent,r.mField);
+			SetActive(rule,Compare(value,r.mCompare,r.mValue),now,value,rState,rEvents);
+			evaluated++;
+		}
+	}
+
+	// Hourly and daily, only when the window has moved or an entry in it changed.
+	const std::time_t firstHour = pWeather.mHourly.size() > 0 ? pWeather.mHourly[0].mTime.mUTC : 0;
+	const std::time_t firstDay = pWeather.mDaily.size() > 0 ? pWeather.mDaily[0].mTime.mUTC : 0;
+	const bool allHourly = all || firstHour != rState.mFirstHour || pWeather.mHourly.size() != rState.mHourlyCount;
+	const bool allDaily = all || firstDay != rState.mFirstDay || pWeather.mDaily.size() != rState.mDailyCount;
+	rState.mFirstHour = firstHour;
+	rState.mFirstDay = firstDay;
+	rState.mHourlyCount = pWeather.mHourly.size();
+	rState.mDailyCount = pWeather.mDaily.size();
+
+	evaluated += UpdateEntries(RuleSource::HOURLY,pWeather.mHourly,pChanges.mHourly,allHourly,pWeather,rState,rEvents);
+	evaluated += UpdateEntries(RuleSource::DAILY,pWeather.mDaily,pChanges.mDaily,allDaily,pWeather,rState,rEvents);
+
+	// Nowcast, there are no changes kept for the minutely data and the lookups are cheap, so every time.
+	if( pWeather.mNowcast.mCount > 0 || all )
+	{
+		for( const auto& rules : mRulesByChange[(size_t)RuleSource::NOWCAST] )
+		{
+			for( size_t rule : rules )
+			{
+				std::time_t time;
+				float value;
+				const bool active = EvaluateNowcast(mRules[rule],pWeather,time,value);
+				SetActive(rule,active,time,value,rState,rEvents);
+				evaluated++;
+			}
+		}
+	}
+
+	return evaluated;
+}
+
+size_t RuleEngine::GetChangedBit(QueryField pField)
+{
+	uint32_t changed = CHANGED_CONDITION;
+	switch( pField )
+	{
+	case QueryField::TEMPERATURE:
+	case QueryField::TEMPERATURE_MIN:
+	case QueryField::TEMPERATURE_MAX:
+	case QueryField::FEELS_LIKE:
+	case QueryField::DEW_POINT:
+		changed = CHANGED_TEMPERATURE;
+		break;
+	case QueryField::PRESSURE:
+		changed = CHANGED_PRESSURE;
+		break;
+	case QueryField::HUMIDITY:
+		changed = CHANGED_HUMIDITY;
+		break;
+	case QueryField::CLOUDS:
+		changed = CHANGED_CLOUDS;
+		break;
+	case QueryField::UV_INDEX:
+		changed = CHANGED_UV_INDEX;
+		break;
+	case QueryField::VISIBILITY:
+		changed = CHANGED_VISIBILITY;
+		break;
+	case QueryField::WIND_SPEED:
+	case QueryField::WIND_GUSTS:
+	case QueryField::WIND_DIRECTION:
+		changed = CHANGED_WIND;
+		break;
+	case QueryField::PRECIPITATION_PROBABILITY:
+	case QueryField::RAIN:
+	case QueryField::SNOW:
+		changed = CHANGED_PRECIPITATION;
+		break;
+	case QueryField::CONDITION_ID:
+		changed = CHANGED_CONDITION;
+		break;
+	}
+	assert( __builtin_ctz(changed) < (int)CHANGED_BITS );
+	return (size_t)__builtin_ctz(changed);
+}
+
+template<typename ENTRIES,typename CHANGES> size_t RuleEngine::UpdateEntries(RuleSource pSource,const ENTRIES& pEntries,const CHANGES& pChanges,bool pAll,const OpenWeatherMap& pWeather,RuleState& rState,std::vector<RuleEvent>& rEvents)const
+{
+	// Which entries changed for each bit, so a rule can be skipped with one and against its window.
+	uint64_t changed[CHANGED_BITS] = {};
+	if( pAll == false )
+	{
+		const size_t count = std::min(MAX_ENTRIES,std::min(pEntries.size(),pChanges.size()));
+		for( size_t n = 0 ; n < count ; n++ )
+		{
+			const uint32_t bits = pChanges[n];
+			for( size_t bit = 0 ; bit < CHANGED_BITS ; bit++ )
+			{
+				changed[bit] |= (uint64_t)((bits >> bit) & 1) << n;
+			}
+		}
+	}
+
+	size_t evaluated = 0;
+	for( size_t bit = 0 ; bit < CHANGED_BITS ; bit++ )
+	{
+		if( pAll == false && changed[bit] == 0 )
+			continue;
+
+		for( size_t rule : mRulesByChange[(size_t)pSource][bit] )
+		{
+			if( pAll == false && (changed[bit] & mWindows[rule]) == 0 )
+				continue;
+
+			std::time_t time = pWeather.mCurrent.mTime.mUTC;
+			float value = 0.0f;
+			const bool active = Evaluate(mRules[rule],pEntries,time,value);
+			SetActive(rule,active,time,value,rState,rEvents);
+			evaluated++;
+		}
+	}
+	return evaluated;
+}
+
+template<typename ENTRIES> bool RuleEngine::Evaluate(const WeatherRule& pRule,const ENTRIES& pEntries,std::time_t& rTime,float& rValue)const
+{
+	const size_t count = std::min((size_t)pRule.mCount,pEntries.size());
+	for( size_t n = 0 ; n < count ; n++ )
+	{
+		const float value = GetQueryField(pEntries[n],pRule.mField);
+		if( Compare(value,pRule.mCompare,pRule.mValue) )
+		{
+			rTime = pEntries[n].mTime.mUTC;
+			rValue = value;
+			return true;
+		}
+	}
+
+	rValue = count > 0 ? GetQueryField(pEntries[0],pRule.mField) : 0.0f;
+	return false;
+}
+
+bool RuleEngine::EvaluateNowcast(const WeatherRule& pRule,const OpenWeatherMap& pWeather,std::time_t& rTime,float& rValue)const
+{
+	const MinutelyNowcast& nowcast = pWeather.mNowcast;
+	const std::time_t now = pWeather.mCurrent.mTime.mUTC;
+	const int minutes = nowcast.GetMinutesUntilAbove(now,pRule.mValue);
+	if( minutes >= 0 && minutes < pRule.mCount )
+	{
+		rTime = now + (minutes * ONE_MINUTE);
+		rValue = nowcast.GetMax(rTime,1);
+		return true;
+	}
+
+	rTime = now;
+	rValue = nowcast.GetMax(now,1);
+	return false;
+}
+
+void RuleEngine::SetActive(size_t pRule,bool pActive,std::time_t pTime,float pValue,RuleState& rState,std::vector<RuleEvent>& rEvents)const
+{
+	if( rState.mActive[pRule] == pActive )
+		return;
+
+	rState.mActive[pRule] = pActive;
+	rEvents.push_back({pRule,pActive ? RuleEdge::STARTED : RuleEdge::CLEARED,pTime,pValue});
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
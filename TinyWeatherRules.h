@@ -0,0 +1,153 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_RULES_H
+#define TINY_WEATHER_RULES_H
+
+#include <vector>
+#include <ctime>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+#include "TinyWeatherQuery.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief What part of the forecast a rule looks at.
+ */
+enum struct RuleSource
+{
+	CURRENT,
+	HOURLY,
+	DAILY,
+	NOWCAST
+};
+
+/**
+ * @brief A condition you want to be told about when it starts and when it clears, make them with the functions below.
+ * Hourly and daily rules are true when any of the first mCount entries match, the first entry being the current hour or today.
+ */
+struct WeatherRule
+{
+	RuleSource mSource = RuleSource::CURRENT;
+	QueryField mField = QueryField::TEMPERATURE;
+	QueryCompare mCompare = QueryCompare::GREATER;
+	float mValue = 0.0f;
+	int mCount = 1;		//!< Hours, days or minutes to look ahead.
+
+	/**
+	 * @brief The current weather, so 'gusts over 20m/s now' is Current(QueryField::WIND_GUSTS,QueryCompare::GREATER,20).
+	 */
+	static WeatherRule Current(QueryField pField,QueryCompare pCompare,float pValue);
+
+	/**
+	 * @brief Any of the next pHours, so 'frost tonight' is Hourly(QueryField::TEMPERATURE,QueryCompare::LESS,0,12).
+	 */
+	static WeatherRule Hourly(QueryField pField,QueryCompare pCompare,float pValue,int pHours);
+
+	/**
+	 * @brief Any of the next pDays, today being the first.
+	 */
+	static WeatherRule Daily(QueryField pField,QueryCompare pCompare,float pValue,int pDays);
+
+	/**
+	 * @brief The precipitation goes over pThreshold mm/h within pMinutes, so 'rain starting within the hour' is Nowcast(0,60).
+	 */
+	static WeatherRule Nowcast(float pThreshold,int pMinutes);
+};
+
+enum struct RuleEdge
+{
+	STARTED,	//!< Was false, now true.
+	CLEARED		//!< Was true, now false.
+};
+
+struct RuleEvent
+{
+	size_t mRule;			//!< The handle from RuleEngine::Add.
+	RuleEdge mEdge;
+	std::time_t mTime;		//!< UTC. When started, the time of the first entry or minute that matches, when cleared the current time.
+	float mValue;			//!< When started, the value that matched, when cleared the value now. For nowcast rules this is mm/h.
+};
+
+/**
+ * @brief What a RuleEngine remembers about one location between refreshes.
+ */
+struct RuleState
+{
+	std::vector<bool> mActive;		//!< One for each rule, true if it was true last time.
+	std::time_t mFirstHour = 0;		//!< mHourly[0] last time, if it moves all hourly rules are checked again.
+	std::time_t mFirstDay = 0;
+	size_t mHourlyCount = 0;
+	size_t mDailyCount = 0;
+};
+
+/**
+ * @brief Runs a set of rules against the forecasts of lots of locations, telling you when each one starts or clears.
+ * Add the rules once, then call Update with the changes passed to the OpenWeatherMap::Get callback each refresh.
+ * Rules are filed by the CHANGED_ bit of the field they read, so Update only looks at rules where an entry inside
+ * their window changed in a way they care about. A refresh where only the wind moved leaves every temperature rule
+ * alone. All the hourly or daily rules are checked when the forecast moves on an hour or a day, as their windows
+ * have moved. Nowcast rules are checked every refresh that has minutely data, they are a couple of lookups each.
+ * Changes under the ChangeThresholds set on the OpenWeatherMap are not seen, so keep those small if you have rules
+ * close to them.
+ */
+class RuleEngine
+{
+public:
+	/**
+	 * @brief Adds a rule, do this before calling Update.
+	 * @return size_t The handle that is in the events for it.
+	 */
+	size_t Add(const WeatherRule& pRule);
+
+	/**
+	 * @brief Checks the rules that could have changed and adds an event to rEvents for each that started or cleared.
+	 * The first Update for a location checks them all, and reports the ones that are true as started.
+	 * @return size_t How many rules were checked.
+	 */
+	size_t Update(const OpenWeatherMap& pWeather,const ForecastChanges& pChanges,RuleState& rState,std::vector<RuleEvent>& rEvents)const;
+
+	size_t GetRuleCount()const{return mRules.size();}
+	const WeatherRule& GetRule(size_t pRule)const{return mRules[pRule];}
+
+private:
+	static const size_t CHANGED_BITS = 10;		//!< CHANGED_TIME up to CHANGED_CONDITION.
+	static const size_t MAX_ENTRIES = 64;
+	static const size_t SOURCES = (size_t)RuleSource::NOWCAST + 1;
+
+	std::vector<WeatherRule> mRules;
+	std::vector<uint64_t> mWindows;								//!< The entries each rule looks at, one bit each.
+	std::vector<size_t> mRulesByChange[SOURCES][CHANGED_BITS];	//!< Rules filed by their source and the bit of their field.
+
+	static size_t GetChangedBit(QueryField pField);
+
+	template<typename ENTRIES,typename CHANGES> size_t UpdateEntries(RuleSource pSource,const ENTRIES& pEntries,const CHANGES& pChanges,bool pAll,const OpenWeatherMap& pWeather,RuleState& rState,std::vector<RuleEvent>& rEvents)const;
+	template<typename ENTRIES> bool Evaluate(const WeatherRule& pRule,const ENTRIES& pEntries,std::time_t& rTime,float& rValue)const;
+	bool EvaluateNowcast(const WeatherRule& pRule,const OpenWeatherMap& pWeather,std::time_t& rTime,float& rValue)const;
+	void SetActive(size_t pRule,bool pActive,std::time_t pTime,float pValue,RuleState& rState,std::vector<RuleEvent>& rEvents)const;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_RULES_H
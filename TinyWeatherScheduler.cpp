@@ -0,0 +1,248 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <algorithm>
+#include <assert.h>
+
+#include "TinyWeatherScheduler.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void TokenBucket::Set(uint32_t pLimit,std::time_t pWindowSeconds,std::time_t pNow)
+{
+	// Burst plus what trickles in over the window must never be more than the limit.
+	// Keeping the burst small is what stops everything going at the top of the hour.
+	mCapacity = std::max(1.0,pLimit / 10.0);
+	mRatePerSecond = std::max(0.0,(pLimit - mCapacity) / (double)pWindowSeconds);
+	mTokens = mCapacity;
+	mLastFill = pNow;
+}
+
+void TokenBucket::Fill(std::time_t pNow)
+{
+	if( pNow < mLastFill )
+	{// Clock went backwards, start again from here.
+		mLastFill = pNow;
+	}
+	else if( pNow > mLastFill )
+	{
+		mTokens = std::min(mCapacity,mTokens + (pNow - mLastFill) * mRatePerSecond);
+		mLastFill = pNow;
+	}
+}
+
+RefreshScheduler::RefreshScheduler(uint32_t pCallsPerMinute,uint32_t pCallsPerDay,float pJitter):
+	mJitter(pJitter),
+	mRandom(std::random_device()())
+{
+	assert( pCallsPerMinute > 0 );
+	assert( pCallsPerDay > 0 );
+
+	// Time only comes from the pNow passed to GetDue. The buckets start full, so the first fill just starts their clock.
+	mMinuteQuota.Set(pCallsPerMinute,60,0);
+	mDayQuota.Set(pCallsPerDay,60*60*24,0);
+}
+
+void RefreshScheduler::AddLocation(uint32_t pID,double pLatitude,double pLongitude,std::time_t pTargetFreshness,float pWeight)
+{
+	assert( pTargetFreshness > 0 );
+	std::lock_guard<std::mutex> lock(mLock);
+
+	const auto found = mIndex.find(pID);
+	if( found != mIndex.end() )
+	{
+		RefreshLocation& loc = mLocations[found->second];
+		loc.mLatitude = pLatitude;
+		loc.mLongitude = pLongitude;
+		loc.mTargetFreshness = pTargetFreshness;
+		loc.mWeight = pWeight;
+		return;
+	}
+
+	RefreshLocation loc;
+	loc.mID = pID;
+	loc.mLatitude = pLatitude;
+	loc.mLongitude = pLongitude;
+	loc.mTargetFreshness = pTargetFreshness;
+	loc.mWeight = pWeight;
+	loc.mLastSuccess = 0;
+	loc.mNextDue = 0;
+	loc.mRetryAfter = 0;
+	loc.mFailures = 0;
+	loc.mInFlight = false;
+
+	mIndex[pID] = mLocations.size();
+	mLocations.push_back(loc);
+}
+
+bool RefreshScheduler::RemoveLocation(uint32_t pID)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+
+	const auto found = mIndex.find(pID);
+	if( found == mIndex.end() )
+		return false;
+
+	// Swap with the last one so the vector stays packed.
+	const size_t index = found->second;
+	mIndex.erase(found);
+	if( index != mLocations.size() - 1 )
+	{
+		mLocations[index] = mLocations.back();
+		mIndex[mLocations[index].mID] = index;
+	}
+	mLocations.pop_back();
+	return true;
+}
+
+bool RefreshScheduler::SetWeight(uint32_t pID,float pWeight)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+
+	const auto found = mIndex.find(pID);
+	if( found == mIndex.end() )
+		return false;
+
+	mLocations[found->second].mWeight = pWeight;
+	return true;
+}
+
+size_t RefreshScheduler::GetLocationCount()const
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mLocations.size();
+}
+
+size_t RefreshScheduler::GetDue(std::time_t pNow,std::vector<uint32_t>& rDue)
+{
+	rDue.clear();
+	std::lock_guard<std::mutex> lock(mLock);
+
+	mMinuteQuota.Fill(pNow);
+	mDayQuota.Fill(pNow);
+	const size_t budget = (size_t)std::min(mMinuteQuota.mTokens,mDayQuota.mTokens);
+	if( budget == 0 )
+		return 0;
+
+	// Due locations go first, then spare quota goes to those nearest to going stale.
+	// Both ordered by how stale they are, squared so that old data climbs quickly, times their weight.
+	mCandidates.clear();
+	for( size_t n = 0 ; n < mLocations.size() ; n++ )
+	{
+		const RefreshLocation& loc = mLocations[n];
+		if( loc.mInFlight || pNow < loc.mRetryAfter )
+			continue;
+
+		const float staleness = GetStaleness(loc,pNow);
+		const bool due = pNow >= loc.mNextDue;
+		if( due || staleness >= mSpareStaleness )
+		{
+			const float priority = loc.mWeight * staleness * staleness;
+			mCandidates.push_back({due,priority,n});
+		}
+	}
+
+	const size_t count = std::min(budget,mCandidates.size());
+	std::partial_sort(mCandidates.begin(),mCandidates.begin() + count,mCandidates.end());
+
+	for( size_t n = 0 ; n < count ; n++ )
+	{
+		RefreshLocation& loc = mLocations[mCandidates[n].mIndex];
+		loc.mInFlight = true;
+		rDue.push_back(loc.mID);
+	}
+
+	mMinuteQuota.mTokens -= count;
+	mDayQuota.mTokens -= count;
+
+	return count;
+}
+
+void RefreshScheduler::ReportResult(uint32_t pID,bool pDownloadedOk,std::time_t pNow)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+
+	const auto found = mIndex.find(pID);
+	if( found == mIndex.end() )
+		return;// Removed whilst in flight.
+
+	RefreshLocation& loc = mLocations[found->second];
+	loc.mInFlight = false;
+	if( pDownloadedOk )
+	{
+		loc.mLastSuccess = pNow;
+		loc.mFailures = 0;
+		loc.mRetryAfter = 0;
+		// Due a little early by a random amount, stops locations added together staying in lock step.
+		loc.mNextDue = pNow + loc.mTargetFreshness - Jitter(loc.mTargetFreshness);
+	}
+	else
+	{
+		loc.mFailures++;
+		const uint32_t shift = std::min(loc.mFailures - 1,(uint32_t)16);
+		const std::time_t backoff = std::min(mMaxBackoff,mMinBackoff << shift);
+		loc.mRetryAfter = pNow + backoff + Jitter(backoff);
+	}
+}
+
+void RefreshScheduler::Update(std::time_t pNow,std::function<bool(const RefreshLocation& pLocation)> pFetch)
+{
+	assert( pFetch != nullptr );
+
+	std::vector<uint32_t> due;
+	GetDue(pNow,due);
+	for( uint32_t id : due )
+	{
+		RefreshLocation loc;
+		if( GetLocation(id,loc) )
+		{
+			ReportResult(id,pFetch(loc),pNow);
+		}
+	}
+}
+
+bool RefreshScheduler::GetLocation(uint32_t pID,RefreshLocation& rLocation)const
+{
+	std::lock_guard<std::mutex> lock(mLock);
+
+	const auto found = mIndex.find(pID);
+	if( found == mIndex.end() )
+		return false;
+
+	rLocation = mLocations[found->second];
+	return true;
+}
+
+std::time_t RefreshScheduler::Jitter(std::time_t pSeconds)
+{
+	std::uniform_real_distribution<float> range(0.0f,mJitter);
+	return (std::time_t)(pSeconds * range(mRandom));
+}
+
+float RefreshScheduler::GetStaleness(const RefreshLocation& pLocation,std::time_t pNow)
+{
+	if( pLocation.mLastSuccess == 0 )
+		return 1000.0f;// Never fetched, nothing to show, as bad as it gets.
+
+	return (float)(pNow - pLocation.mLastSuccess) / (float)pLocation.mTargetFreshness;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
@@ -0,0 +1,157 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_SCHEDULER_H
+#define TINY_WEATHER_SCHEDULER_H
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <random>
+#include <functional>
+#include <ctime>
+#include <stdint.h>
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief A location the scheduler keeps fresh.
+ */
+struct RefreshLocation
+{
+	uint32_t mID;					//!< Your id for the location, passed back when it is time to fetch it.
+	double mLatitude;
+	double mLongitude;
+	std::time_t mTargetFreshness;	//!< How old, in seconds, the data is allowed to get before it is due a refresh.
+	float mWeight;					//!< How much it matters, for example how many displays are watching it.
+
+	std::time_t mLastSuccess;		//!< When it was last fetched ok, zero if never.
+	std::time_t mNextDue;			//!< When it is next due, has jitter applied so a fleet added together does not refresh together.
+	std::time_t mRetryAfter;		//!< When failing, the time the back off ends.
+	uint32_t mFailures;				//!< Fetches failed in a row.
+	bool mInFlight;					//!< Handed out by GetDue and waiting for ReportResult.
+};
+
+/**
+ * @brief A simple token bucket, fills at a steady rate up to a small burst size.
+ */
+struct TokenBucket
+{
+	double mTokens;
+	double mCapacity;
+	double mRatePerSecond;
+	std::time_t mLastFill;
+
+	/**
+	 * @brief Sets the bucket up so that no window of pWindowSeconds ever sees more than pLimit calls.
+	 * The burst is kept to a fraction of the limit and the rest trickles in.
+	 */
+	void Set(uint32_t pLimit,std::time_t pWindowSeconds,std::time_t pNow);
+	void Fill(std::time_t pNow);
+};
+
+/**
+ * @brief Spreads the refreshing of a fleet of locations over an OpenWeather calls per minute and calls per day quota.
+ * Locations are due when they reach their target freshness, give or take some jitter. When quota is tight the
+ * locations where the data is oldest, relative to how fresh they should be, and that have the most weight go first.
+ * Spare quota is handed out to the locations that are closest to going stale.
+ * Failed fetches back off exponentially per location.
+ * Time is passed in so that it can be driven from your own loop and tested without waiting.
+ * Thread safe, results can be reported from the threads doing the fetching.
+ */
+class RefreshScheduler
+{
+public:
+	/**
+	 * @param pCallsPerMinute The plans calls per minute limit.
+	 * @param pCallsPerDay The plans calls per day limit.
+	 * @param pJitter Fraction of the target freshness used to randomise when a location is due, 0.1 is 10%.
+	 */
+	RefreshScheduler(uint32_t pCallsPerMinute,uint32_t pCallsPerDay,float pJitter = 0.1f);
+
+	/**
+	 * @brief Adds, or updates, a location. New locations are due straight away, the quota spreads them out.
+	 */
+	void AddLocation(uint32_t pID,double pLatitude,double pLongitude,std::time_t pTargetFreshness,float pWeight);
+	bool RemoveLocation(uint32_t pID);
+	bool SetWeight(uint32_t pID,float pWeight);
+	size_t GetLocationCount()const;
+
+	/**
+	 * @brief Tells you which locations to fetch now, as many as the quota allows. Best first.
+	 * The locations are marked as in flight until you call ReportResult for them.
+	 * @param pNow The time now, UTC.
+	 * @param rDue Filled with the ids of the locations to fetch, cleared first.
+	 * @return size_t The number of locations to fetch.
+	 */
+	size_t GetDue(std::time_t pNow,std::vector<uint32_t>& rDue);
+
+	/**
+	 * @brief Tells the scheduler how the fetch went, failures will back off.
+	 */
+	void ReportResult(uint32_t pID,bool pDownloadedOk,std::time_t pNow);
+
+	/**
+	 * @brief Convenience function, calls GetDue and then pFetch for each one due reporting the result.
+	 * The fetch function is called with the lock released.
+	 */
+	void Update(std::time_t pNow,std::function<bool(const RefreshLocation& pLocation)> pFetch);
+
+	/**
+	 * @brief Copies out the state of a location, returns false if not found.
+	 */
+	bool GetLocation(uint32_t pID,RefreshLocation& rLocation)const;
+
+private:
+	struct Candidate
+	{
+		bool mDue;
+		float mPriority;
+		size_t mIndex;
+		inline bool operator < (const Candidate& pOther)const // Due first, then highest priority first.
+		{
+			if( mDue != pOther.mDue )
+				return mDue;
+			return mPriority > pOther.mPriority;
+		}
+	};
+
+	const float mJitter;
+	const std::time_t mMinBackoff = 30;			//!< First retry after a failure, doubles each time.
+	const std::time_t mMaxBackoff = 60 * 60;	//!< Never wait longer than this to retry.
+	const float mSpareStaleness = 0.5f;			//!< Spare quota only goes to data that is at least this far to its target age.
+
+	mutable std::mutex mLock;
+	std::vector<RefreshLocation> mLocations;
+	std::map<uint32_t,size_t> mIndex;			//!< Location id to index into mLocations.
+	std::vector<Candidate> mCandidates;			//!< Kept to save allocating each update.
+	TokenBucket mMinuteQuota;
+	TokenBucket mDayQuota;
+	std::mt19937 mRandom;
+
+	std::time_t Jitter(std::time_t pSeconds);
+	static float GetStaleness(const RefreshLocation& pLocation,std::time_t pNow);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_SCHEDULER_H
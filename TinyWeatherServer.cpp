@@ -0,0 +1,884 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <assert.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "TinyWeatherServer.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const size_t MAX_REQUEST_SIZE = 8192;
+
+static const std::string NOT_FOUND = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+static const std::string NOT_MODIFIED = "HTTP/1.1 304 Not Modified\r\nContent-Length: 0\r\n\r\n";
+static const std::string BAD_REQUEST = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const std::string EVENT_STREAM = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+
+/**
+ * @brief Just enough of a json writer for the forecast, keeps track of when a comma is needed.
+ */
+class JsonWriter
+{
+public:
+	JsonWriter(std::string& rJson):mJson(rJson){}
+
+	/**
+	 * @brief Starts an object or array, pass nullptr for the key when it's in an array.
+	 */
+	void Open(const char* pKey,char pBracket)
+	{
+		Key(pKey);
+		mJson += pBracket;
+		mComma = false;
+	}
+
+	void Close(char pBracket)
+	{
+		mJson += pBracket;
+		mComma = true;
+	}
+
+	void Float(const char* pKey,double pValue)
+	{
+		Key(pKey);
+		char number[32];
+		// Enough digits that reading it back gives the same float.
+		snprintf(number,sizeof(number),"%.9g",std::isfinite(pValue) ? pValue : 0.0);
+		mJson += number;
+	}
+
+	void Integer(const char* pKey,int64_t pValue)
+	{
+		Key(pKey);
+		char number[32];
+		snprintf(number,sizeof(number),"%lld",(long long)pValue);
+		mJson += number;
+	}
+
+	void String(const char* pKey,const std::string& pValue)
+	{
+		Key(pKey);
+		mJson += '"';
+		for( const char c : pValue )
+		{
+			if( c == '"' || c == '\\' )
+			{
+				mJson += '\\';
+				mJson += c;
+			}
+			else if( (unsigned char)c < 0x20 )
+			{
+				char escaped[8];
+				snprintf(escaped,sizeof(escaped),"\\u%04x",(unsigned int)c);
+				mJson += escaped;
+			}
+			else
+			{
+				mJson += c;
+			}
+		}
+		mJson += '"';
+	}
+
+private:
+	std::string& mJson;
+	bool mComma = false;
+
+	void Key(const char* pKey)
+	{
+		if( mComma )
+			mJson += ',';
+		mComma = true;
+
+		if( pKey )
+		{
+			mJson += '"';
+			mJson += pKey;
+			mJson += "\":";
+		}
+	}
+};
+
+static void WriteDisplayData(JsonWriter& rJson,const DisplayData& pDisplay)
+{
+	if( pDisplay.mID == 0 && pDisplay.mCondition == 0 && pDisplay.mIcon == 0 )
+		return;
+
+	rJson.Open("weather",'[');
+		rJson.Open(nullptr,'{');
+			rJson.Integer("id",pDisplay.mID);
+			rJson.String("main",pDisplay.GetTitle());
+			rJson.String("description",pDisplay.GetDescription());
+			rJson.String("icon",pDisplay.GetIcon());
+		rJson.Close('}');
+	rJson.Close(']');
+}
+
+/**
+ * @brief The times that are not in every entry, like sunrise in the hourly forecast, are left out when zero.
+ */
+static void WriteTime(JsonWriter& rJson,const char* pKey,const WeatherTime& pTime)
+{
+	if( pTime.mUTC != 0 )
+		rJson.Integer(pKey,pTime.mUTC);
+}
+
+static void WriteWeatherData(JsonWriter& rJson,const WeatherData& pWeather,bool pCompact)
+{
+	rJson.Integer("dt",pWeather.mTime.mUTC);
+	WriteTime(rJson,"sunrise",pWeather.mSunrise);
+	WriteTime(rJson,"sunset",pWeather.mSunset);
+	rJson.Float("temp",pWeather.mTemperature.k);
+	rJson.Float("feels_like",pWeather.mFeelsLike.k);
+	rJson.Integer("humidity",pWeather.mHumidity);
+	if( pCompact == false )
+	{
+		rJson.Integer("pressure",pWeather.mPressure);
+		rJson.Float("dew_point",pWeather.mDewPoint);
+		rJson.Integer("uvi",pWeather.mUVIndex);
+		rJson.Integer("clouds",pWeather.mClouds);
+		rJson.Integer("visibility",pWeather.mVisibility);
+		rJson.Integer("wind_deg",pWeather.mWindDirection);
+	}
+	rJson.Float("wind_speed",pWeather.mWindSpeed);
+	rJson.Float("wind_gust",pWeather.mWindGusts);
+	rJson.Float("pop",pWeather.mPrecipitationProbability);
+	if( pWeather.mRain > 0.0f )
+	{
+		rJson.Open("rain",'{');
+		rJson.Float("1h",pWeather.mRain);
+		rJson.Close('}');
+	}
+	if( pWeather.mSnow > 0.0f )
+	{
+		rJson.Open("snow",'{');
+		rJson.Float("1h",pWeather.mSnow);
+		rJson.Close('}');
+	}
+	WriteDisplayData(rJson,pWeather.mDisplay);
+}
+
+static void WriteDailyWeatherData(JsonWriter& rJson,const DailyWeatherData& pDaily,bool pCompact)
+{
+	rJson.Integer("dt",pDaily.mTime.mUTC);
+	WriteTime(rJson,"sunrise",pDaily.mSunrise);
+	WriteTime(rJson,"sunset",pDaily.mSunset);
+
+	rJson.Open("temp",'{');
+		rJson.Float("morn",pDaily.mTemperature.Morning.k);
+		rJson.Float("day",pDaily.mTemperature.Day.k);
+		rJson.Float("eve",pDaily.mTemperature.Evening.k);
+		rJson.Float("night",pDaily.mTemperature.Night.k);
+		rJson.Float("min",pDaily.mTemperature.Min.k);
+		rJson.Float("max",pDaily.mTemperature.Max.k);
+	rJson.Close('}');
+
+	rJson.Integer("humidity",pDaily.mHumidity);
+	if( pCompact == false )
+	{
+		rJson.Open("feels_like",'{');
+			rJson.Float("morn",pDaily.mFeelsLike.Morning.k);
+			rJson.Float("day",pDaily.mFeelsLike.Day.k);
+			rJson.Float("eve",pDaily.mFeelsLike.Evening.k);
+			rJson.Float("night",pDaily.mFeelsLike.Night.k);
+		rJson.Close('}');
+		rJson.Integer("pressure",pDaily.mPressure);
+		rJson.Float("dew_point",pDaily.mDewPoint);
+		rJson.Integer("uvi",pDaily.mUVIndex);
+		rJson.Integer("clouds",pDaily.mClouds);
+		rJson.Integer("wind_deg",pDaily.mWindDirection);
+	}
+	rJson.Float("wind_speed",pDaily.mWindSpeed);
+	rJson.Float("wind_gust",pDaily.mWindGusts);
+	rJson.Float("pop",pDaily.mPrecipitationProbability);
+	if( pDaily.mRain > 0.0f )
+		rJson.Float("rain",pDaily.mRain);
+	if( pDaily.mSnow > 0.0f )
+		rJson.Float("snow",pDaily.mSnow);
+	WriteDisplayData(rJson,pDaily.mDisplay);
+}
+
+void WriteForecastJson(const OpenWeatherMap& pWeather,bool pCompact,std::string& rJson)
+{
+	rJson.clear();
+	JsonWriter json(rJson);
+	json.Open(nullptr,'{');
+	json.Float("lat",pWeather.mLatitude);
+	json.Float("lon",pWeather.mLongitude);
+	json.String("timezone",pWeather.mTimeZone);
+	json.Integer("timezone_offset",pWeather.mTimezoneOffset);
+
+	json.Open("current",'{');
+	WriteWeatherData(json,pWeather.mCurrent,pCompact);
+	json.Close('}');
+
+	if( pCompact == false && pWeather.mMinutely.size() > 0 )
+	{
+		json.Open("minutely",'[');
+		for( const auto& minute : pWeather.mMinutely )
+		{
+			json.Open(nullptr,'{');
+			json.Integer("dt",minute.mTime.mUTC);
+			json.Float("precipitation",minute.mPrecipitation);
+			json.Close('}');
+		}
+		json.Close(']');
+	}
+
+	const size_t hours = pCompact ? std::min(COMPACT_HOURS,pWeather.mHourly.size()) : pWeather.mHourly.size();
+	if( hours > 0 )
+	{
+		json.Open("hourly",'[');
+		for( size_t n = 0 ; n < hours ; n++ )
+		{
+			json.Open(nullptr,'{');
+			WriteWeatherData(json,pWeather.mHourly[n],pCompact);
+			json.Close('}');
+		}
+		json.Close(']');
+	}
+
+	if( pWeather.mDaily.size() > 0 )
+	{
+		json.Open("daily",'[');
+		for( const auto& day : pWeather.mDaily )
+		{
+			json.Open(nullptr,'{');
+			WriteDailyWeatherData(json,day,pCompact);
+			json.Close('}');
+		}
+		json.Close(']');
+	}
+	json.Close('}');
+}
+
+static std::string MakeResponse(const std::string& pJson,uint64_t pVersion)
+{
+	char headers[256];
+	snprintf(headers,sizeof(headers),"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\nX-Forecast-Version: %llu\r\nCache-Control: no-cache\r\n\r\n",
+		pJson.size(),(unsigned long long)pVersion);
+	return headers + pJson;
+}
+
+/**
+ * @brief Finds the parameter in the query and its value, parameters without a value, like compact, give an empty string.
+ */
+static bool FindParameter(const std::string& pQuery,const char* pName,std::string& rValue)
+{
+	const size_t length = strlen(pName);
+	size_t start = 0;
+	while( start < pQuery.size() )
+	{
+		const size_t end = std::min(pQuery.find('&',start),pQuery.size());
+		if( pQuery.compare(start,length,pName) == 0 && (start + length == end || pQuery[start + length] == '=') )
+		{
+			rValue = start + length < end ? pQuery.substr(start + length + 1,end - start - length - 1) : "";
+			return true;
+		}
+		start = end + 1;
+	}
+	return false;
+}
+
+/**
+ * @brief True if one of the comma separated values of the header is pToken. Header names and these values are not case sensitive.
+ */
+static bool HasHeaderToken(const std::string& pRequest,const char* pName,const char* pToken)
+{
+	const size_t nameLength = strlen(pName);
+	const size_t tokenLength = strlen(pToken);
+
+	// Skip the request line, then one header per line.
+	size_t line = pRequest.find("\r\n");
+	while( line != std::string::npos )
+	{
+		line += 2;
+		const size_t lineEnd = std::min(pRequest.find("\r\n",line),pRequest.size());
+		const size_t colon = pRequest.find(':',line);
+		if( colon < lineEnd && colon - line == nameLength && strncasecmp(pRequest.c_str() + line,pName,nameLength) == 0 )
+		{
+			size_t start = colon + 1;
+			while( start < lineEnd )
+			{
+				const size_t end = std::min(pRequest.find(',',start),lineEnd);
+				size_t first = start;
+				size_t last = end;
+				while( first < last && (pRequest[first] == ' ' || pRequest[first] == '\t') ){first++;}
+				while( last > first && (pRequest[last-1] == ' ' || pRequest[last-1] == '\t') ){last--;}
+				if( last - first == tokenLength && strncasecmp(pRequest.c_str() + first,pToken,tokenLength) == 0 )
+					return true;
+				start = end + 1;
+			}
+		}
+		line = lineEnd < pRequest.size() ? lineEnd : std::string::npos;
+	}
+	return false;
+}
+
+ForecastServer::ForecastServer():
+	mStop(false),
+	mConnectionCount(0),
+	mRequestCount(0),
+	mBytesSent(0),
+	mPublishCount(0),
+	mWaitingCount(0)
+{
+	mEpoll = epoll_create1(EPOLL_CLOEXEC);
+	mWake = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+	if( mEpoll < 0 || mWake < 0 )
+	{
+		std::cerr << "ForecastServer failed to create epoll or eventfd, " << strerror(errno) << "\n";
+		return;
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = mWake;
+	epoll_ctl(mEpoll,EPOLL_CTL_ADD,mWake,&event);
+}
+
+ForecastServer::~ForecastServer()
+{
+	for( auto& connection : mConnections )
+	{
+		if( connection )
+		{
+			close(connection->mSocket);
+		}
+	}
+
+	for( int listening : mListening )
+	{
+		close(listening);
+	}
+
+	if( mUnixPath.size() > 0 )
+	{
+		unlink(mUnixPath.c_str());
+	}
+
+	if( mWake >= 0 )
+		close(mWake);
+	if( mEpoll >= 0 )
+		close(mEpoll);
+}
+
+bool ForecastServer::Listen(uint16_t pPort,const std::string& pAddress)
+{
+	const int listening = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+	if( listening < 0 )
+	{
+		std::cerr << "ForecastServer failed to create socket, " << strerror(errno) << "\n";
+		return false;
+	}
+
+	const int reuse = 1;
+	setsockopt(listening,SOL_SOCKET,SO_REUSEADDR,&reuse,sizeof(reuse));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(pPort);
+	socklen_t size = sizeof(address);
+	if( inet_pton(AF_INET,pAddress.c_str(),&address.sin_addr) != 1 ||
+		bind(listening,(sockaddr*)&address,sizeof(address)) != 0 ||
+		listen(listening,SOMAXCONN) != 0 ||
+		getsockname(listening,(sockaddr*)&address,&size) != 0 )
+	{
+		std::cerr << "ForecastServer failed to listen on " << pAddress << ":" << pPort << ", " << strerror(errno) << "\n";
+		close(listening);
+		return false;
+	}
+
+	mPort = ntohs(address.sin_port);
+	return AddListener(listening);
+}
+
+bool ForecastServer::ListenUnix(const std::string& pPath)
+{
+	sockaddr_un address = {};
+	if( pPath.size() >= sizeof(address.sun_path) )
+	{
+		std::cerr << "ForecastServer unix socket path is too long, " << pPath << "\n";
+		return false;
+	}
+
+	const int listening = socket(AF_UNIX,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+	if( listening < 0 )
+	{
+		std::cerr << "ForecastServer failed to create socket, " << strerror(errno) << "\n";
+		return false;
+	}
+
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,pPath.c_str());
+	unlink(pPath.c_str());
+	if( bind(listening,(sockaddr*)&address,sizeof(address)) != 0 || listen(listening,SOMAXCONN) != 0 )
+	{
+		std::cerr << "ForecastServer failed to listen on " << pPath << ", " << strerror(errno) << "\n";
+		close(listening);
+		return false;
+	}
+
+	mUnixPath = pPath;
+	return AddListener(listening);
+}
+
+void ForecastServer::Publish(const std::string& pName,const OpenWeatherMap& pWeather)
+{
+	uint64_t version;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		version = mNextVersion++;
+	}
+
+	// Done here, on the caller's thread, so the event loop only ever sends.
+	std::shared_ptr<Payload> payload = std::make_shared<Payload>();
+	payload->mVersion = version;
+
+	std::string json;
+	WriteForecastJson(pWeather,false,json);
+	payload->mFull = MakeResponse(json,version);
+
+	WriteForecastJson(pWeather,true,json);
+	payload->mCompact = MakeResponse(json,version);
+	payload->mEvent = "id: " + std::to_string(version) + "\nevent: forecast\ndata: " + json + "\n\n";
+
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		PayloadPtr& published = mPublished[pName];
+		if( published == nullptr || published->mVersion < version )
+		{
+			published = payload;
+		}
+	}
+
+	mPublishCount++;
+	const uint64_t wake = 1;
+	if( write(mWake,&wake,sizeof(wake)) < 0 && errno != EAGAIN )
+	{
+		std::cerr << "ForecastServer failed to wake the event loop, " << strerror(errno) << "\n";
+	}
+}
+
+void ForecastServer::Run()
+{
+	epoll_event events[64];
+	while( mStop == false )
+	{
+		const int count = epoll_wait(mEpoll,events,64,1000);
+		for( int n = 0 ; n < count ; n++ )
+		{
+			const int socket = events[n].data.fd;
+			if( socket == mWake )
+			{
+				uint64_t wakes;
+				while( read(mWake,&wakes,sizeof(wakes)) > 0 ){}
+				TakePublished();
+				continue;
+			}
+
+			if( std::find(mListening.begin(),mListening.end(),socket) != mListening.end() )
+			{
+				Accept(socket);
+				continue;
+			}
+
+			if( (size_t)socket >= mConnections.size() || mConnections[socket] == nullptr )
+				continue;
+
+			if( events[n].events & EPOLLOUT )
+			{
+				Send(*mConnections[socket]);
+			}
+
+			// Sending may have closed it.
+			if( mConnections[socket] && (events[n].events & (EPOLLIN|EPOLLHUP|EPOLLERR)) )
+			{
+				Read(*mConnections[socket]);
+			}
+		}
+
+		if( mWaitingCount > 0 )
+		{
+			ExpireLongPolls(std::time(nullptr));
+		}
+	}
+}
+
+void ForecastServer::Stop()
+{
+	mStop = true;
+	const uint64_t wake = 1;
+	if( write(mWake,&wake,sizeof(wake)) < 0 && errno != EAGAIN )
+	{
+		std::cerr << "ForecastServer failed to wake the event loop, " << strerror(errno) << "\n";
+	}
+}
+
+ForecastServer::Stats ForecastServer::GetStats()const
+{
+	Stats stats;
+	stats.mConnections = mConnectionCount;
+	stats.mRequests = mRequestCount;
+	stats.mBytesSent = mBytesSent;
+	stats.mPublishes = mPublishCount;
+	stats.mWaiting = mWaitingCount;
+	return stats;
+}
+
+bool ForecastServer::AddListener(int pSocket)
+{
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = pSocket;
+	if( epoll_ctl(mEpoll,EPOLL_CTL_ADD,pSocket,&event) != 0 )
+	{
+		std::cerr << "ForecastServer failed to add the listening socket to epoll, " << strerror(errno) << "\n";
+		close(pSocket);
+		return false;
+	}
+	mListening.push_back(pSocket);
+	return true;
+}
+
+void ForecastServer::Accept(int pListening)
+{
+	for(;;)
+	{
+		const int socket = accept4(pListening,nullptr,nullptr,SOCK_NONBLOCK|SOCK_CLOEXEC);
+		if( socket < 0 )
+			return;// EAGAIN, all taken, or an error that will show again next time.
+
+		// Responses are written in one go, no point waiting to fill a packet. Fails harmlessly on unix sockets.
+		const int noDelay = 1;
+		setsockopt(socket,IPPROTO_TCP,TCP_NODELAY,&noDelay,sizeof(noDelay));
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = socket;
+		if( epoll_ctl(mEpoll,EPOLL_CTL_ADD,socket,&event) != 0 )
+		{
+			close(socket);
+			continue;
+		}
+
+		if( (size_t)socket >= mConnections.size() )
+		{
+			mConnections.resize(socket + 1);
+		}
+		mConnections[socket].reset(new Connection);
+		mConnections[socket]->mSocket = socket;
+		mConnections[socket]->mID = mNextConnectionID++;
+		mConnectionCount++;
+	}
+}
+
+void ForecastServer::Read(Connection& pConnection)
+{
+	char buffer[4096];
+	for(;;)
+	{
+		const ssize_t got = recv(pConnection.mSocket,buffer,sizeof(buffer),0);
+		if( got > 0 )
+		{
+			pConnection.mRequest.append(buffer,got);
+			if( pConnection.mRequest.size() > MAX_REQUEST_SIZE )
+			{
+				Close(pConnection);
+				return;
+			}
+		}
+		else if( got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+		{
+			break;
+		}
+		else
+		{// Closed by the client, or an error.
+			Close(pConnection);
+			return;
+		}
+	}
+
+	// Requests that come in whilst answering the last one wait their turn.
+	if( pConnection.mData == nullptr && pConnection.mWaiting == false )
+	{
+		HandleRequest(pConnection);
+	}
+}
+
+void ForecastServer::HandleRequest(Connection& pConnection)
+{
+	const size_t end = pConnection.mRequest.find("\r\n\r\n");
+	if( end == std::string::npos )
+		return;
+
+	const std::string request = pConnection.mRequest.substr(0,end);
+	pConnection.mRequest.erase(0,end + 4);
+	mRequestCount++;
+
+	// GET /name?query HTTP/1.1
+	const size_t targetEnd = request.find(' ',4);
+	if( request.compare(0,5,"GET /") != 0 || targetEnd == std::string::npos )
+	{
+		pConnection.mKeepAlive = false;
+		StartSending(pConnection,nullptr,BAD_REQUEST);
+		return;
+	}
+
+	const std::string target = request.substr(5,targetEnd - 5);
+	const size_t queryStart = std::min(target.find('?'),target.size());
+	std::string name = target.substr(0,queryStart);
+	const std::string query = queryStart < target.size() ? target.substr(queryStart + 1) : "";
+
+	// http 1.1 keeps the connection open unless told not to, 1.0 closes it unless told not to.
+	const size_t versionStart = targetEnd + 1;
+	if( request.compare(versionStart,8,"HTTP/1.0") == 0 )
+		pConnection.mKeepAlive = HasHeaderToken(request,"Connection","keep-alive");
+	else
+		pConnection.mKeepAlive = HasHeaderToken(request,"Connection","close") == false;
+	pConnection.mType = RequestType::FULL;
+
+	std::string value;
+	const std::string EVENTS = "/events";
+	if( name.size() > EVENTS.size() && name.compare(name.size() - EVENTS.size(),EVENTS.size(),EVENTS) == 0 )
+	{
+		name.resize(name.size() - EVENTS.size());
+		pConnection.mType = RequestType::EVENTS;
+	}
+	else if( FindParameter(query,"compact",value) )
+	{
+		pConnection.mType = RequestType::COMPACT;
+	}
+
+	// Locations are only made by a publish, so a client asking for made up names can't grow the map.
+	const auto found = mLocations.find(name);
+	if( found == mLocations.end() )
+	{
+		StartSending(pConnection,nullptr,NOT_FOUND);
+		return;
+	}
+
+	Location& location = found->second;
+	if( pConnection.mType == RequestType::EVENTS )
+	{
+		// Headers first, then what there is now, then each publish after.
+		pConnection.mName = name;
+		pConnection.mNextEvent = location.mPayload;
+		Wait(pConnection,location);
+		StartSending(pConnection,nullptr,EVENT_STREAM);
+	}
+	else if( FindParameter(query,"since",value) && strtoull(value.c_str(),nullptr,10) >= location.mPayload->mVersion )
+	{
+		pConnection.mName = name;
+		pConnection.mDeadline = std::time(nullptr) + mLongPollTimeout;
+		Wait(pConnection,location);
+	}
+	else
+	{
+		Respond(pConnection,location.mPayload);
+	}
+}
+
+void ForecastServer::Respond(Connection& pConnection,const PayloadPtr& pPayload)
+{
+	StartSending(pConnection,pPayload,pConnection.mType == RequestType::COMPACT ? pPayload->mCompact : pPayload->mFull);
+}
+
+void ForecastServer::StartSending(Connection& pConnection,const PayloadPtr& pPayload,const std::string& pData)
+{
+	assert( pConnection.mData == nullptr );
+	// Holding the payload keeps pData alive, even if a newer one is published whilst sending.
+	pConnection.mSending = pPayload;
+	pConnection.mData = &pData;
+	pConnection.mSent = 0;
+	Send(pConnection);
+}
+
+void ForecastServer::Send(Connection& pConnection)
+{
+	if( pConnection.mData == nullptr )
+		return;
+
+	const std::string& data = *pConnection.mData;
+	while( pConnection.mSent < data.size() )
+	{
+		const ssize_t sent = send(pConnection.mSocket,data.data() + pConnection.mSent,data.size() - pConnection.mSent,MSG_NOSIGNAL);
+		if( sent > 0 )
+		{
+			pConnection.mSent += sent;
+			mBytesSent += sent;
+		}
+		else if( sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+		{// Socket buffer is full, carry on when epoll says there is room.
+			SetWantWrite(pConnection,true);
+			return;
+		}
+		else
+		{
+			Close(pConnection);
+			return;
+		}
+	}
+
+	SetWantWrite(pConnection,false);
+	SendDone(pConnection);
+}
+
+void ForecastServer::SendDone(Connection& pConnection)
+{
+	pConnection.mSending.reset();
+	pConnection.mData = nullptr;
+
+	if( pConnection.mType == RequestType::EVENTS )
+	{
+		if( pConnection.mNextEvent )
+		{
+			const PayloadPtr next = pConnection.mNextEvent;
+			pConnection.mNextEvent.reset();
+			StartSending(pConnection,next,next->mEvent);
+		}
+		return;
+	}
+
+	if( pConnection.mKeepAlive == false )
+	{
+		Close(pConnection);
+		return;
+	}
+
+	HandleRequest(pConnection);
+}
+
+void ForecastServer::Wait(Connection& pConnection,Location& pLocation)
+{
+	pConnection.mWaiting = true;
+	pLocation.mWaiting.push_back({pConnection.mSocket,pConnection.mID});
+	mWaitingCount++;
+}
+
+void ForecastServer::StopWaiting(Connection& pConnection)
+{
+	const auto found = mLocations.find(pConnection.mName);
+	if( found != mLocations.end() )
+	{
+		auto& waiting = found->second.mWaiting;
+		const uint64_t id = pConnection.mID;
+		waiting.erase(std::remove_if(waiting.begin(),waiting.end(),[id](const std::pair<int,uint64_t>& w){return w.second == id;}),waiting.end());
+	}
+	pConnection.mWaiting = false;
+	mWaitingCount--;
+}
+
+void ForecastServer::TakePublished()
+{
+	std::map<std::string,PayloadPtr> published;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		published.swap(mPublished);
+	}
+
+	for( auto& update : published )
+	{
+		Location& location = mLocations[update.first];
+		const PayloadPtr& payload = update.second;
+		if( location.mPayload && location.mPayload->mVersion >= payload->mVersion )
+			continue;
+		location.mPayload = payload;
+
+		std::vector<std::pair<int,uint64_t>> waiting;
+		waiting.swap(location.mWaiting);
+		for( const auto& waiter : waiting )
+		{
+			const int socket = waiter.first;
+			if( (size_t)socket >= mConnections.size() || mConnections[socket] == nullptr || mConnections[socket]->mID != waiter.second )
+				continue;
+
+			Connection& connection = *mConnections[socket];
+			if( connection.mType == RequestType::EVENTS )
+			{
+				// Stays waiting for the next one. If it's still sending the last, only the newest is sent after.
+				location.mWaiting.push_back(waiter);
+				if( connection.mData )
+					connection.mNextEvent = payload;
+				else
+					StartSending(connection,payload,payload->mEvent);
+			}
+			else
+			{
+				connection.mWaiting = false;
+				mWaitingCount--;
+				Respond(connection,payload);
+			}
+		}
+	}
+}
+
+void ForecastServer::ExpireLongPolls(std::time_t pNow)
+{
+	for( auto& connection : mConnections )
+	{
+		if( connection == nullptr || connection->mWaiting == false || connection->mType == RequestType::EVENTS || connection->mDeadline > pNow )
+			continue;
+
+		StopWaiting(*connection);
+		StartSending(*connection,nullptr,NOT_MODIFIED);
+	}
+}
+
+void ForecastServer::Close(Connection& pConnection)
+{
+	const int socket = pConnection.mSocket;
+	if( pConnection.mWaiting )
+	{
+		StopWaiting(pConnection);
+	}
+
+	epoll_ctl(mEpoll,EPOLL_CTL_DEL,socket,nullptr);
+	close(socket);
+	mConnections[socket].reset();
+}
+
+void ForecastServer::SetWantWrite(Connection& pConnection,bool pWrite)
+{
+	epoll_event event = {};
+	event.events = pWrite ? (EPOLLIN|EPOLLOUT) : EPOLLIN;
+	event.data.fd = pConnection.mSocket;
+	epoll_ctl(mEpoll,EPOLL_CTL_MOD,pConnection.mSocket,&event);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
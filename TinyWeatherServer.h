@@ -0,0 +1,203 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_SERVER_H
+#define TINY_WEATHER_SERVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <ctime>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Writes the forecast as one call api json, so it can be read back with OpenWeatherMap::ProcessWeatherReport.
+ * Compact leaves out the minutely forecast and the fields a display rarely shows, and only has the next COMPACT_HOURS hours.
+ */
+void WriteForecastJson(const OpenWeatherMap& pWeather,bool pCompact,std::string& rJson);
+
+static const size_t COMPACT_HOURS = 24;
+
+/**
+ * @brief Serves the forecasts you refresh to lots of local clients, so one fetch from the api feeds them all.
+ * Linux only, it uses epoll.
+ *
+ * Publish serialises the forecast once, full and compact, with the http headers, into a buffer shared by every
+ * client. Sending it to a client is just writing that buffer to its socket, nothing is copied or built per client.
+ * Run the event loop on its own thread, Publish can be called from any thread.
+ *
+ * The requests it answers, where name is the name you published the forecast under:
+ *   GET /name						The full forecast. Anything else in the query, like the lat, lon and appid that
+ *									OpenWeatherMap::Get adds, is ignored, so a client can SetServerURL("http://server:port/name").
+ *   GET /name?compact				The compact forecast.
+ *   GET /name?since=version		Long poll, answers when there is a newer version than the one passed, or with
+ *									304 Not Modified after the long poll timeout. The version is in the X-Forecast-Version header.
+ *   GET /name/events				Server sent events, the compact forecast is pushed each time it is published.
+ * Names that have not been published yet get a 404, so clients can't wait on names that may never be served.
+ */
+class ForecastServer
+{
+public:
+	struct Stats
+	{
+		uint64_t mConnections = 0;	//!< Accepted since it started.
+		uint64_t mRequests = 0;
+		uint64_t mBytesSent = 0;
+		uint64_t mPublishes = 0;
+		size_t mWaiting = 0;		//!< Long polls and event streams waiting for a publish.
+	};
+
+	ForecastServer();
+	~ForecastServer();
+
+	/**
+	 * @brief Listen for http on the port, pass 0 for any free port and read it back with GetPort.
+	 * Call before Run. Can be used with ListenUnix, both are served.
+	 */
+	bool Listen(uint16_t pPort,const std::string& pAddress = "0.0.0.0");
+	uint16_t GetPort()const{return mPort;}
+
+	/**
+	 * @brief Listen for http on a unix socket, any file already at the path is removed.
+	 */
+	bool ListenUnix(const std::string& pPath);
+
+	/**
+	 * @brief How long a long poll waits before answering 304 Not Modified. Default 30 seconds.
+	 */
+	void SetLongPollTimeout(std::time_t pSeconds){mLongPollTimeout = pSeconds;}
+
+	/**
+	 * @brief Serialises the forecast and makes it the one served for the name, waking the clients waiting on it.
+	 * Thread safe. The serialising is done on the calling thread, not the event loop.
+	 */
+	void Publish(const std::string& pName,const OpenWeatherMap& pWeather);
+
+	/**
+	 * @brief The event loop, returns when Stop is called.
+	 */
+	void Run();
+
+	/**
+	 * @brief Thread safe, makes Run return.
+	 */
+	void Stop();
+
+	Stats GetStats()const;
+
+private:
+	/**
+	 * @brief One publish of a location, the complete responses ready to send. Shared, read only, by all the
+	 * clients sending it, and freed when the last one finishes after a newer one is published.
+	 */
+	struct Payload
+	{
+		uint64_t mVersion;
+		std::string mFull;
+		std::string mCompact;
+		std::string mEvent;		//!< The compact forecast as a server sent event.
+	};
+	typedef std::shared_ptr<const Payload> PayloadPtr;
+
+	enum struct RequestType
+	{
+		FULL,
+		COMPACT,
+		EVENTS
+	};
+
+	struct Connection
+	{
+		int mSocket = -1;
+		uint64_t mID = 0;				//!< So a waiting list entry for a closed socket, whose number has been reused, is spotted.
+		std::string mRequest;			//!< What has been read so far.
+		bool mKeepAlive = true;
+
+		// The response being sent. Either from a payload, which is held until it is sent, or a static string.
+		PayloadPtr mSending;
+		const std::string* mData = nullptr;
+		size_t mSent = 0;
+
+		// Long poll or event stream.
+		std::string mName;
+		RequestType mType = RequestType::FULL;
+		bool mWaiting = false;
+		std::time_t mDeadline = 0;		//!< Long poll only.
+		PayloadPtr mNextEvent;			//!< A newer event to send once the one being sent is done.
+	};
+
+	struct Location
+	{
+		PayloadPtr mPayload;
+		std::vector<std::pair<int,uint64_t>> mWaiting;	//!< Socket and connection id.
+	};
+
+	int mEpoll = -1;
+	int mWake = -1;							//!< eventfd, written to by Publish and Stop.
+	std::vector<int> mListening;
+	uint16_t mPort = 0;
+	std::string mUnixPath;
+	std::time_t mLongPollTimeout = 30;
+
+	// Only touched by the event loop.
+	std::vector<std::unique_ptr<Connection>> mConnections;	//!< By socket.
+	std::map<std::string,Location> mLocations;
+	uint64_t mNextConnectionID = 1;
+
+	// From Publish to the event loop.
+	mutable std::mutex mLock;
+	std::map<std::string,PayloadPtr> mPublished;
+	uint64_t mNextVersion = 1;
+	std::atomic<bool> mStop;
+
+	std::atomic<uint64_t> mConnectionCount;
+	std::atomic<uint64_t> mRequestCount;
+	std::atomic<uint64_t> mBytesSent;
+	std::atomic<uint64_t> mPublishCount;
+	std::atomic<size_t> mWaitingCount;
+
+	bool AddListener(int pSocket);
+	void Accept(int pListening);
+	void Read(Connection& pConnection);
+	void HandleRequest(Connection& pConnection);
+	void Respond(Connection& pConnection,const PayloadPtr& pPayload);
+	void StartSending(Connection& pConnection,const PayloadPtr& pPayload,const std::string& pData);
+	void Send(Connection& pConnection);
+	void SendDone(Connection& pConnection);
+	void Wait(Connection& pConnection,Location& pLocation);
+	void StopWaiting(Connection& pConnection);
+	void TakePublished();
+	void ExpireLongPolls(std::time_t pNow);
+	void Close(Connection& pConnection);
+	void SetWantWrite(Connection& pConnection,bool pWrite);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_SERVER_H
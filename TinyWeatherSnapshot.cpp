@@ -0,0 +1,343 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TinyWeatherSnapshot.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const char SNAPSHOT_MAGIC[8] = {'T','W','S','N','A','P',0,0};
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+/**
+ * @brief Builds the string table as the records are written, the same string is only stored once.
+ */
+class SnapshotStringTable
+{
+public:
+	SnapshotString Add(const std::string& pString)
+	{
+		const auto found = mOffsets.find(pString);
+		if( found != mOffsets.end() )
+			return {found->second,(uint32_t)pString.size()};
+
+		const uint32_t offset = (uint32_t)mTable.size();
+		mTable.insert(mTable.end(),pString.begin(),pString.end());
+		mTable.push_back(0);
+		mOffsets[pString] = offset;
+		return {offset,(uint32_t)pString.size()};
+	}
+
+	const std::vector<char>& GetTable()const{return mTable;}
+
+private:
+	std::map<std::string,uint32_t> mOffsets;
+	std::vector<char> mTable;
+};
+
+static void WriteTime(const WeatherTime& pTime,SnapshotTime& rTime)
+{
+	rTime.mUTC = pTime.mUTC;
+	rTime.mYear = pTime.mYear;
+	rTime.mMonth = pTime.mMonth;
+	rTime.mDay = pTime.mDay;
+	rTime.mHour = pTime.mHour;
+	rTime.mMinute = pTime.mMinute;
+	rTime.mPadding = 0;
+}
+
+static void WriteDisplay(const DisplayData& pDisplay,SnapshotDisplay& rDisplay,SnapshotStringTable& rStrings)
+{
+	rDisplay.mID = pDisplay.mID;
+	rDisplay.mPadding = 0;
+	rDisplay.mTitle = rStrings.Add(pDisplay.GetTitle());
+	rDisplay.mDescription = rStrings.Add(pDisplay.GetDescription());
+	rDisplay.mIcon = rStrings.Add(pDisplay.GetIcon());
+}
+
+static void WriteWeather(const WeatherData& pWeather,SnapshotWeather& rWeather,SnapshotStringTable& rStrings)
+{
+	WriteTime(pWeather.mTime,rWeather.mTime);
+	WriteTime(pWeather.mSunrise,rWeather.mSunrise);
+	WriteTime(pWeather.mSunset,rWeather.mSunset);
+	rWeather.mTemperature = pWeather.mTemperature;
+	rWeather.mFeelsLike = pWeather.mFeelsLike;
+	rWeather.mDewPoint = pWeather.mDewPoint;
+	rWeather.mWindSpeed = pWeather.mWindSpeed;
+	rWeather.mWindGusts = pWeather.mWindGusts;
+	rWeather.mPressure = pWeather.mPressure;
+	rWeather.mHumidity = pWeather.mHumidity;
+	rWeather.mClouds = pWeather.mClouds;
+	rWeather.mUVIndex = pWeather.mUVIndex;
+	rWeather.mVisibility = pWeather.mVisibility;
+	rWeather.mWindDirection = pWeather.mWindDirection;
+	rWeather.mPrecipitationProbability = pWeather.mPrecipitationProbability;
+	rWeather.mRain = pWeather.mRain;
+	rWeather.mSnow = pWeather.mSnow;
+	WriteDisplay(pWeather.mDisplay,rWeather.mDisplay,rStrings);
+}
+
+static void WriteDaily(const DailyWeatherData& pDaily,SnapshotDaily& rDaily,SnapshotStringTable& rStrings)
+{
+	WriteTime(pDaily.mTime,rDaily.mTime);
+	WriteTime(pDaily.mSunrise,rDaily.mSunrise);
+	WriteTime(pDaily.mSunset,rDaily.mSunset);
+	rDaily.mTemperatureMorning = pDaily.mTemperature.Morning;
+	rDaily.mTemperatureDay = pDaily.mTemperature.Day;
+	rDaily.mTemperatureEvening = pDaily.mTemperature.Evening;
+	rDaily.mTemperatureNight = pDaily.mTemperature.Night;
+	rDaily.mTemperatureMin = pDaily.mTemperature.Min;
+	rDaily.mTemperatureMax = pDaily.mTemperature.Max;
+	rDaily.mFeelsLikeMorning = pDaily.mFeelsLike.Morning;
+	rDaily.mFeelsLikeDay = pDaily.mFeelsLike.Day;
+	rDaily.mFeelsLikeEvening = pDaily.mFeelsLike.Evening;
+	rDaily.mFeelsLikeNight = pDaily.mFeelsLike.Night;
+	rDaily.mPressure = pDaily.mPressure;
+	rDaily.mHumidity = pDaily.mHumidity;
+	rDaily.mDewPoint = pDaily.mDewPoint;
+	rDaily.mClouds = pDaily.mClouds;
+	rDaily.mUVIndex = pDaily.mUVIndex;
+	rDaily.mWindSpeed = pDaily.mWindSpeed;
+	rDaily.mWindGusts = pDaily.mWindGusts;
+	rDaily.mWindDirection = pDaily.mWindDirection;
+	rDaily.mPrecipitationProbability = pDaily.mPrecipitationProbability;
+	rDaily.mRain = pDaily.mRain;
+	rDaily.mSnow = pDaily.mSnow;
+	rDaily.mPadding = 0;
+	WriteDisplay(pDaily.mDisplay,rDaily.mDisplay,rStrings);
+}
+
+void BuildSnapshot(const OpenWeatherMap& pWeather,std::vector<uint8_t>& rSnapshot)
+{
+	// Records are written into their own arrays first as the string table is not complete until they are all done.
+	SnapshotStringTable strings;
+	SnapshotHeader header;
+	memset(&header,0,sizeof(header));
+
+	std::vector<SnapshotWeather> hourly(pWeather.mHourly.size());
+	for( size_t n = 0 ; n < hourly.size() ; n++ )
+	{
+		WriteWeather(pWeather.mHourly[n],hourly[n],strings);
+	}
+
+	std::vector<SnapshotDaily> daily(pWeather.mDaily.size());
+	for( size_t n = 0 ; n < daily.size() ; n++ )
+	{
+		WriteDaily(pWeather.mDaily[n],daily[n],strings);
+	}
+
+	std::vector<SnapshotMinutely> minutely(pWeather.mMinutely.size());
+	for( size_t n = 0 ; n < minutely.size() ; n++ )
+	{
+		minutely[n].mTime = pWeather.mMinutely[n].mTime.mUTC;
+		minutely[n].mPrecipitation = pWeather.mMinutely[n].mPrecipitation;
+		minutely[n].mPadding = 0;
+	}
+
+	memcpy(header.mMagic,SNAPSHOT_MAGIC,sizeof(header.mMagic));
+	header.mVersion = SNAPSHOT_VERSION;
+	header.mByteOrder = SNAPSHOT_BYTE_ORDER;
+	header.mTimezoneOffset = (int32_t)pWeather.mTimezoneOffset;
+	header.mLatitude = pWeather.mLatitude;
+	header.mLongitude = pWeather.mLongitude;
+	header.mTimeZone = strings.Add(pWeather.mTimeZone);
+	WriteWeather(pWeather.mCurrent,header.mCurrent,strings);
+
+	// All the records are multiples of eight bytes so each array is aligned.
+	uint32_t offset = sizeof(SnapshotHeader);
+	header.mHourlyCount = (uint32_t)hourly.size();
+	header.mHourlyOffset = offset;
+	offset += header.mHourlyCount * sizeof(SnapshotWeather);
+
+	header.mDailyCount = (uint32_t)daily.size();
+	header.mDailyOffset = offset;
+	offset += header.mDailyCount * sizeof(SnapshotDaily);
+
+	header.mMinutelyCount = (uint32_t)minutely.size();
+	header.mMinutelyOffset = offset;
+	offset += header.mMinutelyCount * sizeof(SnapshotMinutely);
+
+	header.mStringsOffset = offset;
+	header.mStringsSize = (uint32_t)strings.GetTable().size();
+	header.mFileSize = offset + header.mStringsSize;
+
+	rSnapshot.resize(header.mFileSize);
+	uint8_t* dest = rSnapshot.data();
+	memcpy(dest,&header,sizeof(header));
+	memcpy(dest + header.mHourlyOffset,hourly.data(),hourly.size() * sizeof(SnapshotWeather));
+	memcpy(dest + header.mDailyOffset,daily.data(),daily.size() * sizeof(SnapshotDaily));
+	memcpy(dest + header.mMinutelyOffset,minutely.data(),minutely.size() * sizeof(SnapshotMinutely));
+	memcpy(dest + header.mStringsOffset,strings.GetTable().data(),header.mStringsSize);
+}
+
+bool WriteSnapshot(const OpenWeatherMap& pWeather,const std::string& pFileName)
+{
+	std::vector<uint8_t> snapshot;
+	BuildSnapshot(pWeather,snapshot);
+
+	const std::string tempName = pFileName + ".tmp";
+	{
+		std::ofstream file(tempName,std::ios::binary|std::ios::trunc);
+		file.write((const char*)snapshot.data(),snapshot.size());
+		if( !file )
+		{
+			std::cerr << "Failed to write weather snapshot " << tempName << "\n";
+			return false;
+		}
+	}
+
+	if( rename(tempName.c_str(),pFileName.c_str()) != 0 )
+	{
+		std::cerr << "Failed to rename weather snapshot " << tempName << " to " << pFileName << "\n";
+		return false;
+	}
+	return true;
+}
+
+SnapshotView::~SnapshotView()
+{
+	Close();
+}
+
+bool SnapshotView::Open(const std::string& pFileName)
+{
+	Close();
+
+	const int file = open(pFileName.c_str(),O_RDONLY);
+	if( file < 0 )
+	{
+		std::cerr << "Failed to open weather snapshot " << pFileName << "\n";
+		return false;
+	}
+
+	struct stat info;
+	void* mapped = MAP_FAILED;
+	if( fstat(file,&info) == 0 && info.st_size > 0 )
+	{
+		mapped = mmap(nullptr,info.st_size,PROT_READ,MAP_SHARED,file,0);
+	}
+	close(file);// The mapping keeps its own reference.
+
+	if( mapped == MAP_FAILED )
+	{
+		std::cerr << "Failed to map weather snapshot " << pFileName << "\n";
+		return false;
+	}
+
+	mData = (const uint8_t*)mapped;
+	mSize = info.st_size;
+	mMapped = true;
+	if( Validate() == false )
+	{
+		std::cerr << "Invalid weather snapshot " << pFileName << "\n";
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool SnapshotView::Open(const void* pSnapshot,size_t pSize)
+{
+	Close();
+
+	mData = (const uint8_t*)pSnapshot;
+	mSize = pSize;
+	if( Validate() == false )
+	{
+		std::cerr << "Invalid weather snapshot in memory\n";
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void SnapshotView::Close()
+{
+	if( mMapped )
+	{
+		munmap((void*)mData,mSize);
+	}
+	mData = nullptr;
+	mSize = 0;
+	mMapped = false;
+	mHeader = nullptr;
+}
+
+bool SnapshotView::Validate()
+{
+	// Only the structure is checked, enough that nothing we hand out points outside of the data.
+	if( mData == nullptr || mSize < sizeof(SnapshotHeader) )
+		return false;
+
+	const SnapshotHeader* header = (const SnapshotHeader*)mData;
+	if( memcmp(header->mMagic,SNAPSHOT_MAGIC,sizeof(SNAPSHOT_MAGIC)) != 0 ||
+		header->mVersion != SNAPSHOT_VERSION ||
+		header->mByteOrder != SNAPSHOT_BYTE_ORDER ||
+		header->mFileSize != mSize )
+	{
+		return false;
+	}
+
+	auto fits = [this](uint64_t pOffset,uint64_t pBytes){return pOffset + pBytes <= mSize;};
+	if( !fits(header->mHourlyOffset,(uint64_t)header->mHourlyCount * sizeof(SnapshotWeather)) ||
+		!fits(header->mDailyOffset,(uint64_t)header->mDailyCount * sizeof(SnapshotDaily)) ||
+		!fits(header->mMinutelyOffset,(uint64_t)header->mMinutelyCount * sizeof(SnapshotMinutely)) ||
+		!fits(header->mStringsOffset,header->mStringsSize) ||
+		header->mStringsSize == 0 ||
+		mData[header->mStringsOffset + header->mStringsSize - 1] != 0 )
+	{
+		return false;
+	}
+
+	auto stringOk = [header](const SnapshotString& pString){return pString.mOffset + (uint64_t)pString.mLength < header->mStringsSize;};
+	auto displayOk = [&stringOk](const SnapshotDisplay& pDisplay){return stringOk(pDisplay.mTitle) && stringOk(pDisplay.mDescription) && stringOk(pDisplay.mIcon);};
+
+	if( !stringOk(header->mTimeZone) || !displayOk(header->mCurrent.mDisplay) )
+		return false;
+
+	const SnapshotWeather* hourly = Get<SnapshotWeather>(header->mHourlyOffset);
+	for( uint32_t n = 0 ; n < header->mHourlyCount ; n++ )
+	{
+		if( !displayOk(hourly[n].mDisplay) )
+			return false;
+	}
+
+	const SnapshotDaily* daily = Get<SnapshotDaily>(header->mDailyOffset);
+	for( uint32_t n = 0 ; n < header->mDailyCount ; n++ )
+	{
+		if( !displayOk(daily[n].mDisplay) )
+			return false;
+	}
+
+	mHeader = header;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
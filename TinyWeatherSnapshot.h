@@ -0,0 +1,229 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_SNAPSHOT_H
+#define TINY_WEATHER_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The snapshot is a fixed layout binary image of an OpenWeatherMap. It is mapped into memory and read in place,
+ * there is no parsing or time conversion on load. All the records are plain old data with their sizes checked at
+ * compile time so the layout does not depend on the compiler. Numbers are in the byte order of the machine that
+ * wrote it, which is checked on open. If you change a record bump SNAPSHOT_VERSION.
+ *
+ *   SnapshotHeader, includes current weather.
+ *   SnapshotWeather[mHourlyCount]
+ *   SnapshotDaily[mDailyCount]
+ *   SnapshotMinutely[mMinutelyCount]
+ *   String table, null terminated strings, duplicates stored once.
+ */
+const uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotString
+{
+	uint32_t mOffset;	//!< From the start of the string table.
+	uint32_t mLength;	//!< Not including the null terminator.
+};
+
+/**
+ * @brief Same as WeatherTime but with a fixed size time value.
+ */
+struct SnapshotTime
+{
+	int64_t mUTC;
+	int32_t mYear;
+	int32_t mMonth;
+	int32_t mDay;
+	int32_t mHour;
+	int32_t mMinute;
+	int32_t mPadding;
+};
+
+struct SnapshotDisplay
+{
+	uint32_t mID;
+	uint32_t mPadding;
+	SnapshotString mTitle;
+	SnapshotString mDescription;
+	SnapshotString mIcon;
+};
+
+/**
+ * @brief Current and hourly weather, see WeatherData.
+ */
+struct SnapshotWeather
+{
+	SnapshotTime mTime;
+	SnapshotTime mSunrise;
+	SnapshotTime mSunset;
+	Temperature mTemperature;
+	Temperature mFeelsLike;
+	float mDewPoint;
+	float mWindSpeed;
+	float mWindGusts;
+	uint32_t mPressure;
+	uint32_t mHumidity;
+	uint32_t mClouds;
+	uint32_t mUVIndex;
+	uint32_t mVisibility;
+	uint32_t mWindDirection;
+	float mPrecipitationProbability;
+	float mRain;
+	float mSnow;
+	SnapshotDisplay mDisplay;
+};
+
+/**
+ * @brief See DailyWeatherData.
+ */
+struct SnapshotDaily
+{
+	SnapshotTime mTime;
+	SnapshotTime mSunrise;
+	SnapshotTime mSunset;
+	Temperature mTemperatureMorning,mTemperatureDay,mTemperatureEvening,mTemperatureNight,mTemperatureMin,mTemperatureMax;
+	Temperature mFeelsLikeMorning,mFeelsLikeDay,mFeelsLikeEvening,mFeelsLikeNight;
+	uint32_t mPressure;
+	uint32_t mHumidity;
+	float mDewPoint;
+	uint32_t mClouds;
+	uint32_t mUVIndex;
+	float mWindSpeed;
+	float mWindGusts;
+	uint32_t mWindDirection;
+	float mPrecipitationProbability;
+	float mRain;
+	float mSnow;
+	uint32_t mPadding;
+	SnapshotDisplay mDisplay;
+};
+
+struct SnapshotMinutely
+{
+	int64_t mTime;
+	float mPrecipitation;
+	uint32_t mPadding;
+};
+
+struct SnapshotHeader
+{
+	char mMagic[8];				//!< "TWSNAP" and two nulls.
+	uint32_t mVersion;			//!< SNAPSHOT_VERSION
+	uint32_t mByteOrder;		//!< 0x01020304 as written by the machine that made it.
+	uint32_t mFileSize;			//!< Total size in bytes, so a truncated file is spotted.
+	int32_t mTimezoneOffset;
+	double mLatitude;
+	double mLongitude;
+	SnapshotString mTimeZone;
+	uint32_t mHourlyCount,mHourlyOffset;
+	uint32_t mDailyCount,mDailyOffset;
+	uint32_t mMinutelyCount,mMinutelyOffset;
+	uint32_t mStringsOffset,mStringsSize;
+	SnapshotWeather mCurrent;
+};
+
+static_assert(sizeof(Temperature) == 12,"Temperature layout has changed, the snapshot format depends on it");
+static_assert(sizeof(SnapshotTime) == 32,"Snapshot layout has changed, bump SNAPSHOT_VERSION");
+static_assert(sizeof(SnapshotDisplay) == 32,"Snapshot layout has changed, bump SNAPSHOT_VERSION");
+static_assert(sizeof(SnapshotWeather) == 200,"Snapshot layout has changed, bump SNAPSHOT_VERSION");
+static_assert(sizeof(SnapshotDaily) == 296,"Snapshot layout has changed, bump SNAPSHOT_VERSION");
+static_assert(sizeof(SnapshotMinutely) == 16,"Snapshot layout has changed, bump SNAPSHOT_VERSION");
+static_assert(sizeof(SnapshotHeader) == 280,"Snapshot layout has changed, bump SNAPSHOT_VERSION");
+
+/**
+ * @brief Builds the snapshot of the weather into the buffer. The buffer is resized to fit.
+ */
+void BuildSnapshot(const OpenWeatherMap& pWeather,std::vector<uint8_t>& rSnapshot);
+
+/**
+ * @brief Builds the snapshot and writes it to the file. Written to a temp file first then renamed so a reader never sees half a file.
+ */
+bool WriteSnapshot(const OpenWeatherMap& pWeather,const std::string& pFileName);
+
+/**
+ * @brief Read only view of a snapshot, either mapped from a file or over memory you own.
+ * Everything returned points into the snapshot, there is no copy.
+ */
+class SnapshotView
+{
+public:
+	SnapshotView() = default;
+	~SnapshotView();
+
+	SnapshotView(const SnapshotView&) = delete;
+	SnapshotView& operator=(const SnapshotView&) = delete;
+
+	/**
+	 * @brief Maps the file into memory and checks the header.
+	 * @return false if the file could not be opened or is not a valid snapshot, reason written to std::cerr.
+	 */
+	bool Open(const std::string& pFileName);
+
+	/**
+	 * @brief Use a snapshot already in memory, must stay valid whilst this view is in use.
+	 */
+	bool Open(const void* pSnapshot,size_t pSize);
+
+	void Close();
+	bool IsOpen()const{return mHeader != nullptr;}
+
+	const SnapshotHeader& GetHeader()const{return *mHeader;}
+	const SnapshotWeather& GetCurrent()const{return mHeader->mCurrent;}
+	const char* GetTimeZone()const{return GetString(mHeader->mTimeZone);}
+
+	const SnapshotWeather* GetHourly()const{return Get<SnapshotWeather>(mHeader->mHourlyOffset);}
+	size_t GetHourlyCount()const{return mHeader->mHourlyCount;}
+
+	const SnapshotDaily* GetDaily()const{return Get<SnapshotDaily>(mHeader->mDailyOffset);}
+	size_t GetDailyCount()const{return mHeader->mDailyCount;}
+
+	const SnapshotMinutely* GetMinutely()const{return Get<SnapshotMinutely>(mHeader->mMinutelyOffset);}
+	size_t GetMinutelyCount()const{return mHeader->mMinutelyCount;}
+
+	/**
+	 * @brief Returns the null terminated string from the string table.
+	 */
+	const char* GetString(const SnapshotString& pString)const
+	{
+		return (const char*)mData + mHeader->mStringsOffset + pString.mOffset;
+	}
+
+private:
+	const uint8_t* mData = nullptr;
+	size_t mSize = 0;
+	bool mMapped = false;	//!< True if we mapped it and so need to unmap it.
+	const SnapshotHeader* mHeader = nullptr;
+
+	template<typename T> const T* Get(uint32_t pOffset)const{return (const T*)(mData + pOffset);}
+	bool Validate();
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_SNAPSHOT_H
@@ -0,0 +1,196 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <mutex>
+#include <cmath>
+#include <algorithm>
+#include <assert.h>
+
+#include "TinyWeatherSpatial.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const double METRES_PER_DEGREE = 111320.0;	//!< Of latitude, and longitude at the equator.
+static const double SAME_POSITION_METRES = 1.0;		//!< Inserts closer than this replace the one there.
+
+SpatialIndex::SpatialIndex(double pRadiusMetres,std::time_t pMaxAge):
+	mRadiusMetres(pRadiusMetres),
+	mMaxAge(pMaxAge),
+	mCellSize(std::max(pRadiusMetres,SAME_POSITION_METRES) / METRES_PER_DEGREE),
+	mLonCells((int32_t)std::ceil(360.0 / mCellSize)),
+	mCount(0)
+{
+	assert( pRadiusMetres > 0.0 );
+}
+
+void SpatialIndex::Insert(double pLatitude,double pLongitude,std::time_t pFetched,ForecastPtr pForecast)
+{
+	assert( pForecast != nullptr );
+	std::unique_lock<std::shared_mutex> lock(mLock);
+
+	std::vector<Entry>& cell = mCells[MakeCellKey(ToCell(pLatitude),ToLonCell(pLongitude))];
+	for( auto& entry : cell )
+	{
+		if( GetDistanceMetres(pLatitude,pLongitude,entry.mLatitude,entry.mLongitude) < SAME_POSITION_METRES )
+		{
+			entry.mFetched = pFetched;
+			entry.mForecast = std::move(pForecast);
+			return;
+		}
+	}
+
+	cell.push_back({pLatitude,pLongitude,pFetched,std::move(pForecast)});
+	mCount++;
+}
+
+bool SpatialIndex::Remove(double pLatitude,double pLongitude)
+{
+	std::unique_lock<std::shared_mutex> lock(mLock);
+
+	const auto found = mCells.find(MakeCellKey(ToCell(pLatitude),ToLonCell(pLongitude)));
+	if( found == mCells.end() )
+		return false;
+
+	std::vector<Entry>& cell = found->second;
+	for( size_t n = 0 ; n < cell.size() ; n++ )
+	{
+		if( GetDistanceMetres(pLatitude,pLongitude,cell[n].mLatitude,cell[n].mLongitude) < SAME_POSITION_METRES )
+		{
+			cell[n] = std::move(cell.back());
+			cell.pop_back();
+			if( cell.size() == 0 )
+			{
+				mCells.erase(found);
+			}
+			mCount--;
+			return true;
+		}
+	}
+	return false;
+}
+
+ForecastPtr SpatialIndex::FindNearest(double pLatitude,double pLongitude,std::time_t pNow,double* rDistanceMetres)const
+{
+	// Cells are square in degrees, so away from the equator the radius spans more cells of longitude.
+	const double lonScale = std::max(0.01,std::cos(pLatitude * M_PI / 180.0));
+	const int32_t lonReach = (int32_t)std::ceil(mRadiusMetres / (METRES_PER_DEGREE * lonScale * mCellSize));
+	const int32_t latCell = ToCell(pLatitude);
+	const int32_t lonCell = ToLonCell(pLongitude);
+	const std::time_t oldest = pNow - mMaxAge;
+
+	std::shared_lock<std::shared_mutex> lock(mLock);
+
+	const Entry* best = nullptr;
+	double bestDistance = mRadiusMetres;
+	for( int32_t lat = latCell - 1 ; lat <= latCell + 1 ; lat++ )
+	{
+		for( int32_t lon = lonCell - lonReach ; lon <= lonCell + lonReach ; lon++ )
+		{
+			// Wrap around at 180 degrees.
+			const auto found = mCells.find(MakeCellKey(lat,((lon % mLonCells) + mLonCells) % mLonCells));
+			if( found == mCells.end() )
+				continue;
+
+			for( const auto& entry : found->second )
+			{
+				if( entry.mFetched < oldest )
+					continue;
+
+				const double distance = GetDistanceMetres(pLatitude,pLongitude,entry.mLatitude,entry.mLongitude);
+				if( distance <= bestDistance )
+				{
+					bestDistance = distance;
+					best = &entry;
+				}
+			}
+		}
+	}
+
+	if( best == nullptr )
+		return nullptr;
+
+	if( rDistanceMetres )
+	{
+		*rDistanceMetres = bestDistance;
+	}
+	return best->mForecast;
+}
+
+size_t SpatialIndex::Prune(std::time_t pNow)
+{
+	const std::time_t oldest = pNow - mMaxAge;
+	std::unique_lock<std::shared_mutex> lock(mLock);
+
+	size_t removed = 0;
+	for( auto cell = mCells.begin() ; cell != mCells.end() ; )
+	{
+		std::vector<Entry>& entries = cell->second;
+		const auto end = std::remove_if(entries.begin(),entries.end(),[oldest](const Entry& pEntry){return pEntry.mFetched < oldest;});
+		removed += entries.end() - end;
+		entries.erase(end,entries.end());
+
+		if( entries.size() == 0 )
+			cell = mCells.erase(cell);
+		else
+			cell++;
+	}
+
+	mCount -= removed;
+	return removed;
+}
+
+size_t SpatialIndex::GetCount()const
+{
+	std::shared_lock<std::shared_mutex> lock(mLock);
+	return mCount;
+}
+
+int32_t SpatialIndex::ToCell(double pDegrees)const
+{
+	return (int32_t)std::floor(pDegrees / mCellSize);
+}
+
+int32_t SpatialIndex::ToLonCell(double pLongitude)const
+{
+	const int32_t cell = (int32_t)std::floor((pLongitude + 180.0) / mCellSize);
+	return ((cell % mLonCells) + mLonCells) % mLonCells;
+}
+
+uint64_t SpatialIndex::MakeCellKey(int32_t pLatCell,int32_t pLonCell)
+{
+	return ((uint64_t)(uint32_t)pLatCell << 32) | (uint32_t)pLonCell;
+}
+
+double SpatialIndex::GetDistanceMetres(double pLatitudeA,double pLongitudeA,double pLatitudeB,double pLongitudeB)
+{
+	// Equirectangular, plenty good enough over the short distances this is used for and a lot cheaper than haversine.
+	double deltaLon = pLongitudeB - pLongitudeA;
+	if( deltaLon > 180.0 )
+		deltaLon -= 360.0;
+	else if( deltaLon < -180.0 )
+		deltaLon += 360.0;
+
+	const double x = deltaLon * std::cos((pLatitudeA + pLatitudeB) * 0.5 * M_PI / 180.0);
+	const double y = pLatitudeB - pLatitudeA;
+	return std::sqrt(x*x + y*y) * METRES_PER_DEGREE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
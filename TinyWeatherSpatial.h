@@ -0,0 +1,99 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_SPATIAL_H
+#define TINY_WEATHER_SPATIAL_H
+
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <ctime>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Finds a cached forecast near to a position, so requests a few meters apart share one forecast.
+ * The world is split into a grid of cells about the size of the search radius, a lookup only looks at the
+ * cells that the radius touches and picks the nearest forecast that is fresh enough.
+ * Thread safe, many lookups can run at once.
+ */
+class SpatialIndex
+{
+public:
+	/**
+	 * @param pRadiusMetres How far away a forecast can be and still be used.
+	 * @param pMaxAge How old, in seconds, a forecast can be and still be used.
+	 */
+	SpatialIndex(double pRadiusMetres,std::time_t pMaxAge);
+
+	/**
+	 * @brief Adds a forecast, replacing any at the same position.
+	 * @param pFetched When it was fetched, used to decide if it is still fresh enough.
+	 */
+	void Insert(double pLatitude,double pLongitude,std::time_t pFetched,ForecastPtr pForecast);
+
+	bool Remove(double pLatitude,double pLongitude);
+
+	/**
+	 * @brief Returns the nearest forecast within the radius that is fresh enough, else nullptr and you need to fetch one.
+	 * @param rDistanceMetres Optional, set to how far away the forecast returned is.
+	 */
+	ForecastPtr FindNearest(double pLatitude,double pLongitude,std::time_t pNow,double* rDistanceMetres = nullptr)const;
+
+	/**
+	 * @brief Removes forecasts that are too old to ever be returned.
+	 * @return size_t How many were removed.
+	 */
+	size_t Prune(std::time_t pNow);
+
+	size_t GetCount()const;
+
+private:
+	struct Entry
+	{
+		double mLatitude;
+		double mLongitude;
+		std::time_t mFetched;
+		ForecastPtr mForecast;
+	};
+
+	const double mRadiusMetres;
+	const std::time_t mMaxAge;
+	const double mCellSize;		//!< In degrees.
+	const int32_t mLonCells;	//!< Cells around the world, longitude wraps at 180.
+
+	mutable std::shared_mutex mLock;
+	std::unordered_map<uint64_t,std::vector<Entry>> mCells;
+	size_t mCount;
+
+	int32_t ToCell(double pDegrees)const;
+	int32_t ToLonCell(double pLongitude)const;
+	static uint64_t MakeCellKey(int32_t pLatCell,int32_t pLonCell);
+	static double GetDistanceMetres(double pLatitudeA,double pLongitudeA,double pLatitudeB,double pLongitudeB);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_SPATIAL_H
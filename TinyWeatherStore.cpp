@@ -0,0 +1,198 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+*/
+
+#include <thread>
+#include <mutex>
+#include <cmath>
+#include <assert.h>
+
+#include "TinyWeatherStore.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static size_t PickShardCount(size_t pShardCount)
+{
+	if( pShardCount > 0 )
+		return pShardCount;
+
+	// More shards than cores so two threads rarely land on the same one.
+	return std::max(1u,std::thread::hardware_concurrency()) * 4;
+}
+
+ForecastStore::ForecastStore(size_t pByteBudget,size_t pShardCount):
+	mByteBudget(pByteBudget),
+	mShardBudget(pByteBudget / PickShardCount(pShardCount))
+{
+	mShards.resize(PickShardCount(pShardCount));
+	for( auto& shard : mShards )
+	{
+		shard.reset(new Shard);
+	}
+}
+
+ForecastStore::~ForecastStore()
+{
+}
+
+uint64_t ForecastStore::MakeLocationKey(double pLatitude,double pLongitude,double pGridSize)
+{
+	assert( pGridSize > 0.0 );
+	const uint32_t lat = (uint32_t)(int32_t)std::lround(pLatitude / pGridSize);
+	const uint32_t lon = (uint32_t)(int32_t)std::lround(pLongitude / pGridSize);
+	return ((uint64_t)lat << 32) | lon;
+}
+
+ForecastPtr ForecastStore::Find(uint64_t pKey)const
+{
+	Shard& shard = GetShard(pKey);
+	std::shared_lock<std::shared_mutex> lock(shard.mLock);
+
+	const auto found = shard.mIndex.find(pKey);
+	if( found == shard.mIndex.end() )
+	{
+		shard.mMisses.fetch_add(1,std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	const Entry& entry = shard.mSlots[found->second];
+	entry.mReferenced.store(true,std::memory_order_relaxed);
+	shard.mHits.fetch_add(1,std::memory_order_relaxed);
+	return entry.mForecast;
+}
+
+void ForecastStore::Insert(uint64_t pKey,ForecastPtr pForecast)
+{
+	assert( pForecast != nullptr );
+	const size_t bytes = GetMemoryUsage(*pForecast);
+
+	Shard& shard = GetShard(pKey);
+	std::unique_lock<std::shared_mutex> lock(shard.mLock);
+
+	size_t slot;
+	const auto found = shard.mIndex.find(pKey);
+	if( found != shard.mIndex.end() )
+	{
+		slot = found->second;
+		shard.mBytes -= shard.mSlots[slot].mBytes;
+	}
+	else
+	{
+		if( shard.mFreeSlots.size() > 0 )
+		{
+			slot = shard.mFreeSlots.back();
+			shard.mFreeSlots.pop_back();
+		}
+		else
+		{
+			slot = shard.mSlots.size();
+			shard.mSlots.emplace_back();
+		}
+		shard.mIndex[pKey] = slot;
+	}
+
+	Entry& entry = shard.mSlots[slot];
+	entry.mKey = pKey;
+	entry.mForecast = std::move(pForecast);
+	entry.mBytes = bytes;
+	entry.mReferenced.store(true,std::memory_order_relaxed);
+	shard.mBytes += bytes;
+	shard.mInserts.fetch_add(1,std::memory_order_relaxed);
+
+	Evict(shard,slot);
+}
+
+bool ForecastStore::Remove(uint64_t pKey)
+{
+	Shard& shard = GetShard(pKey);
+	std::unique_lock<std::shared_mutex> lock(shard.mLock);
+
+	const auto found = shard.mIndex.find(pKey);
+	if( found == shard.mIndex.end() )
+		return false;
+
+	FreeSlot(shard,found->second);
+	return true;
+}
+
+ForecastStoreStats ForecastStore::GetStats()const
+{
+	ForecastStoreStats stats = {};
+	stats.mByteBudget = mByteBudget;
+	for( const auto& shard : mShards )
+	{
+		std::shared_lock<std::shared_mutex> lock(shard->mLock);
+		stats.mHits += shard->mHits.load(std::memory_order_relaxed);
+		stats.mMisses += shard->mMisses.load(std::memory_order_relaxed);
+		stats.mInserts += shard->mInserts.load(std::memory_order_relaxed);
+		stats.mEvictions += shard->mEvictions.load(std::memory_order_relaxed);
+		stats.mEntries += shard->mIndex.size();
+		stats.mBytes += shard->mBytes;
+	}
+	return stats;
+}
+
+size_t ForecastStore::GetMemoryUsage(const OpenWeatherMap& pForecast)
+{
+	// The display text is in the shared ConditionTable, not in the forecast, so is not counted.
+	return pForecast.GetMemoryUsage().GetTotal();
+}
+
+ForecastStore::Shard& ForecastStore::GetShard(uint64_t pKey)const
+{
+	// The keys are packed grid positions so mix the bits up before picking the shard, splitmix64 finaliser.
+	pKey ^= pKey >> 30;
+	pKey *= 0xbf58476d1ce4e5b9ull;
+	pKey ^= pKey >> 27;
+	pKey *= 0x94d049bb133111ebull;
+	pKey ^= pKey >> 31;
+	return *mShards[pKey % mShards.size()];
+}
+
+void ForecastStore::Evict(Shard& pShard,size_t pKeepSlot)
+{
+	// Never evict the one just added, even if on its own it is over budget.
+	while( pShard.mBytes > mShardBudget && pShard.mIndex.size() > 1 )
+	{
+		pShard.mClockHand = (pShard.mClockHand + 1) % pShard.mSlots.size();
+		Entry& entry = pShard.mSlots[pShard.mClockHand];
+		if( entry.mForecast == nullptr || pShard.mClockHand == pKeepSlot )
+			continue;
+
+		if( entry.mReferenced.exchange(false,std::memory_order_relaxed) )
+			continue;// Second chance.
+
+		FreeSlot(pShard,pShard.mClockHand);
+		pShard.mEvictions.fetch_add(1,std::memory_order_relaxed);
+	}
+}
+
+void ForecastStore::FreeSlot(Shard& pShard,size_t pSlot)
+{
+	Entry& entry = pShard.mSlots[pSlot];
+	pShard.mIndex.erase(entry.mKey);
+	pShard.mBytes -= entry.mBytes;
+	entry.mForecast = nullptr;
+	entry.mBytes = 0;
+	entry.mReferenced.store(false,std::memory_order_relaxed);
+	pShard.mFreeSlots.push_back(pSlot);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
@@ -0,0 +1,132 @@
+/*
+   Copyright (C) 2021, Richard e Collins.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Original code base is at https://github.com/HamAndEggs/TinyWeather
+
+   */
+
+#ifndef TINY_WEATHER_STORE_H
+#define TINY_WEATHER_STORE_H
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <stdint.h>
+
+#include "TinyWeather.h"
+
+namespace tinyweather{
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct ForecastStoreStats
+{
+	uint64_t mHits;
+	uint64_t mMisses;
+	uint64_t mInserts;
+	uint64_t mEvictions;
+	size_t mEntries;
+	size_t mBytes;		//!< Memory accounted to the forecasts held.
+	size_t mByteBudget;
+};
+
+/**
+ * @brief Holds the forecasts for many locations within a memory budget.
+ * Split into shards by a hash of the location so that threads working on different locations do not contend.
+ * Finds only take a shared lock on their shard and mark the entry as used, so many threads can read at once.
+ * When a shard goes over its share of the budget entries are evicted using the clock algorithm, entries that have
+ * been used since the clock hand last went past get a second chance, so it behaves close to least recently used.
+ * Forecasts are held by shared pointer so an evicted forecast stays valid for whoever is still using it.
+ */
+class ForecastStore
+{
+public:
+	/**
+	 * @param pByteBudget Total memory for all the forecasts, split evenly between the shards.
+	 * @param pShardCount Zero picks a count from the number of cores.
+	 */
+	ForecastStore(size_t pByteBudget,size_t pShardCount = 0);
+	~ForecastStore();
+
+	ForecastStore(const ForecastStore&) = delete;
+	ForecastStore& operator=(const ForecastStore&) = delete;
+
+	/**
+	 * @brief Makes the key for a location, rounded to the grid so that positions a few meters apart share a forecast.
+	 */
+	static uint64_t MakeLocationKey(double pLatitude,double pLongitude,double pGridSize = 0.01);
+
+	/**
+	 * @brief Returns the forecast or nullptr if not held.
+	 */
+	ForecastPtr Find(uint64_t pKey)const;
+
+	/**
+	 * @brief Adds or replaces the forecast for the key. May evict others to stay in budget.
+	 */
+	void Insert(uint64_t pKey,ForecastPtr pForecast);
+
+	bool Remove(uint64_t pKey);
+
+	ForecastStoreStats GetStats()const;
+
+	/**
+	 * @brief The memory a forecast is accounted as using.
+	 */
+	static size_t GetMemoryUsage(const OpenWeatherMap& pForecast);
+
+private:
+	struct Entry
+	{
+		uint64_t mKey;
+		ForecastPtr mForecast;			//!< nullptr when the slot is free.
+		size_t mBytes;
+		mutable std::atomic<bool> mReferenced;	//!< Set by Find, cleared by the clock hand.
+
+		Entry():mKey(0),mBytes(0),mReferenced(false){}
+	};
+
+	struct alignas(64) Shard
+	{
+		mutable std::shared_mutex mLock;
+		std::unordered_map<uint64_t,size_t> mIndex;	//!< Key to slot.
+		std::deque<Entry> mSlots;					//!< Deque so entries never move, the atomics can not.
+		std::vector<size_t> mFreeSlots;
+		size_t mClockHand = 0;
+		size_t mBytes = 0;
+
+		// Relaxed atomics, only ever summed for the stats.
+		mutable std::atomic<uint64_t> mHits{0};
+		mutable std::atomic<uint64_t> mMisses{0};
+		std::atomic<uint64_t> mInserts{0};
+		std::atomic<uint64_t> mEvictions{0};
+	};
+
+	const size_t mByteBudget;
+	const size_t mShardBudget;
+	std::vector<std::unique_ptr<Shard>> mShards;
+
+	Shard& GetShard(uint64_t pKey)const;
+	void Evict(Shard& pShard,size_t pKeepSlot);
+	void FreeSlot(Shard& pShard,size_t pSlot);
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+}; //namespace tinyweather{
+
+#endif //TINY_WEATHER_STORE_H
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "TinyWeather.h"
+#include "TinyWeatherChannel.h"
+
+// Checks that the fixed capacity build, TINYWEATHER_FIXED_CAPACITY, really does refresh the weather without
+// touching the heap. Every new and delete in the program is counted, the weather is processed once to warm up
+// and then again lots of times, and the count must not move.
+// Usage: FixedCapacity onecall.json [api key]
+// With an api key it also downloads the weather with Get. libcurl allocates with malloc, not new, so its
+// allocations are not counted here, only ours.
+// Last of all the forecast is handed over through a ForecastChannel, both ways of publishing, which must not
+// touch the heap either.
+
+static size_t allocations = 0;
+
+void* operator new(size_t pSize)
+{
+    allocations++;
+    void* memory = malloc(pSize);
+    if( memory == nullptr )
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* pMemory)noexcept{free(pMemory);}
+void operator delete(void* pMemory,size_t)noexcept{free(pMemory);}
+
+// Where the json is loaded or downloaded to, static so it's not on the heap.
+static char response[64*1024];
+
+int main(int argc, char *argv[])
+{
+#ifndef TINYWEATHER_FIXED_CAPACITY
+    std::cerr << "Build with TINYWEATHER_FIXED_CAPACITY defined\n";
+    return EXIT_FAILURE;
+#endif
+
+    if( argc < 2 )
+    {
+        std::cerr << "Usage: FixedCapacity onecall.json [api key]\n";
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(argv[1],"rb");
+    if( file == nullptr )
+    {
+        std::cerr << "Failed to open " << argv[1] << '\n';
+        return EXIT_FAILURE;
+    }
+    const size_t length = fread(response,1,sizeof(response),file);
+    fclose(file);
+
+    tinyweather::OpenWeatherMap myWeather(argc > 2 ? argv[2] : "");
+    myWeather.SetResponseBuffer(response,sizeof(response));
+
+    if( myWeather.ProcessWeatherReport(response,length) == false )
+    {
+        std::cerr << "Failed to read the weather from " << argv[1] << '\n';
+        return EXIT_FAILURE;
+    }
+
+    const int REFRESHES = 1000;
+    const size_t before = allocations;
+    for( int n = 0 ; n < REFRESHES ; n++ )
+    {
+        myWeather.ProcessWeatherReport(response,length);
+    }
+    const size_t used = allocations - before;
+    std::cout << REFRESHES << " refreshes, " << used << " allocations, " << sizeof(myWeather) << " bytes for the whole forecast\n";
+
+    if( argc > 2 )
+    {
+        // First one sets up the curl handle, after that the only allocations should be curl's own.
+        size_t downloads = 0;
+        size_t getAllocations = 0;
+        for( int n = 0 ; n < 3 ; n++ )
+        {
+            const size_t beforeGet = allocations;
+            myWeather.Get(50.72824,-1.15244,[&downloads](bool pDownloadedOk,const tinyweather::OpenWeatherMap &)
+            {
+                downloads += pDownloadedOk ? 1 : 0;
+            });
+            getAllocations += n > 0 ? allocations - beforeGet : 0;
+        }
+        std::cout << downloads << " downloads, " << getAllocations << " allocations after the first\n";
+    }
+
+    // Made before counting, the channel constructs its three buffers up front.
+    tinyweather::ForecastChannel<tinyweather::OpenWeatherMap> channel("");
+    const size_t beforeChannel = allocations;
+
+    // Moved in whole, then written into the write buffer in place.
+    channel.Publish(std::move(myWeather));
+    channel.Poll();
+    channel.GetWriteBuffer().ProcessWeatherReport(response,length);
+    channel.Publish();
+    channel.Poll();
+
+    const size_t channelUsed = allocations - beforeChannel;
+    std::cout << "2 publishes, " << channelUsed << " allocations, " << channel.GetReadBuffer().mCurrent.mTime.GetDate() << '\n';
+
+    return used == 0 && channelUsed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
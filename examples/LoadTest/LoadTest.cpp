@@ -0,0 +1,429 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "TinyWeather.h"
+#include "TinyWeatherQuery.h"
+
+// Load test for the whole pipeline, download, parse, populate and query, run entirely offline.
+// A local server, forked off so its work is not counted, serves the recorded responses in fixtures/. For each
+// payload and each number of concurrent clients it runs for a while and reports the requests per second, the
+// p50 / p99 / p999 latency of each stage, and the client cpu time and allocations per request.
+// Each client is a thread driving a few OpenWeatherMap objects, one per location, with metrics enabled.
+//
+// Usage: LoadTest [-c 1,2,4,8] [-l locations per client] [-d seconds] [-s server processes] [-f fixtures folder] [-g min requests per second]
+// It exits with a failure if any request fails, or with -g if any run is slower than that, so it can gate a release.
+
+static std::atomic<uint64_t> allocations(0);
+static volatile uint64_t querySink = 0;   //!< So the queries are not optimised away.
+
+void* operator new(size_t pSize)
+{
+    allocations.fetch_add(1,std::memory_order_relaxed);
+    void* memory = malloc(pSize);
+    if( memory == nullptr )
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* pMemory)noexcept{free(pMemory);}
+void operator delete(void* pMemory,size_t)noexcept{free(pMemory);}
+
+struct Fixture
+{
+    std::string mName;          //!< The file name without .json, it's also the path it is served on.
+    std::string mResponse;      //!< Headers and body, ready to send.
+    size_t mBodySize;
+};
+
+static bool LoadFixture(const std::string& pFolder,const std::string& pName,Fixture& rFixture)
+{
+    std::ifstream file(pFolder + "/" + pName + ".json",std::ios::binary);
+    if( !file )
+        return false;
+
+    std::stringstream body;
+    body << file.rdbuf();
+
+    rFixture.mName = pName;
+    rFixture.mBodySize = body.str().size();
+    rFixture.mResponse = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(rFixture.mBodySize) + "\r\n\r\n" + body.str();
+    return true;
+}
+
+static void SendAll(int pSocket,const char* pData,size_t pSize)
+{
+    while( pSize > 0 )
+    {
+        const ssize_t sent = send(pSocket,pData,pSize,MSG_NOSIGNAL);
+        if( sent <= 0 )
+            return;
+        pData += sent;
+        pSize -= sent;
+    }
+}
+
+/**
+ * @brief The stand in for the weather api, a poll loop that answers GET /name?... with the fixture of that name.
+ * Keeps connections open, though the client makes a new one each request.
+ */
+static void RunServer(int pListen,const std::vector<Fixture>& pFixtures)
+{
+    const std::string notFound = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+
+    struct Connection
+    {
+        std::string mRequest;
+    };
+
+    std::vector<pollfd> polls = {{pListen,POLLIN,0}};
+    std::vector<Connection> connections(1);
+    char buffer[4096];
+    for(;;)
+    {
+        if( poll(polls.data(),polls.size(),-1) < 0 )
+            continue;
+
+        if( polls[0].revents & POLLIN )
+        {
+            const int client = accept(pListen,nullptr,nullptr);
+            if( client >= 0 )
+            {
+                polls.push_back({client,POLLIN,0});
+                connections.emplace_back();
+            }
+        }
+
+        for( size_t n = polls.size() - 1 ; n > 0 ; n-- )
+        {
+            if( (polls[n].revents & (POLLIN|POLLHUP|POLLERR)) == 0 )
+                continue;
+
+            const ssize_t got = read(polls[n].fd,buffer,sizeof(buffer));
+            bool close = got <= 0;
+            if( got > 0 )
+            {
+                std::string& request = connections[n].mRequest;
+                request.append(buffer,got);
+                if( request.find("\r\n\r\n") != std::string::npos )
+                {
+                    // GET /name?lat=...
+                    const std::string path = request.substr(5,request.find_first_of("? ",5) - 5);
+                    const auto fixture = std::find_if(pFixtures.begin(),pFixtures.end(),[&path](const Fixture& f){return f.mName == path;});
+                    const std::string& response = fixture != pFixtures.end() ? fixture->mResponse : notFound;
+                    SendAll(polls[n].fd,response.data(),response.size());
+                    close = request.find("Connection: close") != std::string::npos;
+                    request.clear();
+                }
+            }
+
+            if( close )
+            {
+                ::close(polls[n].fd);
+                polls.erase(polls.begin() + n);
+                connections.erase(connections.begin() + n);
+            }
+        }
+    }
+}
+
+/**
+ * @brief The times of every request in a run, for one stage.
+ */
+struct Samples
+{
+    std::vector<double> mSeconds;
+
+    double GetPercentile(double pPercentile)
+    {
+        if( mSeconds.size() == 0 )
+            return 0.0;
+        const size_t index = std::min(mSeconds.size() - 1,(size_t)(pPercentile * mSeconds.size()));
+        std::nth_element(mSeconds.begin(),mSeconds.begin() + index,mSeconds.end());
+        return mSeconds[index];
+    }
+};
+
+// The fetch metrics stages, then the whole Get and the query.
+static const size_t GET_STAGE = tinyweather::FetchMetrics::STAGES;
+static const size_t QUERY_STAGE = GET_STAGE + 1;
+static const size_t STAGE_COUNT = QUERY_STAGE + 1;
+
+static const char* GetStageName(size_t pStage)
+{
+    if( pStage == GET_STAGE )
+        return "get";
+    if( pStage == QUERY_STAGE )
+        return "query";
+    return tinyweather::FetchMetrics::GetStageName((tinyweather::FetchStage)pStage);
+}
+
+struct ClientResults
+{
+    Samples mStages[STAGE_COUNT];
+    uint64_t mRequests = 0;
+    uint64_t mFailures = 0;
+    double mCPUSeconds = 0.0;
+};
+
+static double GetThreadCPUSeconds()
+{
+    timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID,&cpu);
+    return cpu.tv_sec + (cpu.tv_nsec * 1.0e-9);
+}
+
+/**
+ * @brief One client, downloads the weather for each of its locations in turn until told to stop.
+ */
+static void RunClient(const std::string& pURL,size_t pLocations,size_t pClient,const tinyweather::QueryEngine& pQueries,size_t pQueryCount,
+                        std::atomic<size_t>& rReady,const std::atomic<bool>& pGo,const std::atomic<bool>& pStop,ClientResults& rResults)
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::unique_ptr<tinyweather::OpenWeatherMap>> locations;
+    std::vector<tinyweather::ForecastBitmaps> bitmaps(pLocations);
+    for( size_t n = 0 ; n < pLocations ; n++ )
+    {
+        locations.emplace_back(new tinyweather::OpenWeatherMap("loadtest"));
+        locations.back()->SetServerURL(pURL);
+        locations.back()->EnableMetrics(true);
+        // Warm up, so the first allocations of each location are not counted.
+        locations.back()->Get(50.0 + pClient,-1.0 - n,[](bool,const tinyweather::OpenWeatherMap&){});
+    }
+
+    rReady++;
+    while( pGo == false )
+    {
+        std::this_thread::yield();
+    }
+
+    const double startCPU = GetThreadCPUSeconds();
+    uint64_t matches = 0;
+    for( size_t n = 0 ; pStop == false ; n = (n + 1) % pLocations )
+    {
+        tinyweather::OpenWeatherMap& weather = *locations[n];
+        bool downloadedOk = false;
+
+        const Clock::time_point start = Clock::now();
+        weather.Get(50.0 + pClient,-1.0 - n,[&downloadedOk](bool pDownloadedOk,const tinyweather::OpenWeatherMap&){downloadedOk = pDownloadedOk;});
+        const Clock::time_point got = Clock::now();
+
+        rResults.mRequests++;
+        if( downloadedOk == false )
+        {
+            rResults.mFailures++;
+            continue;
+        }
+
+        pQueries.Index(weather,bitmaps[n]);
+        for( size_t q = 0 ; q < pQueryCount ; q++ )
+        {
+            matches += pQueries.Match(q,bitmaps[n]);
+        }
+        const Clock::time_point queried = Clock::now();
+
+        const tinyweather::FetchMetrics& metrics = weather.GetMetrics();
+        for( size_t stage = 0 ; stage < tinyweather::FetchMetrics::STAGES ; stage++ )
+        {
+            rResults.mStages[stage].mSeconds.push_back(metrics.mLast[stage]);
+        }
+        rResults.mStages[GET_STAGE].mSeconds.push_back(std::chrono::duration<double>(got - start).count());
+        rResults.mStages[QUERY_STAGE].mSeconds.push_back(std::chrono::duration<double>(queried - got).count());
+    }
+    rResults.mCPUSeconds = GetThreadCPUSeconds() - startCPU;
+
+    querySink += matches;
+}
+
+static std::vector<size_t> ReadList(const char* pList)
+{
+    std::vector<size_t> values;
+    std::stringstream list(pList);
+    std::string value;
+    while( std::getline(list,value,',') )
+    {
+        values.push_back(std::max(1,atoi(value.c_str())));
+    }
+    return values;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> concurrency = {1,2,4,8};
+    size_t locationsPerClient = 4;
+    double seconds = 3.0;
+    size_t serverProcesses = std::max(1u,std::thread::hardware_concurrency() / 2);
+    std::string folder = "fixtures";
+    double gate = 0.0;
+
+    for( int n = 1 ; n + 1 < argc ; n += 2 )
+    {
+        const std::string option = argv[n];
+        if( option == "-c" )
+            concurrency = ReadList(argv[n+1]);
+        else if( option == "-l" )
+            locationsPerClient = std::max(1,atoi(argv[n+1]));
+        else if( option == "-d" )
+            seconds = atof(argv[n+1]);
+        else if( option == "-s" )
+            serverProcesses = std::max(1,atoi(argv[n+1]));
+        else if( option == "-f" )
+            folder = argv[n+1];
+        else if( option == "-g" )
+            gate = atof(argv[n+1]);
+        else
+        {
+            std::cerr << "Usage: LoadTest [-c 1,2,4,8] [-l locations per client] [-d seconds] [-s server processes] [-f fixtures folder] [-g min requests per second]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Smallest to largest, so the sweep goes up in payload size.
+    std::vector<Fixture> fixtures;
+    for( const char* name : {"current","hourly","onecall"} )
+    {
+        Fixture fixture;
+        if( LoadFixture(folder,name,fixture) == false )
+        {
+            std::cerr << "Failed to load " << folder << "/" << name << ".json\n";
+            return EXIT_FAILURE;
+        }
+        fixtures.push_back(fixture);
+    }
+
+    // The server, started before any threads so it can be forked.
+    const int listenSocket = socket(AF_INET,SOCK_STREAM,0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t addressSize = sizeof(address);
+    if( listenSocket < 0 ||
+        bind(listenSocket,(sockaddr*)&address,sizeof(address)) != 0 ||
+        listen(listenSocket,1024) != 0 ||
+        getsockname(listenSocket,(sockaddr*)&address,&addressSize) != 0 )
+    {
+        std::cerr << "Failed to start the local server\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<pid_t> servers;
+    for( size_t n = 0 ; n < serverProcesses ; n++ )
+    {
+        const pid_t server = fork();
+        if( server == 0 )
+        {
+            RunServer(listenSocket,fixtures);
+            _exit(EXIT_SUCCESS);
+        }
+        servers.push_back(server);
+    }
+    close(listenSocket);
+
+    const std::string server = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/";
+    std::cout << "Server on " << server << " with " << serverProcesses << " processes, " << seconds << " seconds a run, " << locationsPerClient << " locations per client\n";
+
+    // A few typical queries, so the query stage is a realistic amount of work.
+    tinyweather::QueryEngine queries;
+    queries.Compile(tinyweather::ForecastQuery().Where(tinyweather::QueryField::WIND_SPEED,tinyweather::QueryCompare::GREATER,10).Where(tinyweather::QueryField::PRECIPITATION_PROBABILITY,tinyweather::QueryCompare::GREATER,0.5f));
+    queries.Compile(tinyweather::ForecastQuery().Daylight().Is(tinyweather::ConditionClass::CLEAR));
+    queries.Compile(tinyweather::ForecastQuery().Where(tinyweather::QueryField::TEMPERATURE,tinyweather::QueryCompare::LESS,0));
+    queries.Compile(tinyweather::ForecastQuery(tinyweather::QueryTarget::DAILY).Where(tinyweather::QueryField::WIND_GUSTS,tinyweather::QueryCompare::GREATER,20));
+    const size_t queryCount = 4;
+
+    bool passed = true;
+    for( const Fixture& fixture : fixtures )
+    {
+        for( size_t clients : concurrency )
+        {
+            std::vector<ClientResults> results(clients);
+            std::vector<std::thread> threads;
+            std::atomic<size_t> ready(0);
+            std::atomic<bool> go(false);
+            std::atomic<bool> stop(false);
+            for( size_t n = 0 ; n < clients ; n++ )
+            {
+                threads.emplace_back(RunClient,server + fixture.mName,locationsPerClient,n,std::cref(queries),queryCount,std::ref(ready),std::cref(go),std::cref(stop),std::ref(results[n]));
+            }
+
+            while( ready < clients )
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            const uint64_t allocationsBefore = allocations;
+            const auto start = std::chrono::steady_clock::now();
+            go = true;
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+            stop = true;
+            for( auto& thread : threads )
+            {
+                thread.join();
+            }
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const uint64_t allocationsUsed = allocations - allocationsBefore;
+
+            ClientResults total;
+            for( auto& result : results )
+            {
+                total.mRequests += result.mRequests;
+                total.mFailures += result.mFailures;
+                total.mCPUSeconds += result.mCPUSeconds;
+                for( size_t stage = 0 ; stage < STAGE_COUNT ; stage++ )
+                {
+                    auto& to = total.mStages[stage].mSeconds;
+                    const auto& from = result.mStages[stage].mSeconds;
+                    to.insert(to.end(),from.begin(),from.end());
+                }
+            }
+
+            const uint64_t requests = std::max((uint64_t)1,total.mRequests);
+            const double rate = total.mRequests / elapsed;
+            printf("\n%s, %zu bytes, %zu clients: %llu requests, %.1f/s, %llu failed, %.1fus cpu and %.1f allocations per request\n",
+                fixture.mName.c_str(),fixture.mBodySize,clients,(unsigned long long)total.mRequests,rate,(unsigned long long)total.mFailures,
+                total.mCPUSeconds * 1.0e6 / requests,(double)allocationsUsed / requests);
+            printf("    %-12s %10s %10s %10s  (microseconds)\n","stage","p50","p99","p999");
+            for( size_t stage = 0 ; stage < STAGE_COUNT ; stage++ )
+            {
+                Samples& samples = total.mStages[stage];
+                printf("    %-12s %10.1f %10.1f %10.1f\n",GetStageName(stage),samples.GetPercentile(0.5) * 1.0e6,samples.GetPercentile(0.99) * 1.0e6,samples.GetPercentile(0.999) * 1.0e6);
+            }
+
+            if( total.mFailures > 0 || (gate > 0.0 && rate < gate) )
+            {
+                passed = false;
+            }
+        }
+    }
+
+    for( pid_t server : servers )
+    {
+        kill(server,SIGTERM);
+        waitpid(server,nullptr,0);
+    }
+
+    if( gate > 0.0 )
+    {
+        std::cout << (passed ? "\nPassed\n" : "\nFailed\n");
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
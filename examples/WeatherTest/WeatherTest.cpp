@@ -21,14 +21,14 @@ int main(int argc, char *argv[])
     {
         if( pDownloadedOk )
         {
-            std::cout << "Today " << pTheWeather.mCurrent.mDisplay.mDescription << '\n';
+            std::cout << "Today " << pTheWeather.mCurrent.mDisplay.GetDescription() << '\n';
 
             std::cout << "Hourly\n";
             for( const auto& w : pTheWeather.mHourly )
             {
                 std::cout   << "      "
                             << w.mTime.GetDate() << ' ' << w.mTime.GetTime() << ' '
-                            << w.mDisplay.mDescription << ' '
+                            << w.mDisplay.GetDescription() << ' '
                             << w.mTemperature.c << "C\n";
             }
 
@@ -37,7 +37,7 @@ int main(int argc, char *argv[])
             {
                 std::cout   << "      "
                             << w.mTime.GetDate() << ' ' << w.mTime.GetTime() << ' '
-                            << w.mDisplay.mDescription << ' '
+                            << w.mDisplay.GetDescription() << ' '
                             << w.mTemperature.Day.c << "C\n";
             }
 